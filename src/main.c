@@ -8,6 +8,7 @@
 
 #include "mobile-settings-config.h"
 #include "mobile-settings-application.h"
+#include "ms-profile.h"
 
 int
 main (int argc, char *argv[])
@@ -15,6 +16,8 @@ main (int argc, char *argv[])
   g_autoptr (MobileSettingsApplication) app = NULL;
   int ret;
 
+  ms_profile_init ();
+
   bindtextdomain (GETTEXT_PACKAGE, LOCALEDIR);
   bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
   textdomain (GETTEXT_PACKAGE);
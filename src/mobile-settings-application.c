@@ -11,7 +11,11 @@
 #include "mobile-settings-application.h"
 #include "mobile-settings-window.h"
 #include "mobile-settings-plugin.h"
+#include "ms-app-settings-pool.h"
+#include "ms-icon-cache.h"
+#include "ms-panel-registry.h"
 #include "ms-plugin-loader.h"
+#include "ms-profile.h"
 #include "ms-toplevel-tracker.h"
 #include "ms-head-tracker.h"
 #include "mobile-settings-debug-info.h"
@@ -40,15 +44,20 @@ struct _MobileSettingsApplication {
 
   MsPluginLoader *device_plugin_loader;
   GtkWidget      *device_panel;
+  MsAppSettingsPool *app_settings_pool;
+  MsIconCache    *icon_cache;
 
   struct wl_display  *wl_display;
   struct wl_registry *wl_registry;
-  struct zwlr_foreign_toplevel_manager_v1 *foreign_toplevel_manager;
-  struct zwlr_output_manager_v1 *output_manager;
+  gint64              wl_registry_begin;
+  struct wl_callback *wl_registry_sync;
+  uint32_t            foreign_toplevel_manager_name;
+  uint32_t            output_manager_name;
   MsToplevelTracker  *toplevel_tracker;
   MsHeadTracker     *head_tracker;
 
   GHashTable        *wayland_protocols;
+  GHashTable        *wayland_globals;
 };
 
 G_DEFINE_TYPE (MobileSettingsApplication, mobile_settings_application, ADW_TYPE_APPLICATION)
@@ -59,6 +68,11 @@ static const GOptionEntry entries[] = {
     G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
     NULL, "Lists the available panels in phosh-mobile-settings", NULL
   },
+  {
+    "json", '\0',
+    G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
+    NULL, "Use JSON when listing panels", NULL
+  },
   {
     G_OPTION_REMAINING, '\0',
     G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME_ARRAY,
@@ -91,6 +105,81 @@ mobile_settings_application_get_property (GObject    *object,
 
 
 
+static void
+create_trackers (MobileSettingsApplication *self)
+{
+  if (self->toplevel_tracker == NULL && self->foreign_toplevel_manager_name) {
+    struct zwlr_foreign_toplevel_manager_v1 *foreign_toplevel_manager;
+
+    g_debug ("Found foreign toplevel manager. Creating listener.");
+    foreign_toplevel_manager = wl_registry_bind (self->wl_registry,
+                                                 self->foreign_toplevel_manager_name,
+                                                 &zwlr_foreign_toplevel_manager_v1_interface,
+                                                 1);
+    self->toplevel_tracker = ms_toplevel_tracker_new (foreign_toplevel_manager);
+    g_object_notify_by_pspec (G_OBJECT (self), props[PROP_TOPLEVEL_TRACKER]);
+  }
+
+  if (self->head_tracker == NULL && self->output_manager_name) {
+    struct zwlr_output_manager_v1 *output_manager;
+
+    g_debug ("Found output manager. Creating listener.");
+    output_manager = wl_registry_bind (self->wl_registry,
+                                       self->output_manager_name,
+                                       &zwlr_output_manager_v1_interface,
+                                       2);
+    self->head_tracker = ms_head_tracker_new (output_manager);
+    g_object_notify_by_pspec (G_OBJECT (self), props[PROP_HEAD_TRACKER]);
+  }
+}
+
+
+static void
+destroy_toplevel_tracker (MobileSettingsApplication *self)
+{
+  if (self->toplevel_tracker == NULL)
+    return;
+
+  g_debug ("Lost foreign toplevel manager. Destroying listener.");
+
+  /* The manager proxy goes away once the compositor confirms the stop */
+  ms_toplevel_tracker_stop (self->toplevel_tracker);
+  g_clear_object (&self->toplevel_tracker);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_TOPLEVEL_TRACKER]);
+}
+
+
+static void
+destroy_head_tracker (MobileSettingsApplication *self)
+{
+  if (self->head_tracker == NULL)
+    return;
+
+  g_debug ("Lost output manager. Destroying listener.");
+
+  /* The manager proxy goes away once the compositor confirms the stop */
+  ms_head_tracker_stop (self->head_tracker);
+  g_clear_object (&self->head_tracker);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_HEAD_TRACKER]);
+}
+
+
+static gboolean
+has_global (MobileSettingsApplication *self, const char *interface)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, self->wayland_globals);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    if (g_str_equal (value, interface))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+
 static void
 registry_handle_global (void               *data,
                         struct wl_registry *registry,
@@ -100,26 +189,15 @@ registry_handle_global (void               *data,
 {
   MobileSettingsApplication *self = MOBILE_SETTINGS_APPLICATION (data);
 
-  if (strcmp (interface, zwlr_foreign_toplevel_manager_v1_interface.name) == 0) {
-    self->foreign_toplevel_manager =
-      wl_registry_bind (registry, name, &zwlr_foreign_toplevel_manager_v1_interface, 1);
-  } else if (strcmp (interface, zwlr_output_manager_v1_interface.name) == 0) {
-    self->output_manager =
-      wl_registry_bind (registry, name, &zwlr_output_manager_v1_interface, 2);
-  }
-
-  if (self->foreign_toplevel_manager && self->output_manager &&
-      self->toplevel_tracker == NULL) {
-    g_debug ("Found all wayland protocols. Creating listeners.");
-
-    self->toplevel_tracker = ms_toplevel_tracker_new (self->foreign_toplevel_manager);
-    g_object_notify_by_pspec (G_OBJECT (self), props[PROP_TOPLEVEL_TRACKER]);
-
-    self->head_tracker = ms_head_tracker_new (self->output_manager);
-    g_object_notify_by_pspec (G_OBJECT (self), props[PROP_HEAD_TRACKER]);
-  }
+  if (strcmp (interface, zwlr_foreign_toplevel_manager_v1_interface.name) == 0)
+    self->foreign_toplevel_manager_name = name;
+  else if (strcmp (interface, zwlr_output_manager_v1_interface.name) == 0)
+    self->output_manager_name = name;
 
+  g_hash_table_insert (self->wayland_globals, GUINT_TO_POINTER (name), g_strdup (interface));
   g_hash_table_insert (self->wayland_protocols, g_strdup (interface), GUINT_TO_POINTER(version));
+
+  create_trackers (self);
 }
 
 
@@ -128,7 +206,29 @@ registry_handle_global_remove (void               *data,
                                struct wl_registry *registry,
                                uint32_t            name)
 {
-  g_warning ("Global %d removed but not handled", name);
+  MobileSettingsApplication *self = MOBILE_SETTINGS_APPLICATION (data);
+  g_autofree char *interface = NULL;
+
+  if (!g_hash_table_steal_extended (self->wayland_globals, GUINT_TO_POINTER (name),
+                                    NULL, (gpointer *)&interface)) {
+    g_warning ("Unknown global %u removed", name);
+    return;
+  }
+
+  g_debug ("Global %u (%s) removed", name, interface);
+
+  /* E.g. wl_output can be there multiple times */
+  if (!has_global (self, interface))
+    g_hash_table_remove (self->wayland_protocols, interface);
+
+  /* Rebuilt by create_trackers () once the global comes back */
+  if (name == self->foreign_toplevel_manager_name) {
+    self->foreign_toplevel_manager_name = 0;
+    destroy_toplevel_tracker (self);
+  } else if (name == self->output_manager_name) {
+    self->output_manager_name = 0;
+    destroy_head_tracker (self);
+  }
 }
 
 
@@ -138,6 +238,23 @@ static const struct wl_registry_listener registry_listener = {
 };
 
 
+/* All initial globals got announced and bound, no matter which protocols the compositor has */
+static void
+registry_sync_done (void *data, struct wl_callback *callback, uint32_t serial)
+{
+  MobileSettingsApplication *self = MOBILE_SETTINGS_APPLICATION (data);
+
+  ms_profile_end (self->wl_registry_begin, "wayland-registry", NULL);
+  self->wl_registry_begin = 0;
+  g_clear_pointer (&self->wl_registry_sync, wl_callback_destroy);
+}
+
+
+static const struct wl_callback_listener registry_sync_listener = {
+  registry_sync_done,
+};
+
+
 static GtkWindow *
 get_active_window (MobileSettingsApplication *self)
 {
@@ -150,28 +267,35 @@ get_active_window (MobileSettingsApplication *self)
 }
 
 
-static void
-list_available_panels (GApplication *app)
+static gboolean
+is_panel_name_known (const char *name)
 {
-  MobileSettingsWindow *window;
-  g_autoptr (GListModel) list = NULL;
-  g_autoptr (GtkStackPage) page = NULL;
-  const char *name;
+  /* The device panel depends on the plugins available at runtime */
+  if (g_strcmp0 (name, MS_PANEL_NAME_DEVICE) == 0)
+    return TRUE;
 
-  // Since we're in the local instance, just get us a window
-  adw_init ();
+  return ms_panel_registry_lookup (name) != NULL;
+}
 
-  window = g_object_new (MOBILE_SETTINGS_TYPE_WINDOW, NULL);
-  list = G_LIST_MODEL (mobile_settings_window_get_stack_pages (window));
 
-  g_print ("Available panels:\n");
+static void
+list_available_panels (gboolean json)
+{
+  const MsPanelInfo *panels;
+  guint n_panels;
 
-  for (uint i = 0; i < g_list_model_get_n_items (list); ++i) {
-    page = g_list_model_get_item (list, i);
-    name = gtk_stack_page_get_name (page);
+  if (json) {
+    g_autofree char *out = ms_panel_registry_to_json ();
 
-    g_print ("- %s\n", name);
+    g_print ("%s", out);
+    return;
   }
+
+  g_print ("Available panels:\n");
+
+  panels = ms_panel_registry_get_panels (&n_panels);
+  for (guint i = 0; i < n_panels; i++)
+    g_print ("- %s\n", panels[i].name);
 }
 
 
@@ -189,6 +313,11 @@ set_panel_activated (GSimpleAction *action,
 
   g_debug ("'set-panel' '%s'", panel);
 
+  if (!is_panel_name_known (panel)) {
+    g_warning ("Error: panel `%s` not available, launching with default options.", panel);
+    return;
+  }
+
   window = MOBILE_SETTINGS_WINDOW (get_active_window (self));
   panel_switcher = mobile_settings_window_get_panel_switcher (window);
 
@@ -213,10 +342,13 @@ mobile_settings_application_handle_local_options (GApplication *app,
 {
   g_autofree GStrv panels = NULL;
   GApplicationClass *app_class = G_APPLICATION_CLASS (mobile_settings_application_parent_class);
+  gint64 begin = ms_profile_begin ();
+  int ret;
 
   if (g_variant_dict_contains (options, "list")) {
-    list_available_panels (app);
+    list_available_panels (g_variant_dict_contains (options, "json"));
 
+    ms_profile_end (begin, "handle-local-options", NULL);
     return 0;
   } else if (g_variant_dict_lookup (options, G_OPTION_REMAINING, "^a&ay", &panels)) {
     const char *panel;
@@ -224,11 +356,19 @@ mobile_settings_application_handle_local_options (GApplication *app,
     g_return_val_if_fail (panels && panels[0], EXIT_FAILURE);
     panel = panels[0];
 
-    g_application_register (G_APPLICATION (app), NULL, NULL);
-    g_action_group_activate_action (G_ACTION_GROUP (app), "set-panel", g_variant_new ("(s)", panel));
+    /* Check early so we don't need to wait for the primary instance's window */
+    if (is_panel_name_known (panel)) {
+      g_application_register (G_APPLICATION (app), NULL, NULL);
+      g_action_group_activate_action (G_ACTION_GROUP (app), "set-panel", g_variant_new ("(s)", panel));
+    } else {
+      g_warning ("Error: panel `%s` not available, launching with default options.", panel);
+    }
   }
 
-  return app_class->handle_local_options (app, options);
+  ret = app_class->handle_local_options (app, options);
+  ms_profile_end (begin, "handle-local-options", NULL);
+
+  return ret;
 }
 
 
@@ -247,13 +387,18 @@ mobile_settings_application_activate (GApplication *app)
     gdk_display = gdk_display_get_default ();
     self->wl_display = gdk_wayland_display_get_wl_display (gdk_display);
     if (self->wl_display != NULL) {
+      self->wl_registry_begin = ms_profile_begin ();
       self->wl_registry = wl_display_get_registry (self->wl_display);
       wl_registry_add_listener (self->wl_registry, &registry_listener, self);
+      /* Only the initial registry round counts towards startup */
+      self->wl_registry_sync = wl_display_sync (self->wl_display);
+      wl_callback_add_listener (self->wl_registry_sync, &registry_sync_listener, self);
     } else {
       g_critical ("Failed to get display: %m\n");
     }
   }
 
+  ms_profile_track_first_frame (GTK_WIDGET (window));
   gtk_window_present (window);
 }
 
@@ -283,7 +428,11 @@ mobile_settings_application_finalize (GObject *object)
   MobileSettingsApplication *self = MOBILE_SETTINGS_APPLICATION (object);
 
   g_clear_object (&self->device_plugin_loader);
+  g_clear_object (&self->app_settings_pool);
+  g_clear_object (&self->icon_cache);
+  g_clear_pointer (&self->wl_registry_sync, wl_callback_destroy);
   g_clear_pointer (&self->wayland_protocols, g_hash_table_destroy);
+  g_clear_pointer (&self->wayland_globals, g_hash_table_destroy);
 
   G_OBJECT_CLASS (mobile_settings_application_parent_class)->finalize (object);
 }
@@ -315,6 +464,23 @@ mobile_settings_application_class_init (MobileSettingsApplicationClass *klass)
   g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
 }
 
+static void
+on_debug_info_ready (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr (AdwAboutWindow) about_window = ADW_ABOUT_WINDOW (user_data);
+  g_autoptr (GError) err = NULL;
+  g_autofree char *debug_info = NULL;
+
+  debug_info = mobile_settings_generate_debug_info_finish (res, &err);
+  if (debug_info == NULL) {
+    g_warning ("Failed to collect debug info: %s", err->message);
+    return;
+  }
+
+  adw_about_window_set_debug_info (about_window, debug_info);
+}
+
+
 static void
 mobile_settings_application_show_about (GSimpleAction *action,
                                         GVariant      *parameter,
@@ -333,7 +499,8 @@ mobile_settings_application_show_about (GSimpleAction *action,
                                                                       MOBILE_SETTINGS_VERSION));
   adw_about_window_set_developers (about_window, developers);
   adw_about_window_set_artists (about_window, artists);
-  adw_about_window_set_debug_info (about_window, mobile_settings_generate_debug_info ());
+  adw_about_window_set_debug_info (about_window, "Collecting debug information…");
+  mobile_settings_generate_debug_info_async (NULL, on_debug_info_ready, g_object_ref (about_window));
 
   window = gtk_application_get_active_window (GTK_APPLICATION (self));
   gtk_window_set_transient_for (GTK_WINDOW (about_window), window);
@@ -368,10 +535,16 @@ mobile_settings_application_init (MobileSettingsApplication *self)
   g_application_add_main_option_entries (G_APPLICATION (self), entries);
 
   self->device_plugin_loader = ms_plugin_loader_new (plugin_dirs, MS_EXTENSION_POINT_DEVICE_PANEL);
+  self->app_settings_pool = ms_app_settings_pool_new ();
+  self->icon_cache = ms_icon_cache_new ();
   self->wayland_protocols = g_hash_table_new_full (g_str_hash,
                                                    g_str_equal,
                                                    g_free,
                                                    NULL);
+  self->wayland_globals = g_hash_table_new_full (g_direct_hash,
+                                                 g_direct_equal,
+                                                 NULL,
+                                                 g_free);
 }
 
 
@@ -386,6 +559,13 @@ mobile_settings_application_get_device_panel (MobileSettingsApplication *self)
 }
 
 
+MsPluginLoader *
+mobile_settings_application_get_device_plugin_loader (MobileSettingsApplication *self)
+{
+  return self->device_plugin_loader;
+}
+
+
 MsToplevelTracker *
 mobile_settings_application_get_toplevel_tracker (MobileSettingsApplication *self)
 {
@@ -404,6 +584,24 @@ mobile_settings_application_get_head_tracker (MobileSettingsApplication *self)
 }
 
 
+MsAppSettingsPool *
+mobile_settings_application_get_app_settings_pool (MobileSettingsApplication *self)
+{
+  g_assert (MOBILE_SETTINGS_APPLICATION (self));
+
+  return self->app_settings_pool;
+}
+
+
+MsIconCache *
+mobile_settings_application_get_icon_cache (MobileSettingsApplication *self)
+{
+  g_assert (MOBILE_SETTINGS_APPLICATION (self));
+
+  return self->icon_cache;
+}
+
+
 GStrv
 mobile_settings_application_get_wayland_protocols (MobileSettingsApplication *self)
 {
@@ -435,3 +633,88 @@ mobile_settings_application_get_wayland_protocol_version (MobileSettingsApplicat
 
   return GPOINTER_TO_UINT (version);
 }
+
+
+static MsHead *
+find_head_by_name (MobileSettingsApplication *self, const char *name)
+{
+  GListModel *heads;
+
+  if (self->head_tracker == NULL || name == NULL)
+    return NULL;
+
+  heads = ms_head_tracker_get_heads (self->head_tracker);
+  for (guint i = 0; i < g_list_model_get_n_items (heads); i++) {
+    g_autoptr (MsHead) head = g_list_model_get_item (heads, i);
+
+    if (g_strcmp0 (ms_head_get_name (head), name) == 0)
+      return head;
+  }
+
+  return NULL;
+}
+
+/**
+ * mobile_settings_application_lookup_head_for_output:
+ * @self: The application
+ * @output: A `wl_output` e.g. from a toplevel
+ *
+ * Looks up the head for a `wl_output`. Heads and outputs are matched
+ * by their connector name.
+ *
+ * Returns:(transfer none)(nullable): The head
+ */
+MsHead *
+mobile_settings_application_lookup_head_for_output (MobileSettingsApplication *self,
+                                                    struct wl_output          *output)
+{
+  GListModel *monitors;
+
+  g_assert (MOBILE_SETTINGS_APPLICATION (self));
+
+  monitors = gdk_display_get_monitors (gdk_display_get_default ());
+  for (guint i = 0; i < g_list_model_get_n_items (monitors); i++) {
+    g_autoptr (GdkMonitor) monitor = g_list_model_get_item (monitors, i);
+
+    if (!GDK_IS_WAYLAND_MONITOR (monitor))
+      continue;
+
+    if (gdk_wayland_monitor_get_wl_output (monitor) == output)
+      return find_head_by_name (self, gdk_monitor_get_connector (monitor));
+  }
+
+  return NULL;
+}
+
+/**
+ * mobile_settings_application_lookup_output_for_head:
+ * @self: The application
+ * @head: The head
+ *
+ * Looks up the `wl_output` for a head. This is the inverse of
+ * mobile_settings_application_lookup_head_for_output().
+ *
+ * Returns:(transfer none)(nullable): The output
+ */
+struct wl_output *
+mobile_settings_application_lookup_output_for_head (MobileSettingsApplication *self,
+                                                    MsHead                    *head)
+{
+  GListModel *monitors;
+
+  g_assert (MOBILE_SETTINGS_APPLICATION (self));
+  g_assert (MS_IS_HEAD (head));
+
+  monitors = gdk_display_get_monitors (gdk_display_get_default ());
+  for (guint i = 0; i < g_list_model_get_n_items (monitors); i++) {
+    g_autoptr (GdkMonitor) monitor = g_list_model_get_item (monitors, i);
+
+    if (!GDK_IS_WAYLAND_MONITOR (monitor))
+      continue;
+
+    if (g_strcmp0 (gdk_monitor_get_connector (monitor), ms_head_get_name (head)) == 0)
+      return gdk_wayland_monitor_get_wl_output (monitor);
+  }
+
+  return NULL;
+}
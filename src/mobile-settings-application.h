@@ -8,7 +8,10 @@
 
 #pragma once
 
+#include "ms-app-settings-pool.h"
 #include "ms-head-tracker.h"
+#include "ms-icon-cache.h"
+#include "ms-plugin-loader.h"
 #include "ms-toplevel-tracker.h"
 
 #include <adwaita.h>
@@ -21,10 +24,17 @@ G_DECLARE_FINAL_TYPE (MobileSettingsApplication, mobile_settings_application, MO
 
 MobileSettingsApplication *mobile_settings_application_new (gchar *application_id);
 GtkWidget *mobile_settings_application_get_device_panel  (MobileSettingsApplication *self);
+MsPluginLoader *mobile_settings_application_get_device_plugin_loader (MobileSettingsApplication *self);
 MsToplevelTracker *mobile_settings_application_get_toplevel_tracker (MobileSettingsApplication *self);
 MsHeadTracker     *mobile_settings_application_get_head_tracker (MobileSettingsApplication *self);
+MsAppSettingsPool *mobile_settings_application_get_app_settings_pool (MobileSettingsApplication *self);
+MsIconCache       *mobile_settings_application_get_icon_cache (MobileSettingsApplication *self);
 GStrv mobile_settings_application_get_wayland_protocols (MobileSettingsApplication *self);
 guint32 mobile_settings_application_get_wayland_protocol_version (MobileSettingsApplication *self,
                                                                   const char *protocol);
+MsHead *mobile_settings_application_lookup_head_for_output (MobileSettingsApplication *self,
+                                                            struct wl_output          *output);
+struct wl_output *mobile_settings_application_lookup_output_for_head (MobileSettingsApplication *self,
+                                                                      MsHead                    *head);
 
 G_END_DECLS
@@ -10,10 +10,13 @@
 
 #include "mobile-settings-application.h"
 #include "mobile-settings-debug-info.h"
+#include "ms-profile.h"
 
 #define GMOBILE_USE_UNSTABLE_API
 #include <gmobile.h>
 
+#include <string.h>
+
 /* Copied and adapted from gtk/inspector/general.c */
 static void
 get_gtk_info (const char **backend,
@@ -69,33 +72,38 @@ get_flatpak_info (const char *group,
 }
 #endif
 
-static char *
-get_phosh_session_version (void)
-{
-  g_autoptr(GSubprocess) subprocess = NULL;
-  GInputStream *stdout_stream = NULL;
-  g_autoptr(GDataInputStream) data_input_stream = NULL;
-  g_autofree char *version = NULL;
-  g_autoptr(GError) error = NULL;
-
-  subprocess = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE, &error,
-                                 "phosh-session", "--version", NULL);
-
-  if (subprocess == NULL) {
-    g_warning ("Failed to read version: %s", error->message);
-    return NULL;
-  }
+/* Information that doesn't change during the process lifetime */
+static struct {
+  /* Main thread only */
+  const char *backend;
+  const char *renderer;
+  gboolean    phosh_session_version_done;
+  char       *phosh_session_version;
+  /* Filled in by the worker thread */
+  gsize       system_done;
+  char       *os_info;
+  char       *compatibles;
+#ifndef G_OS_WIN32
+  gboolean    flatpak;
+  char       *flatpak_runtime;
+  char       *flatpak_runtime_commit;
+  char       *flatpak_arch;
+  char       *flatpak_version;
+  char       *flatpak_devel;
+#endif
+} cache;
 
-  stdout_stream = g_subprocess_get_stdout_pipe (subprocess);
-  data_input_stream = g_data_input_stream_new (G_INPUT_STREAM (stdout_stream));
-  version = g_data_input_stream_read_line (data_input_stream, NULL, NULL, &error);
+typedef struct {
+  guint  pending;
+  char  *settings;
+} MsDebugInfoData;
 
-  if (version == NULL) {
-    g_warning ("Failed to read version: %s", error->message);
-    return NULL;
-  }
 
-  return g_steal_pointer (&version);
+static void
+ms_debug_info_data_free (MsDebugInfoData *data)
+{
+  g_free (data->settings);
+  g_free (data);
 }
 
 
@@ -118,13 +126,105 @@ get_os_info (void)
 }
 
 
-char *
-mobile_settings_generate_debug_info (void)
+/* Settings in the debug info. Unlike the rest these can change any time */
+static const struct {
+  const char *schema;
+  const char *key;
+} schema[] = {
+  { "sm.puri.phosh.emergency-calls", "enabled" },
+  { "sm.puri.phosh", "automatic-high-contrast" },
+  { "sm.puri.phosh.plugins", "lock-screen" },
+  { "org.gnome.desktop.a11y.applications", "screen-keyboard-enabled" },
+  { "org.gnome.desktop.interface", "gtk-im-module" },
+  { "org.gnome.desktop.input-sources", "sources" },
+
+  /* Power related */
+  { "org.gnome.settings-daemon.plugins.power", "ambient-enabled" },
+  { "org.gnome.settings-daemon.plugins.power", "idle-dim" },
+  { "org.gnome.settings-daemon.plugins.power", "sleep-inactive-battery-timeout" },
+  { "org.gnome.settings-daemon.plugins.power", "sleep-inactive-battery-type" },
+  { "org.gnome.settings-daemon.plugins.power", "sleep-inactive-ac-timeout" },
+  { "org.gnome.settings-daemon.plugins.power", "sleep-inactive-ac-type" },
+
+  /* Screen wakeup */
+  { "sm.puri.phosh.notifications", "wakeup-screen-categories" },
+  { "sm.puri.phosh.notifications", "wakeup-screen-triggers" },
+  { "sm.puri.phosh.notifications", "wakeup-screen-urgency" },
+
+  /* Other phosh related */
+  { "sm.puri.phosh", "app-filter-mode" },
+  { "sm.puri.phosh", "automatic-high-contrast" },
+  { "sm.puri.phoc", "auto-maximize" },
+};
+
+
+static char *
+get_settings_info (void)
 {
   GString *string = g_string_new (NULL);
+  GSettingsSchemaSource *source = g_settings_schema_source_get_default ();
+  g_autoptr (GHashTable) settings = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                          NULL, g_object_unref);
+
+  for (int i = 0; i < G_N_ELEMENTS (schema); i++) {
+    g_autoptr (GSettingsSchema) settings_schema = NULL;
+    g_autoptr (GVariant) value = NULL;
+    g_autofree gchar *result = NULL;
+    GSettings *s;
+
+    settings_schema = g_settings_schema_source_lookup (source, schema[i].schema, TRUE);
+    if (settings_schema == NULL || !g_settings_schema_has_key (settings_schema, schema[i].key)) {
+      g_string_append_printf (string, "- %s '%s': not found\n", schema[i].schema, schema[i].key);
+      continue;
+    }
+
+    /* Several keys come from the same schema */
+    s = g_hash_table_lookup (settings, schema[i].schema);
+    if (s == NULL) {
+      s = g_settings_new_full (settings_schema, NULL, NULL);
+      g_hash_table_insert (settings, (gpointer)schema[i].schema, s);
+    }
+
+    value = g_settings_get_value (s, schema[i].key);
+    result = g_variant_print (value, TRUE);
+    g_string_append_printf (string, "- %s '%s': %s\n", schema[i].schema, schema[i].key, result);
+  }
+
+  return g_string_free (string, FALSE);
+}
+
+
+static void
+get_system_info (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_auto (GStrv) compatibles = NULL;
+
+  cache.os_info = get_os_info ();
+
+  compatibles = gm_device_tree_get_compatibles (NULL, &err);
+  if (compatibles && compatibles[0])
+    cache.compatibles = g_strjoinv (" ", compatibles);
+  else
+    g_debug ("Couldn't get device tree information: %s", err ? err->message : "none");
+
 #ifndef G_OS_WIN32
-  gboolean flatpak = g_file_test ("/.flatpak-info", G_FILE_TEST_EXISTS);
+  cache.flatpak = g_file_test ("/.flatpak-info", G_FILE_TEST_EXISTS);
+  if (cache.flatpak) {
+    cache.flatpak_runtime = get_flatpak_info ("Application", "runtime");
+    cache.flatpak_runtime_commit = get_flatpak_info ("Instance", "runtime-commit");
+    cache.flatpak_arch = get_flatpak_info ("Instance", "arch");
+    cache.flatpak_version = get_flatpak_info ("Instance", "flatpak-version");
+    cache.flatpak_devel = get_flatpak_info ("Instance", "devel");
+  }
 #endif
+}
+
+
+static char *
+build_debug_info (MsDebugInfoData *data)
+{
+  GString *string = g_string_new (NULL);
 
   g_string_append_printf (string, "Mobile Settings: %s\n", MOBILE_SETTINGS_VERSION);
   g_string_append (string, "Compiled against:\n");
@@ -153,42 +253,24 @@ mobile_settings_generate_debug_info (void)
                                                               adw_get_micro_version ());
   g_string_append (string, "\n");
 
-  {
-    g_autofree char *phosh_session_version = get_phosh_session_version ();
-    g_autofree char *os_info = get_os_info ();
-
-    g_string_append (string, "System:\n");
-    g_string_append_printf (string, "- Operating System: %s\n", os_info);
-    g_string_append_printf (string, "- Phosh-session: %s\n", phosh_session_version);
-    g_string_append (string, "\n");
-  }
-
-  {
-    const char *backend, *renderer;
-
-    get_gtk_info (&backend, &renderer);
-
+  g_string_append (string, "System:\n");
+  g_string_append_printf (string, "- Operating System: %s\n", cache.os_info);
+  g_string_append_printf (string, "- Phosh-session: %s\n", cache.phosh_session_version);
+  g_string_append (string, "\n");
 
-    g_string_append (string, "GTK:\n");
-    g_string_append_printf (string, "- GDK backend: %s\n", backend);
-    g_string_append_printf (string, "- GSK renderer: %s\n", renderer);
-    g_string_append (string, "\n");
-  }
+  g_string_append (string, "GTK:\n");
+  g_string_append_printf (string, "- GDK backend: %s\n", cache.backend);
+  g_string_append_printf (string, "- GSK renderer: %s\n", cache.renderer);
+  g_string_append (string, "\n");
 
 #ifndef G_OS_WIN32
-  if (flatpak) {
-    g_autofree char *runtime = get_flatpak_info ("Application", "runtime");
-    g_autofree char *runtime_commit = get_flatpak_info ("Instance", "runtime-commit");
-    g_autofree char *arch = get_flatpak_info ("Instance", "arch");
-    g_autofree char *flatpak_version = get_flatpak_info ("Instance", "flatpak-version");
-    g_autofree char *devel = get_flatpak_info ("Instance", "devel");
-
+  if (cache.flatpak) {
     g_string_append (string, "Flatpak:\n");
-    g_string_append_printf (string, "- Runtime: %s\n", runtime);
-    g_string_append_printf (string, "- Runtime commit: %s\n", runtime_commit);
-    g_string_append_printf (string, "- Arch: %s\n", arch);
-    g_string_append_printf (string, "- Flatpak version: %s\n", flatpak_version);
-    g_string_append_printf (string, "- Devel: %s\n", devel ? "yes" : "no");
+    g_string_append_printf (string, "- Runtime: %s\n", cache.flatpak_runtime);
+    g_string_append_printf (string, "- Runtime commit: %s\n", cache.flatpak_runtime_commit);
+    g_string_append_printf (string, "- Arch: %s\n", cache.flatpak_arch);
+    g_string_append_printf (string, "- Flatpak version: %s\n", cache.flatpak_version);
+    g_string_append_printf (string, "- Devel: %s\n", cache.flatpak_devel ? "yes" : "no");
     g_string_append (string, "\n");
   }
 #endif
@@ -220,48 +302,8 @@ mobile_settings_generate_debug_info (void)
   }
   g_string_append (string, "\n");
 
-  {
-    static struct {
-      const char *schema;
-      const char *key;
-    } const schema[] = {
-      { "sm.puri.phosh.emergency-calls", "enabled" },
-      { "sm.puri.phosh", "automatic-high-contrast" },
-      { "sm.puri.phosh.plugins", "lock-screen" },
-      { "org.gnome.desktop.a11y.applications", "screen-keyboard-enabled" },
-      { "org.gnome.desktop.interface", "gtk-im-module" },
-      { "org.gnome.desktop.input-sources", "sources" },
-
-      /* Power related */
-      { "org.gnome.settings-daemon.plugins.power", "ambient-enabled" },
-      { "org.gnome.settings-daemon.plugins.power", "idle-dim" },
-      { "org.gnome.settings-daemon.plugins.power", "sleep-inactive-battery-timeout" },
-      { "org.gnome.settings-daemon.plugins.power", "sleep-inactive-battery-type" },
-      { "org.gnome.settings-daemon.plugins.power", "sleep-inactive-ac-timeout" },
-      { "org.gnome.settings-daemon.plugins.power", "sleep-inactive-ac-type" },
-
-      /* Screen wakeup */
-      { "sm.puri.phosh.notifications", "wakeup-screen-categories" },
-      { "sm.puri.phosh.notifications", "wakeup-screen-triggers" },
-      { "sm.puri.phosh.notifications", "wakeup-screen-urgency" },
-
-      /* Other phosh related */
-      { "sm.puri.phosh", "app-filter-mode" },
-      { "sm.puri.phosh", "automatic-high-contrast" },
-      { "sm.puri.phoc", "auto-maximize" },
-    };
-
-    g_string_append (string, "Settings:\n");
-
-    for (int i = 0; i < G_N_ELEMENTS (schema); i++) {
-      g_autoptr (GSettings) settings = g_settings_new (schema[i].schema);
-      g_autoptr (GVariant) value;
-      g_autofree gchar *result;
-      value = g_settings_get_value (settings, schema[i].key);
-      result = g_variant_print (value, TRUE);
-      g_string_append_printf (string, "- %s '%s': %s\n", schema[i].schema, schema[i].key, result);
-    }
-  }
+  g_string_append (string, "Settings:\n");
+  g_string_append (string, data->settings);
   g_string_append (string, "\n");
 
   g_string_append_printf (string, "Wayland Protocols\n");
@@ -280,20 +322,216 @@ mobile_settings_generate_debug_info (void)
   }
   g_string_append (string, "\n");
 
-  g_string_append_printf (string, "Hardware Information:\n");
+  g_string_append (string, "Wayland activity:\n");
   {
-    g_autoptr (GError) err = NULL;
-    g_auto (GStrv) compatibles = gm_device_tree_get_compatibles (NULL, &err);
+    MobileSettingsApplication *app = MOBILE_SETTINGS_APPLICATION (g_application_get_default ());
+    MsToplevelTracker *toplevel_tracker = mobile_settings_application_get_toplevel_tracker (app);
+    MsHeadTracker *head_tracker = mobile_settings_application_get_head_tracker (app);
 
-    if (compatibles && compatibles[0]) {
-      g_autofree char *compatible_str = g_strjoinv(" ", compatibles);
+    if (toplevel_tracker) {
+      MsWaylandStats *stats = ms_toplevel_tracker_get_stats (toplevel_tracker);
+      g_autofree char *report = ms_wayland_stats_get_report (stats);
 
-      g_string_append_printf (string, "- DT compatibles: %s\n", compatible_str);
-    } else {
-      g_debug ("Couldn't get device tree information: %s", err->message);
-      g_string_append (string, "Not a device tree device\n");
+      g_string_append (string, report);
     }
+
+    if (head_tracker) {
+      MsWaylandStats *stats = ms_head_tracker_get_stats (head_tracker);
+      g_autofree char *report = ms_wayland_stats_get_report (stats);
+
+      g_string_append (string, report);
+    }
+
+    if (toplevel_tracker == NULL && head_tracker == NULL)
+      g_string_append (string, "- No trackers\n");
+  }
+  g_string_append (string, "\n");
+
+  g_string_append_printf (string, "Hardware Information:\n");
+  if (cache.compatibles)
+    g_string_append_printf (string, "- DT compatibles: %s\n", cache.compatibles);
+  else
+    g_string_append (string, "Not a device tree device\n");
+  g_string_append (string, "\n");
+
+  g_string_append (string, "Device plugins:\n");
+  {
+    MobileSettingsApplication *app = MOBILE_SETTINGS_APPLICATION (g_application_get_default ());
+    MsPluginLoader *loader = mobile_settings_application_get_device_plugin_loader (app);
+    g_autofree char *plugins = ms_plugin_loader_get_debug_info (loader);
+
+    g_string_append (string, plugins);
+  }
+  g_string_append (string, "\n");
+
+  g_string_append (string, "Startup profile:\n");
+  {
+    g_autofree char *report = ms_profile_get_report ();
+
+    g_string_append (string, report);
   }
 
   return g_string_free (string, FALSE);
 }
+
+
+static void
+debug_info_section_done (GTask *task)
+{
+  MsDebugInfoData *data = g_task_get_task_data (task);
+
+  g_assert (data->pending > 0);
+  data->pending--;
+  if (data->pending)
+    return;
+
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  g_task_return_pointer (task, build_debug_info (data), g_free);
+}
+
+
+static void
+on_phosh_session_version_ready (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr (GTask) task = G_TASK (user_data);
+  g_autoptr (GError) err = NULL;
+  g_autofree char *out = NULL;
+
+  if (!g_subprocess_communicate_utf8_finish (G_SUBPROCESS (source_object), res, &out, NULL, &err)) {
+    if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_warning ("Failed to read version: %s", err->message);
+      cache.phosh_session_version_done = TRUE;
+    }
+  } else if (!cache.phosh_session_version_done) {
+    /* Only the first line */
+    cache.phosh_session_version = out ? g_strndup (out, strcspn (out, "\n")) : NULL;
+    cache.phosh_session_version_done = TRUE;
+  }
+
+  debug_info_section_done (task);
+}
+
+
+static void
+get_phosh_session_version_async (GTask *task)
+{
+  g_autoptr (GSubprocess) subprocess = NULL;
+  g_autoptr (GError) err = NULL;
+
+  subprocess = g_subprocess_new (G_SUBPROCESS_FLAGS_STDOUT_PIPE, &err,
+                                 "phosh-session", "--version", NULL);
+  if (subprocess == NULL) {
+    g_warning ("Failed to read version: %s", err->message);
+    cache.phosh_session_version_done = TRUE;
+    debug_info_section_done (task);
+    return;
+  }
+
+  g_subprocess_communicate_utf8_async (subprocess,
+                                       NULL,
+                                       g_task_get_cancellable (task),
+                                       on_phosh_session_version_ready,
+                                       g_object_ref (task));
+}
+
+
+static gboolean
+probe_renderer (gpointer user_data)
+{
+  GTask *task = G_TASK (user_data);
+
+  /* Needs to happen on the main thread so do it while the rest is collected */
+  if (cache.renderer == NULL)
+    get_gtk_info (&cache.backend, &cache.renderer);
+
+  debug_info_section_done (task);
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+collect_thread (GTask        *task,
+                gpointer      source_object,
+                gpointer      task_data,
+                GCancellable *cancellable)
+{
+  if (g_once_init_enter (&cache.system_done)) {
+    get_system_info ();
+    g_once_init_leave (&cache.system_done, TRUE);
+  }
+
+  g_task_return_pointer (task, get_settings_info (), g_free);
+}
+
+
+static void
+on_collect_thread_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr (GTask) task = G_TASK (user_data);
+  MsDebugInfoData *data = g_task_get_task_data (task);
+
+  data->settings = g_task_propagate_pointer (G_TASK (res), NULL);
+  debug_info_section_done (task);
+}
+
+/**
+ * mobile_settings_generate_debug_info_async:
+ * @cancellable: A cancellable
+ * @callback: The callback to invoke when done
+ * @user_data: User data for the callback
+ *
+ * Collects the debug information. The individual parts are collected
+ * in parallel and information that doesn't change is only gathered
+ * once per process.
+ */
+void
+mobile_settings_generate_debug_info_async (GCancellable        *cancellable,
+                                           GAsyncReadyCallback  callback,
+                                           gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+  g_autoptr (GTask) collect_task = NULL;
+  MsDebugInfoData *data = g_new0 (MsDebugInfoData, 1);
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, mobile_settings_generate_debug_info_async);
+  g_task_set_task_data (task, data, (GDestroyNotify) ms_debug_info_data_free);
+
+  /* Keep the task alive until all sections are done */
+  data->pending = 1;
+
+  if (!cache.phosh_session_version_done) {
+    data->pending++;
+    get_phosh_session_version_async (task);
+  }
+
+  if (cache.renderer == NULL) {
+    data->pending++;
+    g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, probe_renderer, g_object_ref (task), g_object_unref);
+  }
+
+  data->pending++;
+  collect_task = g_task_new (NULL, cancellable, on_collect_thread_done, g_object_ref (task));
+  g_task_run_in_thread (collect_task, collect_thread);
+
+  debug_info_section_done (task);
+}
+
+/**
+ * mobile_settings_generate_debug_info_finish:
+ * @res: The async result
+ * @error: The error
+ *
+ * Finishes an operation started with mobile_settings_generate_debug_info_async ().
+ *
+ * Returns:(transfer full): The debug information
+ */
+char *
+mobile_settings_generate_debug_info_finish (GAsyncResult *res, GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, NULL), NULL);
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
@@ -10,6 +10,10 @@
 
 G_BEGIN_DECLS
 
-char *mobile_settings_generate_debug_info (void);
+void  mobile_settings_generate_debug_info_async  (GCancellable        *cancellable,
+                                                 GAsyncReadyCallback  callback,
+                                                 gpointer             user_data);
+char *mobile_settings_generate_debug_info_finish (GAsyncResult        *res,
+                                                 GError             **error);
 
 G_END_DECLS
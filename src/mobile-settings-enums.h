@@ -47,4 +47,22 @@ typedef enum {
   MS_PHOSH_NOTIFY_SCREEN_WAKEUP_FLAG_CATEGORY = (1 << 2),
 } MsPhoshNotifyScreenWakeupFlags;
 
+/**
+ * MsToplevelState:
+ * @MS_TOPLEVEL_STATE_NONE: No special state
+ * @MS_TOPLEVEL_STATE_MAXIMIZED: The toplevel is maximized
+ * @MS_TOPLEVEL_STATE_MINIMIZED: The toplevel is minimized
+ * @MS_TOPLEVEL_STATE_ACTIVATED: The toplevel is active
+ * @MS_TOPLEVEL_STATE_FULLSCREEN: The toplevel is fullscreen
+ *
+ * The state of a toplevel as reported by the compositor
+ */
+typedef enum {
+  MS_TOPLEVEL_STATE_NONE       = 0, /*< skip >*/
+  MS_TOPLEVEL_STATE_MAXIMIZED  = (1 << 0),
+  MS_TOPLEVEL_STATE_MINIMIZED  = (1 << 1),
+  MS_TOPLEVEL_STATE_ACTIVATED  = (1 << 2),
+  MS_TOPLEVEL_STATE_FULLSCREEN = (1 << 3),
+} MsToplevelState;
+
 G_END_DECLS
@@ -13,9 +13,10 @@
 #include "mobile-settings-application.h"
 #include "mobile-settings-window.h"
 
-#include "ms-compositor-panel.h"
-#include "ms-feedback-panel.h"
+#include "ms-lazy-panel.h"
+#include "ms-panel-registry.h"
 #include "ms-plugin-panel.h"
+#include "ms-profile.h"
 
 #include <glib/gi18n.h>
 
@@ -34,6 +35,12 @@ G_DEFINE_TYPE (MobileSettingsWindow, mobile_settings_window, ADW_TYPE_APPLICATIO
 static void
 on_visible_child_changed (MobileSettingsWindow *self)
 {
+  GtkWidget *child = gtk_stack_get_visible_child (self->stack);
+
+  /* Panels are only built once they're shown */
+  if (MS_IS_LAZY_PANEL (child))
+    ms_lazy_panel_ensure_panel (MS_LAZY_PANEL (child));
+
   adw_navigation_split_view_set_show_content (self->split_view, TRUE);
 }
 
@@ -89,9 +96,6 @@ mobile_settings_window_class_init (MobileSettingsWindowClass *klass)
 
   object_class->constructed = ms_settings_window_constructed;
 
-  g_type_ensure (MS_TYPE_COMPOSITOR_PANEL);
-  g_type_ensure (MS_TYPE_FEEDBACK_PANEL);
-
   gtk_widget_class_set_template_from_resource (widget_class,
                                                "/mobi/phosh/MobileSettings/ui/mobile-settings-window.ui");
   gtk_widget_class_bind_template_child (widget_class, MobileSettingsWindow, split_view);
@@ -101,10 +105,44 @@ mobile_settings_window_class_init (MobileSettingsWindowClass *klass)
   gtk_widget_class_bind_template_callback (widget_class, stack_child_to_tile);
 }
 
+static void
+add_registered_panels (MobileSettingsWindow *self)
+{
+  const MsPanelInfo *panels;
+  guint n_panels;
+
+  panels = ms_panel_registry_get_panels (&n_panels);
+  for (guint i = 0; i < n_panels; i++) {
+    const MsPanelInfo *info = &panels[i];
+    GtkStackPage *page;
+
+    if (info->get_type) {
+      MsLazyPanel *panel = ms_lazy_panel_new (info->get_type ());
+
+      page = gtk_stack_add_named (self->stack, GTK_WIDGET (panel), info->name);
+    } else {
+      /* Part of the template, only the metadata comes from the registry */
+      GtkWidget *child = gtk_stack_get_child_by_name (self->stack, info->name);
+
+      g_return_if_fail (child);
+      page = gtk_stack_get_page (self->stack, child);
+    }
+
+    gtk_stack_page_set_title (page, _(info->title));
+    gtk_stack_page_set_icon_name (page, info->icon_name);
+  }
+}
+
+
 static void
 mobile_settings_window_init (MobileSettingsWindow *self)
 {
+  gint64 begin = ms_profile_begin ();
+
   gtk_widget_init_template (GTK_WIDGET (self));
+  ms_profile_end (begin, "template", G_OBJECT_TYPE_NAME (self));
+
+  add_registered_panels (self);
   on_visible_child_changed (self);
 }
 
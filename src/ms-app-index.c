@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ms-app-index"
+
+#include "mobile-settings-config.h"
+
+#include "ms-app-index.h"
+#include "ms-util.h"
+
+#include <gio/gdesktopappinfo.h>
+
+/**
+ * MsAppIndex:
+ *
+ * An on disk index of the apps that set a boolean desktop file key
+ * (like `X-Phosh-UsesFeedback`) to true.
+ *
+ * The index is stored in `$XDG_CACHE_HOME` as a serialized GVariant so
+ * it can be used directly from the mmap()ed file. It has an entry per
+ * XDG application directory that records the mtimes of the directory
+ * and all its subdirectories, all desktop file ids in it (to get
+ * precedence between directories right) and the matching apps. Only
+ * directories where one of these mtimes changed get rescanned. As
+ * package managers replace desktop files atomically this catches apps
+ * getting installed, updated or removed.
+ */
+
+#define INDEX_VERSION 2
+#define INDEX_ENTRY_TYPE "(ssss)"
+#define INDEX_STAMP_TYPE "(sx)"
+#define INDEX_DIR_TYPE "(a" INDEX_STAMP_TYPE "asa" INDEX_ENTRY_TYPE ")"
+#define INDEX_DIRS_TYPE "a{s" INDEX_DIR_TYPE "}"
+#define INDEX_TYPE "(us" INDEX_DIRS_TYPE ")"
+
+#define DESKTOP_FILE_SUFFIX ".desktop"
+
+
+void
+ms_app_index_entry_free (MsAppIndexEntry *entry)
+{
+  g_return_if_fail (entry);
+
+  g_ref_string_release (entry->app_id);
+  g_free (entry->name);
+  g_free (entry->icon);
+  g_ref_string_release (entry->munged_app_id);
+  g_free (entry);
+}
+
+
+static char *
+get_index_name (const char *key)
+{
+  return g_strdup_printf ("apps-%s.gvariant", key);
+}
+
+
+/* The XDG application dirs, highest precedence first */
+static GStrv
+get_app_dirs (void)
+{
+  const char * const *data_dirs = g_get_system_data_dirs ();
+  g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+  g_autofree char *user_dir = g_build_filename (g_get_user_data_dir (), "applications", NULL);
+
+  g_strv_builder_add (builder, user_dir);
+  for (int i = 0; data_dirs[i]; i++) {
+    g_autofree char *dir = g_build_filename (data_dirs[i], "applications", NULL);
+
+    g_strv_builder_add (builder, dir);
+  }
+
+  return g_strv_builder_end (builder);
+}
+
+
+static void
+scan_dir (const char      *key,
+          const char      *path,
+          const char      *id_prefix,
+          GVariantBuilder *stamps,
+          GVariantBuilder *ids,
+          GVariantBuilder *apps,
+          GCancellable    *cancellable)
+{
+  g_autoptr (GDir) dir = NULL;
+  const char *name;
+  gint64 mtime;
+
+  /* Before reading the dir so changes while scanning invalidate the index */
+  mtime = ms_get_mtime (path);
+  g_variant_builder_add (stamps, INDEX_STAMP_TYPE, path, mtime);
+
+  dir = g_dir_open (path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir))) {
+    g_autofree char *filename = g_build_filename (path, name, NULL);
+    g_autofree char *app_id = NULL;
+    g_autofree char *icon = NULL;
+    g_autofree char *munged_app_id = NULL;
+    g_autoptr (GDesktopAppInfo) app_info = NULL;
+    GIcon *gicon;
+
+    if (g_cancellable_is_cancelled (cancellable))
+      return;
+
+    /* Desktop file ids in subdirs use '-' as separator */
+    if (g_file_test (filename, G_FILE_TEST_IS_DIR)) {
+      g_autofree char *prefix = g_strconcat (id_prefix, name, "-", NULL);
+
+      scan_dir (key, filename, prefix, stamps, ids, apps, cancellable);
+      continue;
+    }
+
+    if (!g_str_has_suffix (name, DESKTOP_FILE_SUFFIX))
+      continue;
+
+    app_id = g_strconcat (id_prefix, name, NULL);
+    g_variant_builder_add (ids, "s", app_id);
+
+    app_info = g_desktop_app_info_new_from_filename (filename);
+    if (app_info == NULL || !g_desktop_app_info_get_boolean (app_info, key))
+      continue;
+
+    gicon = g_app_info_get_icon (G_APP_INFO (app_info));
+    if (gicon)
+      icon = g_icon_to_string (gicon);
+
+    munged_app_id = ms_munge_app_id (app_id);
+    g_debug ("App '%s' has %s", app_id, key);
+    g_variant_builder_add (apps, INDEX_ENTRY_TYPE,
+                           app_id,
+                           g_app_info_get_name (G_APP_INFO (app_info)) ?: "",
+                           icon ?: "",
+                           munged_app_id);
+  }
+}
+
+
+static GVariant *
+scan_app_dir (const char *key, const char *app_dir, GCancellable *cancellable)
+{
+  GVariantBuilder stamps, ids, apps;
+
+  g_debug ("Scanning %s", app_dir);
+
+  g_variant_builder_init (&stamps, G_VARIANT_TYPE ("a" INDEX_STAMP_TYPE));
+  g_variant_builder_init (&ids, G_VARIANT_TYPE_STRING_ARRAY);
+  g_variant_builder_init (&apps, G_VARIANT_TYPE ("a" INDEX_ENTRY_TYPE));
+
+  scan_dir (key, app_dir, "", &stamps, &ids, &apps, cancellable);
+
+  return g_variant_new ("(@a" INDEX_STAMP_TYPE "@as@a" INDEX_ENTRY_TYPE ")",
+                        g_variant_builder_end (&stamps),
+                        g_variant_builder_end (&ids),
+                        g_variant_builder_end (&apps));
+}
+
+
+/* Whether the app dir and its subdirs are unchanged since they got indexed */
+static gboolean
+dir_index_is_current (GVariant *dir_index)
+{
+  g_autoptr (GVariant) stamps = g_variant_get_child_value (dir_index, 0);
+  const char *path;
+  gint64 mtime;
+  GVariantIter iter;
+
+  g_variant_iter_init (&iter, stamps);
+  while (g_variant_iter_next (&iter, "(&sx)", &path, &mtime)) {
+    if (ms_get_mtime (path) != mtime) {
+      g_debug ("%s changed", path);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+
+static GVariant *
+load_index (const char *name, const char *locale)
+{
+  g_autoptr (GVariant) index = NULL;
+  const char *index_locale;
+  guint32 version;
+
+  index = ms_cache_load (name, G_VARIANT_TYPE (INDEX_TYPE));
+  if (index == NULL)
+    return NULL;
+
+  g_variant_get_child (index, 0, "u", &version);
+  if (version != INDEX_VERSION) {
+    g_debug ("App index version %u, expected %u", version, INDEX_VERSION);
+    return NULL;
+  }
+
+  /* App names are localized */
+  g_variant_get_child (index, 1, "&s", &index_locale);
+  if (g_strcmp0 (index_locale, locale)) {
+    g_debug ("App index locale '%s' does not match '%s'", index_locale, locale);
+    return NULL;
+  }
+
+  return g_steal_pointer (&index);
+}
+
+
+static void
+emit_dir_entries (GVariant       *dir_index,
+                  GHashTable     *seen,
+                  MsAppIndexFunc  func,
+                  gpointer        user_data)
+{
+  g_autoptr (GVariant) ids = g_variant_get_child_value (dir_index, 1);
+  g_autoptr (GVariant) apps = g_variant_get_child_value (dir_index, 2);
+  const char *app_id, *name, *icon, *munged_app_id;
+  GVariantIter iter;
+
+  g_variant_iter_init (&iter, apps);
+  while (g_variant_iter_next (&iter, "(&s&s&s&s)", &app_id, &name, &icon, &munged_app_id)) {
+    MsAppIndexEntry *entry;
+
+    /* Shadowed by a directory with higher precedence */
+    if (g_hash_table_contains (seen, app_id))
+      continue;
+
+    entry = g_new0 (MsAppIndexEntry, 1);
+    entry->app_id = ms_app_id_intern (app_id);
+    entry->name = g_strdup (name);
+    entry->icon = STR_IS_NULL_OR_EMPTY (icon) ? NULL : g_strdup (icon);
+    entry->munged_app_id = ms_app_id_intern (munged_app_id);
+    (*func) (entry, user_data);
+  }
+
+  g_variant_iter_init (&iter, ids);
+  while (g_variant_iter_next (&iter, "&s", &app_id))
+    g_hash_table_add (seen, g_strdup (app_id));
+}
+
+/**
+ * ms_app_index_query_sync:
+ * @key: The boolean desktop file key to look for
+ * @func: Function invoked for each matching app
+ * @user_data: User data passed to `func`
+ * @cancellable: A cancellable
+ * @error: The error
+ *
+ * Invokes `func` with each app that has `key` set to true. `func`
+ * takes ownership of the passed in entry. Apps are reported per
+ * application directory so they arrive incrementally when directories
+ * need to be rescanned.
+ *
+ * Directories that changed since the last query are rescanned and
+ * the index is updated. As this can block this is meant to be invoked
+ * from a thread.
+ *
+ * Returns: %TRUE on success, otherwise %FALSE
+ */
+gboolean
+ms_app_index_query_sync (const char     *key,
+                         MsAppIndexFunc  func,
+                         gpointer        user_data,
+                         GCancellable   *cancellable,
+                         GError        **error)
+{
+  g_autofree char *index_name = NULL;
+  g_autoptr (GVariant) index = NULL;
+  g_autoptr (GVariant) cached_dirs = NULL;
+  g_autoptr (GHashTable) seen = NULL;
+  g_auto (GStrv) app_dirs = NULL;
+  GVariantBuilder dirs_builder;
+  const char *locale;
+  gboolean changed = FALSE;
+  gsize n_cached = 0, n_dirs = 0;
+
+  g_return_val_if_fail (!STR_IS_NULL_OR_EMPTY (key), FALSE);
+  g_return_val_if_fail (func, FALSE);
+
+  index_name = get_index_name (key);
+  locale = g_get_language_names ()[0];
+  index = load_index (index_name, locale);
+  if (index) {
+    cached_dirs = g_variant_get_child_value (index, 2);
+    n_cached = g_variant_n_children (cached_dirs);
+  }
+
+  seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  app_dirs = get_app_dirs ();
+  g_variant_builder_init (&dirs_builder, G_VARIANT_TYPE (INDEX_DIRS_TYPE));
+
+  for (int i = 0; app_dirs[i]; i++) {
+    const char *app_dir = app_dirs[i];
+    g_autoptr (GVariant) dir_index = NULL;
+
+    if (ms_get_mtime (app_dir) < 0)
+      continue;
+
+    if (cached_dirs)
+      dir_index = g_variant_lookup_value (cached_dirs, app_dir, G_VARIANT_TYPE (INDEX_DIR_TYPE));
+
+    if (dir_index && !dir_index_is_current (dir_index))
+      g_clear_pointer (&dir_index, g_variant_unref);
+
+    if (dir_index == NULL) {
+      dir_index = g_variant_ref_sink (scan_app_dir (key, app_dir, cancellable));
+      changed = TRUE;
+    }
+
+    if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+      g_variant_builder_clear (&dirs_builder);
+      return FALSE;
+    }
+
+    g_variant_builder_add (&dirs_builder, "{s@" INDEX_DIR_TYPE "}", app_dir, dir_index);
+    emit_dir_entries (dir_index, seen, func, user_data);
+    n_dirs++;
+  }
+
+  /* Directories went away */
+  if (n_dirs != n_cached)
+    changed = TRUE;
+
+  if (changed) {
+    g_debug ("Updating app index %s", index_name);
+    ms_cache_save (index_name, g_variant_new ("(us@" INDEX_DIRS_TYPE ")",
+                                              INDEX_VERSION,
+                                              locale,
+                                              g_variant_builder_end (&dirs_builder)));
+  } else {
+    g_variant_builder_clear (&dirs_builder);
+  }
+
+  return TRUE;
+}
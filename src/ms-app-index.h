@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/**
+ * MsAppIndexEntry:
+ * @app_id: The desktop file id
+ * @name: The app's (localized) name
+ * @icon:(nullable): The serialized icon, see g_icon_new_for_string()
+ * @munged_app_id: The munged app id as used for GSettings paths
+ *
+ * An app found by the app index. `app_id` and `munged_app_id` are
+ * interned, see ms_app_id_intern().
+ */
+typedef struct {
+  char *app_id;
+  char *name;
+  char *icon;
+  char *munged_app_id;
+} MsAppIndexEntry;
+
+typedef void (*MsAppIndexFunc) (MsAppIndexEntry *entry, gpointer user_data);
+
+void     ms_app_index_entry_free (MsAppIndexEntry *entry);
+gboolean ms_app_index_query_sync (const char     *key,
+                                  MsAppIndexFunc  func,
+                                  gpointer        user_data,
+                                  GCancellable   *cancellable,
+                                  GError        **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (MsAppIndexEntry, ms_app_index_entry_free)
+
+G_END_DECLS
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ms-app-settings-pool"
+
+#include "mobile-settings-config.h"
+
+#include "ms-app-settings-pool.h"
+
+#define G_SETTINGS_ENABLE_BACKEND
+#include <gio/gsettingsbackend.h>
+
+#include <dconf.h>
+
+/**
+ * MsAppSettingsPool:
+ *
+ * Hands out the relocatable per application `GSettings` objects
+ * (like `sm.puri.phoc.application`) keyed by schema and munged
+ * app-id. As long as someone holds a reference to the settings for
+ * an app the same object is handed out again so every settings path
+ * is monitored at most once no matter how many rows show it.
+ *
+ * The pool doesn't keep the settings alive itself, it only tracks
+ * them via weak references.
+ *
+ * It also allows to change a key for many apps at once, see
+ * ms_app_settings_pool_set_value().
+ */
+
+struct _MsAppSettingsPool {
+  GObject     parent;
+
+  /* "schema:path" -> unowned GSettings */
+  GHashTable *settings;
+
+  DConfClient *dconf;
+};
+G_DEFINE_TYPE (MsAppSettingsPool, ms_app_settings_pool, G_TYPE_OBJECT)
+
+
+static gboolean
+is_settings (gpointer key, gpointer value, gpointer user_data)
+{
+  return value == user_data;
+}
+
+
+static void
+on_settings_finalized (gpointer data, GObject *where_the_object_was)
+{
+  MsAppSettingsPool *self = MS_APP_SETTINGS_POOL (data);
+
+  g_hash_table_foreach_remove (self->settings, is_settings, where_the_object_was);
+}
+
+
+static void
+ms_app_settings_pool_finalize (GObject *object)
+{
+  MsAppSettingsPool *self = MS_APP_SETTINGS_POOL (object);
+  GHashTableIter iter;
+  gpointer settings;
+
+  g_hash_table_iter_init (&iter, self->settings);
+  while (g_hash_table_iter_next (&iter, NULL, &settings))
+    g_object_weak_unref (settings, on_settings_finalized, self);
+
+  g_clear_pointer (&self->settings, g_hash_table_destroy);
+  g_clear_object (&self->dconf);
+
+  G_OBJECT_CLASS (ms_app_settings_pool_parent_class)->finalize (object);
+}
+
+
+static void
+ms_app_settings_pool_class_init (MsAppSettingsPoolClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ms_app_settings_pool_finalize;
+}
+
+
+static void
+ms_app_settings_pool_init (MsAppSettingsPool *self)
+{
+  self->settings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+}
+
+
+MsAppSettingsPool *
+ms_app_settings_pool_new (void)
+{
+  return MS_APP_SETTINGS_POOL (g_object_new (MS_TYPE_APP_SETTINGS_POOL, NULL));
+}
+
+/**
+ * ms_app_settings_pool_get:
+ * @self: The settings pool
+ * @schema_id: The relocatable schema's id
+ * @path_prefix: The path the per app settings live under, e.g.
+ *   `/sm/puri/phoc/application/`
+ * @munged_app_id: The munged app id, see ms_munge_app_id()
+ *
+ * Gets the settings for the app at `path_prefix` + `munged_app_id`.
+ * If the settings for the app are still in use elsewhere these are
+ * returned, otherwise new settings are created.
+ *
+ * Returns:(transfer full): The app's settings
+ */
+GSettings *
+ms_app_settings_pool_get (MsAppSettingsPool *self,
+                          const char        *schema_id,
+                          const char        *path_prefix,
+                          const char        *munged_app_id)
+{
+  g_autofree char *path = NULL;
+  g_autofree char *key = NULL;
+  GSettings *settings;
+
+  g_return_val_if_fail (MS_IS_APP_SETTINGS_POOL (self), NULL);
+  g_return_val_if_fail (schema_id, NULL);
+  g_return_val_if_fail (path_prefix, NULL);
+  g_return_val_if_fail (munged_app_id, NULL);
+
+  path = g_strconcat (path_prefix, munged_app_id, "/", NULL);
+  key = g_strconcat (schema_id, ":", path, NULL);
+
+  settings = g_hash_table_lookup (self->settings, key);
+  if (settings)
+    return g_object_ref (settings);
+
+  g_debug ("Monitoring settings path: %s", path);
+  settings = g_settings_new_with_path (schema_id, path);
+  g_object_weak_ref (G_OBJECT (settings), on_settings_finalized, self);
+  g_hash_table_insert (self->settings, g_steal_pointer (&key), settings);
+
+  return settings;
+}
+
+
+static gboolean
+uses_dconf (void)
+{
+  g_autoptr (GSettingsBackend) backend = g_settings_backend_get_default ();
+
+  return g_str_equal (G_OBJECT_TYPE_NAME (backend), "DConfSettingsBackend");
+}
+
+/*
+ * GSettings can only batch changes to a single path, so each app
+ * becomes a separate write. Used when not running on dconf.
+ */
+static void
+set_value_delayed (const char         *schema_id,
+                   const char         *path_prefix,
+                   const char * const *munged_app_ids,
+                   const char         *key,
+                   GVariant           *value)
+{
+  for (guint i = 0; munged_app_ids[i]; i++) {
+    g_autofree char *path = g_strconcat (path_prefix, munged_app_ids[i], "/", NULL);
+    /* Not pooled: delay mode can't be left again */
+    g_autoptr (GSettings) settings = g_settings_new_with_path (schema_id, path);
+
+    g_settings_delay (settings);
+    if (value)
+      g_settings_set_value (settings, key, value);
+    else
+      g_settings_reset (settings, key);
+    g_settings_apply (settings);
+  }
+}
+
+/**
+ * ms_app_settings_pool_set_value:
+ * @self: The settings pool
+ * @schema_id: The relocatable schema's id
+ * @path_prefix: The path the per app settings live under
+ * @munged_app_ids: %NULL terminated array of munged app ids
+ * @key: The key to set
+ * @value:(nullable): The value to set or %NULL to reset the key
+ *
+ * Sets `key` to `value` for all the given apps. With dconf all
+ * changes are written in a single transaction so readers like phoc
+ * or feedbackd see one burst of change notifications instead of a
+ * write per app. If @value is floating it is consumed.
+ */
+void
+ms_app_settings_pool_set_value (MsAppSettingsPool  *self,
+                                const char         *schema_id,
+                                const char         *path_prefix,
+                                const char * const *munged_app_ids,
+                                const char         *key,
+                                GVariant           *value)
+{
+  DConfChangeset *changeset;
+  g_autoptr (GVariant) sunk = NULL;
+  g_autoptr (GError) err = NULL;
+
+  g_return_if_fail (MS_IS_APP_SETTINGS_POOL (self));
+  g_return_if_fail (schema_id);
+  g_return_if_fail (path_prefix);
+  g_return_if_fail (munged_app_ids);
+  g_return_if_fail (key);
+
+  if (value)
+    sunk = g_variant_ref_sink (value);
+
+  if (munged_app_ids[0] == NULL)
+    return;
+
+  if (!uses_dconf ()) {
+    set_value_delayed (schema_id, path_prefix, munged_app_ids, key, sunk);
+    return;
+  }
+
+  changeset = dconf_changeset_new ();
+  for (guint i = 0; munged_app_ids[i]; i++) {
+    g_autofree char *path = g_strconcat (path_prefix, munged_app_ids[i], "/", key, NULL);
+
+    dconf_changeset_set (changeset, path, sunk);
+  }
+
+  if (self->dconf == NULL)
+    self->dconf = dconf_client_new ();
+
+  g_debug ("Setting %s for %u apps", key, g_strv_length ((GStrv) munged_app_ids));
+  if (!dconf_client_change_fast (self->dconf, changeset, &err))
+    g_warning ("Failed to set %s: %s", key, err->message);
+
+  dconf_changeset_unref (changeset);
+}
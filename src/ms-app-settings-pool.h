@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define MS_TYPE_APP_SETTINGS_POOL (ms_app_settings_pool_get_type ())
+
+G_DECLARE_FINAL_TYPE (MsAppSettingsPool, ms_app_settings_pool, MS, APP_SETTINGS_POOL, GObject)
+
+MsAppSettingsPool *ms_app_settings_pool_new (void);
+GSettings         *ms_app_settings_pool_get (MsAppSettingsPool *self,
+                                             const char        *schema_id,
+                                             const char        *path_prefix,
+                                             const char        *munged_app_id);
+void               ms_app_settings_pool_set_value (MsAppSettingsPool  *self,
+                                                   const char         *schema_id,
+                                                   const char         *path_prefix,
+                                                   const char * const *munged_app_ids,
+                                                   const char         *key,
+                                                   GVariant           *value);
+
+G_END_DECLS
@@ -168,8 +168,18 @@ create_fav_app (gpointer item, gpointer user_data)
   GtkWidget *app = gtk_button_new ();
   GAppInfo *app_info = G_APP_INFO (item);
   MsApplicationsPanel *self = MS_APPLICATIONS_PANEL (user_data);
-  GIcon *icon = g_app_info_get_icon (app_info);
-  GtkWidget *img = gtk_image_new_from_gicon (icon);
+  MobileSettingsApplication *msa = MOBILE_SETTINGS_APPLICATION (g_application_get_default ());
+  g_autoptr (GIcon) icon = g_app_info_get_icon (app_info);
+  GtkWidget *img;
+
+  if (icon)
+    g_object_ref (icon);
+  else
+    icon = g_themed_icon_new ("application-x-executable");
+
+  img = ms_icon_cache_new_image (mobile_settings_application_get_icon_cache (msa), icon,
+                                 FAVORITES_LIST_ICON_SIZE,
+                                 gtk_widget_get_scale_factor (GTK_WIDGET (self)));
 
   gtk_image_set_pixel_size (GTK_IMAGE (img), FAVORITES_LIST_ICON_SIZE);
 
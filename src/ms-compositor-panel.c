@@ -13,10 +13,31 @@
 #include "mobile-settings-application.h"
 #include "ms-compositor-panel.h"
 #include "ms-scale-to-fit-row.h"
+#include "ms-util.h"
+
+#include <dconf.h>
+#include <glib/gi18n.h>
+
+#include <string.h>
 
 /* Verbatim from compositor */
 #define COMPOSITOR_SCHEMA_ID "sm.puri.phoc"
 #define COMPOSITOR_KEY_SCALE_TO_FIT "scale-to-fit"
+#define APP_SCHEMA "sm.puri.phoc.application"
+#define APP_PREFIX "/sm/puri/phoc/application/"
+#define APP_KEY_SCALE_TO_FIT "scale-to-fit"
+
+/* A persisted per app override. Rows are only created for the visible ones */
+#define MS_TYPE_APP_OVERRIDE (ms_app_override_get_type ())
+G_DECLARE_FINAL_TYPE (MsAppOverride, ms_app_override, MS, APP_OVERRIDE, GObject)
+
+struct _MsAppOverride {
+  GObject    parent;
+
+  char      *app_id;
+  char      *name;
+};
+G_DEFINE_TYPE (MsAppOverride, ms_app_override, G_TYPE_OBJECT)
 
 
 struct _MsCompositorPanel {
@@ -25,84 +46,515 @@ struct _MsCompositorPanel {
   GSettings *settings;
   GtkWidget *scale_to_fit_switch;
 
-  GtkListBox *running_apps_listbox;
-  GListStore *running_apps_rows;
+  GtkListView *running_apps_listview;
+  GtkSelectionModel *running_apps_selection;
+  GtkSwitch *bulk_scale_to_fit_switch;
+  GtkWidget *apply_selected_button;
   MsToplevelTracker *tracker;
+
+  GtkListView *overrides_listview;
+  GtkStringFilter *overrides_filter;
+  GListStore *overrides;
+  DConfClient *dconf;
+  guint reload_overrides_id;
+  /* munged app-id -> MsAppOverride of the installed apps */
+  GHashTable *app_ids;
+  GCancellable *load_app_ids_cancel;
 };
 
 G_DEFINE_TYPE (MsCompositorPanel, ms_compositor_panel, ADW_TYPE_BIN)
 
 
 static void
-add_application_row (MsCompositorPanel *self, const char *app_id)
+ms_app_override_finalize (GObject *object)
 {
-  MsScaleToFitRow *row;
+  MsAppOverride *override = MS_APP_OVERRIDE (object);
 
-  row = ms_scale_to_fit_row_new (app_id);
-  g_list_store_append (self->running_apps_rows, row);
+  g_clear_pointer (&override->app_id, g_ref_string_release);
+  g_clear_pointer (&override->name, g_free);
+
+  G_OBJECT_CLASS (ms_app_override_parent_class)->finalize (object);
 }
 
 
 static void
-remove_application_row (MsCompositorPanel *self, const char *app_id)
+ms_app_override_class_init (MsAppOverrideClass *klass)
 {
-  for (guint pos = 0; pos < g_list_model_get_n_items (G_LIST_MODEL (self->running_apps_rows)); pos++) {
-    MsScaleToFitRow *row = g_list_model_get_item (G_LIST_MODEL (self->running_apps_rows), pos);
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ms_app_override_finalize;
+}
+
+
+static void
+ms_app_override_init (MsAppOverride *override)
+{
+}
+
+
+static char *
+app_override_get_search_text (MsAppOverride *override, gpointer user_data)
+{
+  return g_strdup_printf ("%s %s", override->name, override->app_id);
+}
+
+
+static int
+app_override_compare (gconstpointer a, gconstpointer b)
+{
+  MsAppOverride *override_a = *((MsAppOverride **) a);
+  MsAppOverride *override_b = *((MsAppOverride **) b);
+
+  return g_utf8_collate (override_a->name, override_b->name);
+}
 
-    if (g_strcmp0 (ms_scale_to_fit_row_get_app_id (row), app_id) == 0) {
-      g_list_store_remove (self->running_apps_rows, pos);
-      break;
+
+static void
+update_row_subtitle (MsRunningApp *app, GParamSpec *pspec, AdwActionRow *row)
+{
+  MobileSettingsApplication *msa = MOBILE_SETTINGS_APPLICATION (g_application_get_default ());
+  MsHeadTracker *head_tracker = mobile_settings_application_get_head_tracker (msa);
+  g_autoptr (GPtrArray) outputs = ms_running_app_get_outputs (app);
+  g_autoptr (GPtrArray) parts = g_ptr_array_new ();
+  g_autofree char *subtitle = NULL;
+
+  if (ms_running_app_get_state (app) & MS_TOPLEVEL_STATE_ACTIVATED)
+    g_ptr_array_add (parts, (gpointer) _("Focused"));
+
+  /* Only worth mentioning the display when there's more than one */
+  if (head_tracker &&
+      g_list_model_get_n_items (ms_head_tracker_get_heads (head_tracker)) > 1) {
+    for (guint i = 0; i < outputs->len; i++) {
+      MsHead *head = mobile_settings_application_lookup_head_for_output (msa,
+                                                                         g_ptr_array_index (outputs, i));
+      const char *name;
+
+      if (head == NULL)
+        continue;
+
+      name = ms_head_get_description (head) ?: ms_head_get_name (head);
+      if (name)
+        g_ptr_array_add (parts, (gpointer) name);
     }
   }
+
+  g_ptr_array_add (parts, NULL);
+  subtitle = g_strjoinv (" · ", (GStrv) parts->pdata);
+  adw_action_row_set_subtitle (row, subtitle);
+}
+
+
+static void
+on_app_check_toggled (GtkCheckButton *check, GtkListItem *item)
+{
+  GtkWidget *list_view = gtk_widget_get_ancestor (GTK_WIDGET (check), GTK_TYPE_LIST_VIEW);
+  GtkSelectionModel *model;
+  guint pos = gtk_list_item_get_position (item);
+
+  if (list_view == NULL || pos == GTK_INVALID_LIST_POSITION)
+    return;
+
+  if (gtk_check_button_get_active (check) == gtk_list_item_get_selected (item))
+    return;
+
+  model = gtk_list_view_get_model (GTK_LIST_VIEW (list_view));
+  if (gtk_check_button_get_active (check))
+    gtk_selection_model_select_item (model, pos, FALSE);
+  else
+    gtk_selection_model_unselect_item (model, pos);
+}
+
+
+static void
+setup_scale_to_fit_row (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data)
+{
+  MsScaleToFitRow *row = ms_scale_to_fit_row_new (NULL);
+  GtkWidget *check = gtk_check_button_new ();
+
+  /* Selection is only changed via the check button so taps on the row don't clear it */
+  gtk_widget_set_valign (check, GTK_ALIGN_CENTER);
+  gtk_widget_set_tooltip_text (check, _("Select for bulk changes"));
+  g_object_bind_property (item, "selected", check, "active", G_BINDING_SYNC_CREATE);
+  g_signal_connect_object (check, "toggled", G_CALLBACK (on_app_check_toggled), item, 0);
+  adw_action_row_add_prefix (ADW_ACTION_ROW (row), check);
+
+  gtk_list_item_set_activatable (item, FALSE);
+  gtk_list_item_set_selectable (item, FALSE);
+  gtk_list_item_set_child (item, GTK_WIDGET (row));
+}
+
+
+static void
+bind_scale_to_fit_row (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data)
+{
+  MsRunningApp *app = gtk_list_item_get_item (item);
+  GtkWidget *row = gtk_list_item_get_child (item);
+
+  ms_scale_to_fit_row_set_app_id (MS_SCALE_TO_FIT_ROW (row), ms_running_app_get_app_id (app));
+
+  g_signal_connect_object (app, "notify::state", G_CALLBACK (update_row_subtitle), row, 0);
+  g_signal_connect_object (app, "notify::outputs", G_CALLBACK (update_row_subtitle), row, 0);
+  update_row_subtitle (app, NULL, ADW_ACTION_ROW (row));
+}
+
+
+static void
+unbind_scale_to_fit_row (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data)
+{
+  MsRunningApp *app = gtk_list_item_get_item (item);
+  GtkWidget *row = gtk_list_item_get_child (item);
+
+  g_signal_handlers_disconnect_by_data (app, row);
+  ms_scale_to_fit_row_set_app_id (MS_SCALE_TO_FIT_ROW (row), NULL);
+}
+
+
+static gboolean
+overrides_equal (MsCompositorPanel *self, GPtrArray *overrides)
+{
+  GListModel *model = G_LIST_MODEL (self->overrides);
+
+  if (g_list_model_get_n_items (model) != overrides->len)
+    return FALSE;
+
+  for (guint i = 0; i < overrides->len; i++) {
+    g_autoptr (MsAppOverride) override = g_list_model_get_item (model, i);
+    MsAppOverride *new_override = g_ptr_array_index (overrides, i);
+
+    /* app-ids are interned */
+    if (override->app_id != new_override->app_id || g_strcmp0 (override->name, new_override->name))
+      return FALSE;
+  }
+
+  return TRUE;
 }
 
 
 static void
-on_app_id_added (MsCompositorPanel *self, const char *app_id)
+on_reset_override_clicked (GtkButton *button, MsScaleToFitRow *row)
 {
-  g_debug ("Adding app-id: %s", app_id);
-  add_application_row (self, app_id);
+  ms_scale_to_fit_row_reset (row);
 }
 
 
 static void
-on_app_id_removed (MsCompositorPanel *self, const char *app_id)
+setup_override_row (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data)
 {
-  g_debug ("Removing app-id: %s", app_id);
-  remove_application_row (self, app_id);
+  MsScaleToFitRow *row = ms_scale_to_fit_row_new (NULL);
+  GtkWidget *button = gtk_button_new_from_icon_name ("edit-clear-symbolic");
+
+  gtk_widget_set_valign (button, GTK_ALIGN_CENTER);
+  gtk_widget_set_tooltip_text (button, _("Remove override"));
+  gtk_widget_add_css_class (button, "flat");
+  g_signal_connect_object (button, "clicked", G_CALLBACK (on_reset_override_clicked), row, 0);
+  adw_action_row_add_suffix (ADW_ACTION_ROW (row), button);
+
+  gtk_list_item_set_activatable (item, FALSE);
+  gtk_list_item_set_child (item, GTK_WIDGET (row));
 }
 
 
-static GtkWidget *
-create_scale_to_fit_row (gpointer object, gpointer user_data)
+static void
+bind_override_row (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data)
 {
-  return GTK_WIDGET (object);
+  MsAppOverride *override = gtk_list_item_get_item (item);
+  GtkWidget *row = gtk_list_item_get_child (item);
+
+  ms_scale_to_fit_row_set_app_id (MS_SCALE_TO_FIT_ROW (row), override->app_id);
+  adw_action_row_set_subtitle (ADW_ACTION_ROW (row), override->app_id);
 }
 
+
+static void
+unbind_override_row (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data)
+{
+  GtkWidget *row = gtk_list_item_get_child (item);
+
+  ms_scale_to_fit_row_set_app_id (MS_SCALE_TO_FIT_ROW (row), NULL);
+}
+
+static MsAppOverride *
+app_override_new (const char *app_id, const char *name)
+{
+  MsAppOverride *override = g_object_new (MS_TYPE_APP_OVERRIDE, NULL);
+
+  override->app_id = ms_app_id_intern (app_id);
+  override->name = g_strdup (name ?: app_id);
+
+  return override;
+}
+
+/*
+ * Lists the app paths that have settings in dconf. This only reads
+ * the dconf databases and doesn't need a GSettings object per app.
+ * Names come from the app map built by load_app_ids() so there's no
+ * app info lookup here.
+ */
+static void
+reload_overrides (MsCompositorPanel *self)
+{
+  g_autoptr (GPtrArray) overrides = g_ptr_array_new_with_free_func (g_object_unref);
+  g_auto (GStrv) paths = NULL;
+  int n_paths;
+
+  g_clear_handle_id (&self->reload_overrides_id, g_source_remove);
+
+  /* Reloaded once the app map arrives */
+  if (self->app_ids == NULL)
+    return;
+
+  paths = dconf_client_list (self->dconf, APP_PREFIX, &n_paths);
+  for (int i = 0; i < n_paths; i++) {
+    g_autofree char *munged_app_id = NULL;
+    MsAppOverride *override;
+
+    /* Only dirs are per app settings */
+    if (!g_str_has_suffix (paths[i], "/"))
+      continue;
+
+    munged_app_id = g_strndup (paths[i], strlen (paths[i]) - 1);
+    override = g_hash_table_lookup (self->app_ids, munged_app_id);
+    if (override) {
+      g_object_ref (override);
+    } else {
+      /* Munging is idempotent so apps we don't know still map to the same path */
+      override = app_override_new (munged_app_id, NULL);
+    }
+
+    g_ptr_array_add (overrides, override);
+  }
+
+  g_ptr_array_sort (overrides, app_override_compare);
+  g_debug ("Found %u app overrides", overrides->len);
+
+  /* Toggling an override in the list shouldn't rebuild the list */
+  if (overrides_equal (self, overrides))
+    return;
+
+  g_list_store_splice (self->overrides,
+                       0,
+                       g_list_model_get_n_items (G_LIST_MODEL (self->overrides)),
+                       overrides->pdata,
+                       overrides->len);
+}
+
+
+static gboolean
+on_reload_overrides_timeout (gpointer user_data)
+{
+  MsCompositorPanel *self = MS_COMPOSITOR_PANEL (user_data);
+
+  self->reload_overrides_id = 0;
+  reload_overrides (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+on_dconf_changed (MsCompositorPanel *self,
+                  const char        *prefix,
+                  const char * const *changes,
+                  const char        *tag,
+                  DConfClient       *client)
+{
+  if (!g_str_has_prefix (prefix, APP_PREFIX) && !g_str_has_prefix (APP_PREFIX, prefix))
+    return;
+
+  /* Bulk edits emit one change per app, only reload once */
+  if (self->reload_overrides_id)
+    return;
+
+  self->reload_overrides_id = g_timeout_add (100, on_reload_overrides_timeout, self);
+  g_source_set_name_by_id (self->reload_overrides_id, "[ms] reload overrides");
+}
+
+
+static void
+load_app_ids_thread (GTask        *task,
+                     gpointer      source_object,
+                     gpointer      task_data,
+                     GCancellable *cancellable)
+{
+  g_autolist (GAppInfo) app_infos = g_app_info_get_all ();
+  g_autoptr (GHashTable) app_ids = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                          g_free, g_object_unref);
+
+  for (GList *l = app_infos; l; l = l->next) {
+    const char *id = g_app_info_get_id (l->data);
+    g_autofree char *app_id = NULL;
+
+    if (id == NULL)
+      continue;
+
+    app_id = g_strdup (id);
+    if (g_str_has_suffix (app_id, ".desktop"))
+      app_id[strlen (app_id) - strlen (".desktop")] = '\0';
+
+    g_hash_table_insert (app_ids, ms_munge_app_id (app_id),
+                         app_override_new (app_id, g_app_info_get_name (l->data)));
+  }
+
+  g_task_return_pointer (task, g_steal_pointer (&app_ids), (GDestroyNotify) g_hash_table_unref);
+}
+
+
+static void
+on_load_app_ids_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  MsCompositorPanel *self;
+  g_autoptr (GHashTable) app_ids = NULL;
+  g_autoptr (GError) err = NULL;
+
+  app_ids = g_task_propagate_pointer (G_TASK (res), &err);
+  if (app_ids == NULL) {
+    if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning ("Failed to load app ids: %s", err->message);
+    return;
+  }
+
+  self = MS_COMPOSITOR_PANEL (source_object);
+  g_clear_pointer (&self->app_ids, g_hash_table_unref);
+  self->app_ids = g_steal_pointer (&app_ids);
+
+  reload_overrides (self);
+}
+
+/*
+ * Overrides are stored by munged app-id. Map these back to app-ids
+ * and names. Listing all apps is slow with lots of apps installed
+ * so do it in a thread.
+ */
+static void
+load_app_ids (MsCompositorPanel *self)
+{
+  g_autoptr (GTask) task = NULL;
+
+  g_cancellable_cancel (self->load_app_ids_cancel);
+  g_clear_object (&self->load_app_ids_cancel);
+  self->load_app_ids_cancel = g_cancellable_new ();
+
+  task = g_task_new (self, self->load_app_ids_cancel, on_load_app_ids_done, NULL);
+  g_task_set_source_tag (task, load_app_ids);
+  g_task_set_return_on_cancel (task, TRUE);
+  g_task_run_in_thread (task, load_app_ids_thread);
+}
+
+
+static void
+on_overrides_search_changed (MsCompositorPanel *self, GtkSearchEntry *entry)
+{
+  gtk_string_filter_set_search (self->overrides_filter, gtk_editable_get_text (GTK_EDITABLE (entry)));
+}
+
+
+static void
+on_running_apps_selection_changed (MsCompositorPanel *self)
+{
+  g_autoptr (GtkBitset) selected = NULL;
+
+  if (self->running_apps_selection)
+    selected = gtk_selection_model_get_selection (self->running_apps_selection);
+
+  gtk_widget_set_sensitive (self->apply_selected_button, selected && !gtk_bitset_is_empty (selected));
+}
+
+/*
+ * Sets scale-to-fit for many apps at once. This is a single dconf
+ * transaction rather than a write per row.
+ */
+static void
+apply_bulk_scale_to_fit (MsCompositorPanel *self, gboolean only_selected)
+{
+  MobileSettingsApplication *msa = MOBILE_SETTINGS_APPLICATION (g_application_get_default ());
+  MsAppSettingsPool *pool = mobile_settings_application_get_app_settings_pool (msa);
+  g_autoptr (GtkBitset) selected = NULL;
+  g_autoptr (GPtrArray) munged_app_ids = NULL;
+  GListModel *model;
+
+  if (self->running_apps_selection == NULL)
+    return;
+
+  model = G_LIST_MODEL (self->running_apps_selection);
+  if (only_selected)
+    selected = gtk_selection_model_get_selection (self->running_apps_selection);
+
+  munged_app_ids = g_ptr_array_new_null_terminated (g_list_model_get_n_items (model),
+                                                    (GDestroyNotify) g_ref_string_release,
+                                                    TRUE);
+  for (guint i = 0; i < g_list_model_get_n_items (model); i++) {
+    g_autoptr (MsRunningApp) app = NULL;
+
+    if (selected && !gtk_bitset_contains (selected, i))
+      continue;
+
+    app = g_list_model_get_item (model, i);
+    g_ptr_array_add (munged_app_ids, ms_munged_app_id_intern (ms_running_app_get_app_id (app)));
+  }
+
+  /* Nothing to do, pdata isn't allocated for an empty array */
+  if (munged_app_ids->len == 0)
+    return;
+
+  ms_app_settings_pool_set_value (pool, APP_SCHEMA, APP_PREFIX,
+                                  (const char * const *) munged_app_ids->pdata,
+                                  APP_KEY_SCALE_TO_FIT,
+                                  g_variant_new_boolean (gtk_switch_get_active (self->bulk_scale_to_fit_switch)));
+
+  gtk_selection_model_unselect_all (self->running_apps_selection);
+}
+
+
+static void
+on_apply_selected_clicked (MsCompositorPanel *self)
+{
+  apply_bulk_scale_to_fit (self, TRUE);
+}
+
+
+static void
+on_apply_all_clicked (MsCompositorPanel *self)
+{
+  apply_bulk_scale_to_fit (self, FALSE);
+}
+
+
 static void
 on_toplevel_tracker_changed (MsCompositorPanel *self, GParamSpec *spec, MobileSettingsApplication *app)
 {
   MsToplevelTracker *tracker = mobile_settings_application_get_toplevel_tracker (app);
-  g_auto (GStrv) app_ids = NULL;
 
-  if (tracker == NULL)
+  if (tracker == self->tracker)
     return;
 
-  self->tracker = g_object_ref (tracker);
-  g_object_connect (self->tracker,
-                    "swapped_object_signal::app-id-added",
-                    G_CALLBACK (on_app_id_added),
-                    self,
-                    "swapped_object_signal::app-id-removed",
-                    G_CALLBACK (on_app_id_removed),
-                    self,
-                    NULL);
-  app_ids = ms_toplevel_tracker_get_app_ids (self->tracker);
+  g_set_object (&self->tracker, tracker);
+
+  if (self->running_apps_selection)
+    g_signal_handlers_disconnect_by_data (self->running_apps_selection, self);
+  g_clear_object (&self->running_apps_selection);
 
-  for (int i = 0; i < g_strv_length(app_ids); i++) {
-    g_debug ("app-id: %s", app_ids[i]);
-    add_application_row (self, app_ids[i]);
+  /* The tracker is a sorted list model of the running apps */
+  if (tracker) {
+    self->running_apps_selection =
+      GTK_SELECTION_MODEL (gtk_multi_selection_new (G_LIST_MODEL (g_object_ref (tracker))));
+    g_signal_connect_object (self->running_apps_selection, "selection-changed",
+                             G_CALLBACK (on_running_apps_selection_changed), self,
+                             G_CONNECT_SWAPPED);
   }
+  gtk_list_view_set_model (self->running_apps_listview, self->running_apps_selection);
+  on_running_apps_selection_changed (self);
+}
+
+
+static void
+ms_compositor_panel_dispose (GObject *object)
+{
+  MsCompositorPanel *self = MS_COMPOSITOR_PANEL (object);
+
+  g_cancellable_cancel (self->load_app_ids_cancel);
+  g_clear_object (&self->load_app_ids_cancel);
+
+  G_OBJECT_CLASS (ms_compositor_panel_parent_class)->dispose (object);
 }
 
 
@@ -111,7 +563,15 @@ ms_compositor_panel_finalize (GObject *object)
 {
   MsCompositorPanel *self = MS_COMPOSITOR_PANEL (object);
 
-  g_clear_object (&self->running_apps_rows);
+  g_clear_handle_id (&self->reload_overrides_id, g_source_remove);
+  g_clear_pointer (&self->app_ids, g_hash_table_unref);
+  g_clear_object (&self->overrides_filter);
+  g_clear_object (&self->overrides);
+  if (self->dconf) {
+    dconf_client_unwatch_fast (self->dconf, APP_PREFIX);
+    g_clear_object (&self->dconf);
+  }
+  g_clear_object (&self->running_apps_selection);
   g_clear_object (&self->tracker);
   g_clear_object (&self->settings);
 
@@ -125,12 +585,19 @@ ms_compositor_panel_class_init (MsCompositorPanelClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
+  object_class->dispose = ms_compositor_panel_dispose;
   object_class->finalize = ms_compositor_panel_finalize;
 
   gtk_widget_class_set_template_from_resource (widget_class,
                                                "/mobi/phosh/MobileSettings/ui/ms-compositor-panel.ui");
   gtk_widget_class_bind_template_child (widget_class, MsCompositorPanel, scale_to_fit_switch);
-  gtk_widget_class_bind_template_child (widget_class, MsCompositorPanel, running_apps_listbox);
+  gtk_widget_class_bind_template_child (widget_class, MsCompositorPanel, running_apps_listview);
+  gtk_widget_class_bind_template_child (widget_class, MsCompositorPanel, bulk_scale_to_fit_switch);
+  gtk_widget_class_bind_template_child (widget_class, MsCompositorPanel, apply_selected_button);
+  gtk_widget_class_bind_template_callback (widget_class, on_apply_selected_clicked);
+  gtk_widget_class_bind_template_callback (widget_class, on_apply_all_clicked);
+  gtk_widget_class_bind_template_child (widget_class, MsCompositorPanel, overrides_listview);
+  gtk_widget_class_bind_template_callback (widget_class, on_overrides_search_changed);
 }
 
 
@@ -138,14 +605,46 @@ static void
 ms_compositor_panel_init (MsCompositorPanel *self)
 {
   MobileSettingsApplication *app;
+  g_autoptr (GtkListItemFactory) factory = gtk_signal_list_item_factory_new ();
+  g_autoptr (GtkListItemFactory) overrides_factory = gtk_signal_list_item_factory_new ();
+  g_autoptr (GtkFilterListModel) filter_model = NULL;
+  g_autoptr (GtkNoSelection) selection = NULL;
+  GtkExpression *expr;
 
   gtk_widget_init_template (GTK_WIDGET (self));
 
-  self->running_apps_rows = g_list_store_new (MS_TYPE_SCALE_TO_FIT_ROW);
-  gtk_list_box_bind_model (self->running_apps_listbox,
-                           G_LIST_MODEL (self->running_apps_rows),
-                           create_scale_to_fit_row,
-                           NULL, NULL);
+  g_object_connect (factory,
+                    "signal::setup", G_CALLBACK (setup_scale_to_fit_row), NULL,
+                    "signal::bind", G_CALLBACK (bind_scale_to_fit_row), NULL,
+                    "signal::unbind", G_CALLBACK (unbind_scale_to_fit_row), NULL,
+                    NULL);
+  gtk_list_view_set_factory (self->running_apps_listview, factory);
+
+  g_object_connect (overrides_factory,
+                    "signal::setup", G_CALLBACK (setup_override_row), NULL,
+                    "signal::bind", G_CALLBACK (bind_override_row), NULL,
+                    "signal::unbind", G_CALLBACK (unbind_override_row), NULL,
+                    NULL);
+  gtk_list_view_set_factory (self->overrides_listview, overrides_factory);
+
+  self->overrides = g_list_store_new (MS_TYPE_APP_OVERRIDE);
+  expr = gtk_cclosure_expression_new (G_TYPE_STRING, NULL, 0, NULL,
+                                      G_CALLBACK (app_override_get_search_text),
+                                      NULL, NULL);
+  self->overrides_filter = gtk_string_filter_new (expr);
+  gtk_string_filter_set_match_mode (self->overrides_filter, GTK_STRING_FILTER_MATCH_MODE_SUBSTRING);
+  gtk_string_filter_set_ignore_case (self->overrides_filter, TRUE);
+  filter_model = gtk_filter_list_model_new (G_LIST_MODEL (g_object_ref (self->overrides)),
+                                            GTK_FILTER (g_object_ref (self->overrides_filter)));
+  selection = gtk_no_selection_new (G_LIST_MODEL (g_steal_pointer (&filter_model)));
+  gtk_list_view_set_model (self->overrides_listview, GTK_SELECTION_MODEL (selection));
+
+  self->dconf = dconf_client_new ();
+  g_signal_connect_object (self->dconf, "changed",
+                           G_CALLBACK (on_dconf_changed), self,
+                           G_CONNECT_SWAPPED);
+  dconf_client_watch_fast (self->dconf, APP_PREFIX);
+  load_app_ids (self);
 
   self->settings = g_settings_new (COMPOSITOR_SCHEMA_ID);
   g_settings_bind (self->settings,
@@ -155,10 +654,10 @@ ms_compositor_panel_init (MsCompositorPanel *self)
                    G_SETTINGS_BIND_DEFAULT);
 
   app = MOBILE_SETTINGS_APPLICATION (g_application_get_default ());
-  g_signal_connect_swapped (app, "notify::toplevel-tracker",
-                            G_CALLBACK (on_toplevel_tracker_changed), self);
-  on_toplevel_tracker_changed(self, NULL,
-                              MOBILE_SETTINGS_APPLICATION (g_application_get_default ()));
+  g_signal_connect_object (app, "notify::toplevel-tracker",
+                           G_CALLBACK (on_toplevel_tracker_changed), self,
+                           G_CONNECT_SWAPPED);
+  on_toplevel_tracker_changed (self, NULL, app);
 }
 
 
@@ -15,6 +15,8 @@
 #include "ms-scale-to-fit-row.h"
 #include "ms-util.h"
 
+#include <glib/gi18n.h>
+
 /* Verbatim from convergence */
 #define TOUCH_MAPPING_SCHEMA_ID "org.gnome.desktop.peripherals.touchscreen"
 #define TOUCH_MAPPING_PATH_PREFIX "/org/gnome/desktop/peripherals/touchscreens/"
@@ -43,9 +45,11 @@ struct _MsConvergencePanel {
   GtkListBox *docks_listbox;
   AdwActionRow *map_touch_screen_row;
   GtkWidget *map_touch_screen_switch;
+  AdwActionRow *dock_apps_row;
 
-
+  MsHead    *dock_head;
   MsHeadTracker *tracker;
+  MsToplevelTracker *toplevel_tracker;
 };
 
 G_DEFINE_TYPE (MsConvergencePanel, ms_convergence_panel, ADW_TYPE_BIN)
@@ -110,9 +114,12 @@ static const MsDock *
 find_dock (MsHead *head)
 {
   for (int i = 0; i < G_N_ELEMENTS (docks); i++) {
-    if ((STR_IS_NULL_OR_EMPTY (docks[i].make) || g_strcmp0 (docks[i].make, head->make) == 0) &&
-        (STR_IS_NULL_OR_EMPTY (docks[i].model) || g_strcmp0 (docks[i].model, head->model) == 0) &&
-        (STR_IS_NULL_OR_EMPTY (docks[i].serial) || g_strcmp0 (docks[i].serial, head->serial_number) == 0)) {
+    if ((STR_IS_NULL_OR_EMPTY (docks[i].make) ||
+         g_strcmp0 (docks[i].make, ms_head_get_make (head)) == 0) &&
+        (STR_IS_NULL_OR_EMPTY (docks[i].model) ||
+         g_strcmp0 (docks[i].model, ms_head_get_model (head)) == 0) &&
+        (STR_IS_NULL_OR_EMPTY (docks[i].serial) ||
+         g_strcmp0 (docks[i].serial, ms_head_get_serial_number (head)) == 0)) {
       return &docks[i];
     }
   }
@@ -175,11 +182,121 @@ touch_mapping_set (const GValue *value,
 }
 
 
+static void
+update_dock_apps (MsConvergencePanel *self)
+{
+  MobileSettingsApplication *app = MOBILE_SETTINGS_APPLICATION (g_application_get_default ());
+  g_autoptr (GPtrArray) app_ids = g_ptr_array_new ();
+  g_autofree char *subtitle = NULL;
+  struct wl_output *output = NULL;
+  GListModel *apps;
+
+  if (self->dock_head && self->toplevel_tracker)
+    output = mobile_settings_application_lookup_output_for_head (app, self->dock_head);
+
+  if (output == NULL) {
+    adw_action_row_set_subtitle (self->dock_apps_row, "");
+    return;
+  }
+
+  apps = G_LIST_MODEL (self->toplevel_tracker);
+  for (guint i = 0; i < g_list_model_get_n_items (apps); i++) {
+    g_autoptr (MsRunningApp) running_app = g_list_model_get_item (apps, i);
+
+    if (ms_running_app_has_output (running_app, output))
+      g_ptr_array_add (app_ids, (gpointer) ms_running_app_get_app_id (running_app));
+  }
+
+  if (app_ids->len == 0) {
+    adw_action_row_set_subtitle (self->dock_apps_row, _("None"));
+    return;
+  }
+
+  g_ptr_array_add (app_ids, NULL);
+  subtitle = g_strjoinv (", ", (GStrv) app_ids->pdata);
+  adw_action_row_set_subtitle (self->dock_apps_row, subtitle);
+}
+
+
+static void
+on_app_outputs_changed (MsConvergencePanel *self, GParamSpec *pspec, MsRunningApp *app)
+{
+  update_dock_apps (self);
+}
+
+
+static void
+on_running_apps_changed (MsConvergencePanel *self,
+                         guint               position,
+                         guint               removed,
+                         guint               added,
+                         GListModel         *apps)
+{
+  for (guint i = position; i < position + added; i++) {
+    g_autoptr (MsRunningApp) app = g_list_model_get_item (apps, i);
+
+    /* Unchanged apps can be part of the changed range too */
+    g_signal_handlers_disconnect_by_func (app, on_app_outputs_changed, self);
+    g_signal_connect_object (app, "notify::outputs",
+                             G_CALLBACK (on_app_outputs_changed), self,
+                             G_CONNECT_SWAPPED);
+  }
+
+  update_dock_apps (self);
+}
+
+
+/* The dock's wl_output is only known once GDK has the matching monitor */
+static void
+on_monitors_changed (MsConvergencePanel *self,
+                     guint               position,
+                     guint               removed,
+                     guint               added,
+                     GListModel         *monitors)
+{
+  update_dock_apps (self);
+}
+
+
+static void
+on_toplevel_tracker_changed (MsConvergencePanel *self, GParamSpec *spec, MobileSettingsApplication *app)
+{
+  MsToplevelTracker *tracker = mobile_settings_application_get_toplevel_tracker (app);
+  guint n_items;
+
+  if (tracker == self->toplevel_tracker)
+    return;
+
+  if (self->toplevel_tracker) {
+    GListModel *apps = G_LIST_MODEL (self->toplevel_tracker);
+
+    g_signal_handlers_disconnect_by_data (self->toplevel_tracker, self);
+    for (guint i = 0; i < g_list_model_get_n_items (apps); i++) {
+      g_autoptr (MsRunningApp) running_app = g_list_model_get_item (apps, i);
+
+      g_signal_handlers_disconnect_by_func (running_app, on_app_outputs_changed, self);
+    }
+  }
+
+  g_set_object (&self->toplevel_tracker, tracker);
+  if (tracker == NULL) {
+    update_dock_apps (self);
+    return;
+  }
+
+  g_signal_connect_object (tracker, "items-changed",
+                           G_CALLBACK (on_running_apps_changed), self,
+                           G_CONNECT_SWAPPED);
+  n_items = g_list_model_get_n_items (G_LIST_MODEL (tracker));
+  on_running_apps_changed (self, 0, 0, n_items, G_LIST_MODEL (tracker));
+}
+
+
 static void
 on_head_added (MsConvergencePanel *self,
                MsHead *head)
 {
-  g_debug ("Got head %s", head->name);
+  g_debug ("Got head %s", ms_head_get_name (head));
 
   /* If we have a dock, keep it */
   if (self->dock)
@@ -187,6 +304,8 @@ on_head_added (MsConvergencePanel *self,
 
   self->dock = find_dock (head);
   if (self->dock != NULL) {
+    g_set_object (&self->dock_head, head);
+    update_dock_apps (self);
     adw_preferences_group_set_title (self->dock_pref_group, self->dock->name);
     gtk_stack_set_visible_child_name (self->dock_stack, "dock");
     gtk_widget_set_sensitive (GTK_WIDGET (self->map_touch_screen_row),
@@ -217,7 +336,7 @@ static void
 on_head_removed (MsConvergencePanel *self,
                  MsHead *head)
 {
-  g_debug ("Lost head: %s", head->name);
+  g_debug ("Lost head: %s", ms_head_get_name (head));
 
   if (find_dock (head) == FALSE)
     return;
@@ -225,7 +344,9 @@ on_head_removed (MsConvergencePanel *self,
   gtk_stack_set_visible_child_name (self->dock_stack, "empty");
   gtk_widget_set_sensitive (GTK_WIDGET (self->map_touch_screen_row), FALSE);
   g_clear_pointer (&self->touch_settings, g_object_unref);
+  g_clear_object (&self->dock_head);
   self->dock = NULL;
+  update_dock_apps (self);
 }
 
 
@@ -233,12 +354,22 @@ static void
 on_head_tracker_changed (MsConvergencePanel *self, GParamSpec *spec, MobileSettingsApplication *app)
 {
   MsHeadTracker *tracker = mobile_settings_application_get_head_tracker (app);
-  GPtrArray *heads;
+  GListModel *heads;
+
+  if (tracker == self->tracker)
+    return;
 
+  if (self->tracker) {
+    g_signal_handlers_disconnect_by_data (self->tracker, self);
+    /* The heads go away with the tracker */
+    if (self->dock_head)
+      on_head_removed (self, self->dock_head);
+  }
+
+  g_set_object (&self->tracker, tracker);
   if (tracker == NULL)
     return;
 
-  self->tracker = g_object_ref (tracker);
   g_object_connect (self->tracker,
                     "swapped_object_signal::head-added",
                     G_CALLBACK (on_head_added),
@@ -249,9 +380,9 @@ on_head_tracker_changed (MsConvergencePanel *self, GParamSpec *spec, MobileSetti
                     NULL);
 
   heads = ms_head_tracker_get_heads (self->tracker);
-  for (int i = 0; i < heads->len; i++) {
-    MsHead *head = g_ptr_array_index (heads, i);
-    g_debug ("Initial head: %s", head->name);
+  for (guint i = 0; i < g_list_model_get_n_items (heads); i++) {
+    g_autoptr (MsHead) head = g_list_model_get_item (heads, i);
+    g_debug ("Initial head: %s", ms_head_get_name (head));
     on_head_added (self, head);
   }
 }
@@ -263,6 +394,8 @@ ms_convergence_panel_finalize (GObject *object)
   MsConvergencePanel *self = MS_CONVERGENCE_PANEL (object);
 
   g_clear_object (&self->tracker);
+  g_clear_object (&self->toplevel_tracker);
+  g_clear_object (&self->dock_head);
   g_clear_object (&self->touch_settings);
 
   G_OBJECT_CLASS (ms_convergence_panel_parent_class)->finalize (object);
@@ -283,6 +416,7 @@ ms_convergence_panel_class_init (MsConvergencePanelClass *klass)
   gtk_widget_class_bind_template_child (widget_class, MsConvergencePanel, dock_stack);
   gtk_widget_class_bind_template_child (widget_class, MsConvergencePanel, map_touch_screen_row);
   gtk_widget_class_bind_template_child (widget_class, MsConvergencePanel, map_touch_screen_switch);
+  gtk_widget_class_bind_template_child (widget_class, MsConvergencePanel, dock_apps_row);
 }
 
 
@@ -294,10 +428,21 @@ ms_convergence_panel_init (MsConvergencePanel *self)
   gtk_widget_init_template (GTK_WIDGET (self));
 
   app = MOBILE_SETTINGS_APPLICATION (g_application_get_default ());
-  g_signal_connect_swapped (app, "notify::head-tracker",
-                            G_CALLBACK (on_head_tracker_changed), self);
+  g_signal_connect_object (app, "notify::head-tracker",
+                           G_CALLBACK (on_head_tracker_changed), self,
+                           G_CONNECT_SWAPPED);
   on_head_tracker_changed(self, NULL,
                           MOBILE_SETTINGS_APPLICATION (g_application_get_default ()));
+
+  g_signal_connect_object (app, "notify::toplevel-tracker",
+                           G_CALLBACK (on_toplevel_tracker_changed), self,
+                           G_CONNECT_SWAPPED);
+  on_toplevel_tracker_changed (self, NULL, app);
+
+  g_signal_connect_object (gdk_display_get_monitors (gdk_display_get_default ()),
+                           "items-changed",
+                           G_CALLBACK (on_monitors_changed), self,
+                           G_CONNECT_SWAPPED);
 }
 
 
@@ -9,7 +9,9 @@
 #define G_LOG_DOMAIN "ms-feedback-panel"
 
 #include "mobile-settings-config.h"
+#include "mobile-settings-application.h"
 #include "mobile-settings-enums.h"
+#include "ms-app-index.h"
 #include "ms-enum-types.h"
 #include "ms-feedback-row.h"
 #include "ms-feedback-panel.h"
@@ -30,6 +32,14 @@
 #define NOTIFICATIONS_WAKEUP_SCREEN_TRIGGERS_KEY "wakeup-screen-triggers"
 #define NOTIFICATIONS_WAKEUP_SCREEN_URGENCY_KEY "wakeup-screen-urgency"
 
+#define FEEDBACK_APP_KEY "X-Phosh-UsesFeedback"
+
+/* Matches GTK_ICON_SIZE_LARGE */
+#define APP_ICON_SIZE 32
+
+/* Number of apps handed from the scanning thread to the main loop at once */
+#define LOAD_APPS_BATCH_SIZE 16
+
 enum {
   PROP_0,
   PROP_FEEDBACK_PROFILE,
@@ -37,17 +47,34 @@ enum {
 };
 static GParamSpec *props[PROP_LAST_PROP];
 
-typedef struct {
+/* Keys for the widgets and settings attached to a recycled app row */
+#define APP_ROW_ICON_KEY "ms-app-icon"
+#define APP_ROW_GICON_KEY "ms-app-gicon"
+#define APP_ROW_SETTINGS_KEY "ms-app-settings"
+
+/* An app using feedbackd. Rows are only created for the visible ones */
+#define MS_TYPE_FBD_APPLICATION (ms_fbd_application_get_type ())
+G_DECLARE_FINAL_TYPE (MsFbdApplication, ms_fbd_application, MS, FBD_APPLICATION, GObject)
+
+struct _MsFbdApplication {
+  GObject    parent;
+
   char      *munged_app_id;
-  GAppInfo  *app_info;
-  GSettings *settings;
-} MsFbdApplication;
+  char      *name;
+  GIcon     *icon;
+};
+G_DEFINE_TYPE (MsFbdApplication, ms_fbd_application, G_TYPE_OBJECT)
 
 struct _MsFeedbackPanel {
   AdwBin                     parent;
 
-  GtkListBox                *app_listbox;
+  GtkListView               *app_listview;
+  GListStore                *apps;
+  GtkSelectionModel         *app_selection;
+  AdwComboRow               *bulk_profile_row;
+  GtkWidget                 *apply_selected_button;
   GHashTable                *known_applications;
+  GCancellable              *load_apps_cancel;
 
   GSettings                 *settings;
   MsFeedbackProfile          profile;
@@ -159,14 +186,30 @@ play_sound_activated  (GtkWidget *widget,  const char* action_name, GVariant *pa
 
 
 static void
-app_destroy (gpointer data)
+ms_fbd_application_finalize (GObject *object)
 {
-  MsFbdApplication *app = data;
+  MsFbdApplication *app = MS_FBD_APPLICATION (object);
 
-  g_clear_object (&app->settings);
-  g_clear_object (&app->app_info);
-  g_clear_pointer (&app->munged_app_id, g_free);
-  g_slice_free (MsFbdApplication, app);
+  g_clear_object (&app->icon);
+  g_clear_pointer (&app->name, g_free);
+  g_clear_pointer (&app->munged_app_id, g_ref_string_release);
+
+  G_OBJECT_CLASS (ms_fbd_application_parent_class)->finalize (object);
+}
+
+
+static void
+ms_fbd_application_class_init (MsFbdApplicationClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ms_fbd_application_finalize;
+}
+
+
+static void
+ms_fbd_application_init (MsFbdApplication *app)
+{
 }
 
 
@@ -205,97 +248,331 @@ settings_profile_to_name (const GValue       *value,
 
 
 static void
-add_application_row (MsFeedbackPanel *self, MsFbdApplication *app)
+on_app_check_toggled (GtkCheckButton *check, GtkListItem *item)
 {
-  GtkWidget *w;
-  MsFeedbackRow *row;
-  g_autoptr (GIcon) icon = NULL;
-  g_autofree char *markup = NULL;
-  const gchar *app_name;
+  GtkWidget *list_view = gtk_widget_get_ancestor (GTK_WIDGET (check), GTK_TYPE_LIST_VIEW);
+  GtkSelectionModel *model;
+  guint pos = gtk_list_item_get_position (item);
+
+  if (list_view == NULL || pos == GTK_INVALID_LIST_POSITION)
+    return;
 
-  app_name = g_app_info_get_name (app->app_info);
-  if (STR_IS_NULL_OR_EMPTY (app_name))
+  if (gtk_check_button_get_active (check) == gtk_list_item_get_selected (item))
     return;
 
-  icon = g_app_info_get_icon (app->app_info);
+  model = gtk_list_view_get_model (GTK_LIST_VIEW (list_view));
+  if (gtk_check_button_get_active (check))
+    gtk_selection_model_select_item (model, pos, FALSE);
+  else
+    gtk_selection_model_unselect_item (model, pos);
+}
+
+
+/* Looks up the icon for the current scale so it stays sharp on other outputs */
+static void
+update_application_row_icon (GtkWidget *row)
+{
+  MobileSettingsApplication *msa = MOBILE_SETTINGS_APPLICATION (g_application_get_default ());
+  GtkImage *image = g_object_get_data (G_OBJECT (row), APP_ROW_ICON_KEY);
+  GIcon *icon = g_object_get_data (G_OBJECT (row), APP_ROW_GICON_KEY);
+  g_autoptr (GdkPaintable) paintable = NULL;
+
   if (icon == NULL)
+    return;
+
+  g_object_set_data_full (G_OBJECT (row), APP_ROW_GICON_KEY, icon, g_object_unref);
+  update_application_row_icon (row);
+}
+
+
+static void
+setup_application_row (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data)
+{
+  MsFeedbackRow *row = ms_feedback_row_new ();
+  GtkWidget *w = gtk_check_button_new ();
+
+  /* Selection is only changed via the check button so taps on the row don't clear it */
+  gtk_widget_set_valign (w, GTK_ALIGN_CENTER);
+  gtk_widget_set_tooltip_text (w, _("Select for bulk changes"));
+  g_object_bind_property (item, "selected", w, "active", G_BINDING_SYNC_CREATE);
+  g_signal_connect_object (w, "toggled", G_CALLBACK (on_app_check_toggled), item, 0);
+  adw_action_row_add_prefix (ADW_ACTION_ROW (row), w);
+
+  w = gtk_image_new ();
+
+  gtk_widget_add_css_class (w, "lowres-icon");
+  gtk_image_set_icon_size (GTK_IMAGE (w), GTK_ICON_SIZE_LARGE);
+  adw_action_row_add_prefix (ADW_ACTION_ROW (row), w);
+  g_object_set_data (G_OBJECT (row), APP_ROW_ICON_KEY, w);
+  g_signal_connect (row, "notify::scale-factor", G_CALLBACK (update_application_row_icon), NULL);
+
+  gtk_list_item_set_activatable (item, FALSE);
+  gtk_list_item_set_selectable (item, FALSE);
+  gtk_list_item_set_child (item, GTK_WIDGET (row));
+}
+
+
+static void
+bind_application_row (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data)
+{
+  MobileSettingsApplication *msa = MOBILE_SETTINGS_APPLICATION (g_application_get_default ());
+  MsAppSettingsPool *pool = mobile_settings_application_get_app_settings_pool (msa);
+  MsFbdApplication *app = gtk_list_item_get_item (item);
+  GtkWidget *row = gtk_list_item_get_child (item);
+  g_autoptr (GSettings) settings = NULL;
+  GIcon *icon;
+  g_autofree char *markup = NULL;
+
+  if (app->icon == NULL)
     icon = g_themed_icon_new ("application-x-executable");
   else
-    g_object_ref (icon);
-
-  row = ms_feedback_row_new ();
+    icon = g_object_ref (app->icon);
 
   /* TODO: we can move most of this into MsMobileSettingsRow */
-  markup = g_markup_escape_text (app_name, -1);
+  markup = g_markup_escape_text (app->name, -1);
   adw_preferences_row_set_title (ADW_PREFERENCES_ROW (row), markup);
-  g_object_set_data_full (G_OBJECT (row), "app", app, app_destroy);
-  g_settings_bind_with_mapping (app->settings, FEEDBACKD_KEY_PROFILE,
+
+  g_object_set_data_full (G_OBJECT (row), APP_ROW_GICON_KEY, icon, g_object_unref);
+  update_application_row_icon (row);
+
+  settings = ms_app_settings_pool_get (pool, APP_SCHEMA, APP_PREFIX, app->munged_app_id);
+  g_settings_bind_with_mapping (settings, FEEDBACKD_KEY_PROFILE,
                                 row, "feedback-profile",
                                 G_SETTINGS_BIND_DEFAULT,
                                 settings_name_to_profile,
                                 settings_profile_to_name,
                                 NULL, NULL);
+  g_object_set_data_full (G_OBJECT (row), APP_ROW_SETTINGS_KEY,
+                          g_steal_pointer (&settings), g_object_unref);
+}
 
-  gtk_list_box_append (self->app_listbox, GTK_WIDGET (row));
 
-  w = gtk_image_new_from_gicon (icon);
-  gtk_widget_add_css_class (w, "lowres-icon");
-  gtk_image_set_icon_size (GTK_IMAGE (w), GTK_ICON_SIZE_LARGE);
-  adw_action_row_add_prefix (ADW_ACTION_ROW (row), w);
+static void
+unbind_application_row (GtkSignalListItemFactory *factory, GtkListItem *item, gpointer user_data)
+{
+  GtkWidget *row = gtk_list_item_get_child (item);
 
-  g_hash_table_add (self->known_applications, g_strdup (app->munged_app_id));
+  g_settings_unbind (row, "feedback-profile");
+  g_object_set_data (G_OBJECT (row), APP_ROW_SETTINGS_KEY, NULL);
 }
 
 
 static void
-process_app_info (MsFeedbackPanel *self, GAppInfo *app_info)
+process_app_info (MsFeedbackPanel *self, MsAppIndexEntry *entry)
 {
-  MsFbdApplication *app;
-  const char *app_id;
-  g_autofree char *munged_id = NULL;
-  g_autofree char *path = NULL;
+  g_autoptr (MsFbdApplication) app = NULL;
 
-  app_id = g_app_info_get_id (app_info);
-  if (STR_IS_NULL_OR_EMPTY (app_id))
+  if (STR_IS_NULL_OR_EMPTY (entry->app_id) || STR_IS_NULL_OR_EMPTY (entry->name))
     return;
 
-  munged_id = ms_munge_app_id (app_id);
+  if (g_hash_table_contains (self->known_applications, entry->munged_app_id))
+    return;
 
-  app = g_slice_new (MsFbdApplication);
+  app = g_object_new (MS_TYPE_FBD_APPLICATION, NULL);
+  app->name = g_strdup (entry->name);
+  if (entry->icon)
+    app->icon = g_icon_new_for_string (entry->icon, NULL);
+  app->munged_app_id = g_ref_string_acquire (entry->munged_app_id);
 
-  path = g_strconcat (APP_PREFIX, munged_id, "/", NULL);
-  g_debug ("Monitoring settings path: %s", path);
-  app->settings = g_settings_new_with_path (APP_SCHEMA, path);
-  app->app_info = g_object_ref (app_info);
-  app->munged_app_id = g_steal_pointer (&munged_id);
+  g_debug ("Processing queued application %s", app->munged_app_id);
 
-  if (g_hash_table_contains (self->known_applications, app->munged_app_id))
-    return;
+  g_list_store_append (self->apps, app);
+  g_hash_table_add (self->known_applications, g_ref_string_acquire (app->munged_app_id));
+}
 
-  g_debug ("Processing queued application %s", app->munged_app_id);
 
-  add_application_row (self, app);
+typedef struct {
+  GTask     *task;
+  GPtrArray *entries;
+} MsFbdAppBatch;
+
+
+static void
+app_batch_free (gpointer data)
+{
+  MsFbdAppBatch *batch = data;
+
+  g_clear_object (&batch->task);
+  g_clear_pointer (&batch->entries, g_ptr_array_unref);
+  g_free (batch);
 }
 
 
+static gboolean
+process_app_batch (gpointer data)
+{
+  MsFbdAppBatch *batch = data;
+  MsFeedbackPanel *self;
+
+  /* Panel got disposed */
+  if (g_cancellable_is_cancelled (g_task_get_cancellable (batch->task)))
+    return G_SOURCE_REMOVE;
+
+  self = MS_FEEDBACK_PANEL (g_task_get_source_object (batch->task));
+  for (guint i = 0; i < batch->entries->len; i++)
+    process_app_info (self, g_ptr_array_index (batch->entries, i));
+
+  return G_SOURCE_REMOVE;
+}
+
 
+static void
+push_app_batch (GTask *task, GPtrArray *entries)
+{
+  MsFbdAppBatch *batch = g_new0 (MsFbdAppBatch, 1);
+
+  batch->task = g_object_ref (task);
+  batch->entries = entries;
+
+  g_main_context_invoke_full (g_task_get_context (task),
+                              G_PRIORITY_DEFAULT,
+                              process_app_batch,
+                              batch,
+                              app_batch_free);
+}
+
+
+typedef struct {
+  GTask     *task;
+  GPtrArray *entries;
+} MsFbdAppScan;
+
+
+static void
+on_app_found (MsAppIndexEntry *entry, gpointer user_data)
+{
+  MsFbdAppScan *scan = user_data;
+
+  if (scan->entries == NULL)
+    scan->entries = g_ptr_array_new_with_free_func ((GDestroyNotify) ms_app_index_entry_free);
+  g_ptr_array_add (scan->entries, entry);
+
+  if (scan->entries->len == LOAD_APPS_BATCH_SIZE)
+    push_app_batch (scan->task, g_steal_pointer (&scan->entries));
+}
+
+
+static void
+load_apps_thread (GTask        *task,
+                  gpointer      source_object,
+                  gpointer      task_data,
+                  GCancellable *cancellable)
+{
+  g_autoptr (GError) err = NULL;
+  MsFbdAppScan scan = { .task = task, .entries = NULL };
+  gboolean success;
+
+  /* Uses an on disk index so only changed app dirs are scanned */
+  success = ms_app_index_query_sync (FEEDBACK_APP_KEY, on_app_found, &scan, cancellable, &err);
+
+  if (scan.entries)
+    push_app_batch (task, g_steal_pointer (&scan.entries));
+
+  if (!success) {
+    g_task_return_error (task, g_steal_pointer (&err));
+    return;
+  }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+
+static void
+on_load_apps_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr (GError) err = NULL;
+
+  if (!g_task_propagate_boolean (G_TASK (res), &err)) {
+    if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning ("Failed to load apps: %s", err->message);
+    return;
+  }
+
+  g_debug ("Done scanning for apps using feedbackd");
+}
+
+/*
+ * Scanning all desktop files is slow with lots of apps installed so
+ * do it in a thread and add the rows in batches as results come in.
+ */
 static void
 load_apps (MsFeedbackPanel *self)
 {
-  GList *iter, *apps;
+  g_autoptr (GTask) task = NULL;
+
+  g_cancellable_cancel (self->load_apps_cancel);
+  g_clear_object (&self->load_apps_cancel);
+  self->load_apps_cancel = g_cancellable_new ();
 
-  apps = g_app_info_get_all ();
+  task = g_task_new (self, self->load_apps_cancel, on_load_apps_done, NULL);
+  g_task_set_source_tag (task, load_apps);
+  g_task_run_in_thread (task, load_apps_thread);
+}
 
-  for (iter = apps; iter; iter = iter->next) {
-    GDesktopAppInfo *app;
 
-    app = G_DESKTOP_APP_INFO (iter->data);
-    if (g_desktop_app_info_get_boolean (app, "X-Phosh-UsesFeedback")) {
-      g_debug ("App '%s' uses libfeedback", g_app_info_get_id (G_APP_INFO (app)));
-      process_app_info (self, G_APP_INFO (app));
-    }
+static void
+on_app_selection_changed (MsFeedbackPanel *self)
+{
+  g_autoptr (GtkBitset) selected = gtk_selection_model_get_selection (self->app_selection);
+
+  gtk_widget_set_sensitive (self->apply_selected_button, !gtk_bitset_is_empty (selected));
+}
+
+/*
+ * Sets the profile for many apps at once. This is a single dconf
+ * transaction rather than a write per row.
+ */
+static void
+apply_bulk_profile (MsFeedbackPanel *self, gboolean only_selected)
+{
+  MobileSettingsApplication *msa = MOBILE_SETTINGS_APPLICATION (g_application_get_default ());
+  MsAppSettingsPool *pool = mobile_settings_application_get_app_settings_pool (msa);
+  GListModel *model = G_LIST_MODEL (self->apps);
+  g_autoptr (GtkBitset) selected = NULL;
+  g_autoptr (GPtrArray) munged_app_ids = NULL;
+  g_autofree char *profile = NULL;
+
+  if (only_selected)
+    selected = gtk_selection_model_get_selection (self->app_selection);
+
+  munged_app_ids = g_ptr_array_new_null_terminated (g_list_model_get_n_items (model),
+                                                    (GDestroyNotify) g_ref_string_release,
+                                                    TRUE);
+  for (guint i = 0; i < g_list_model_get_n_items (model); i++) {
+    g_autoptr (MsFbdApplication) app = NULL;
+
+    if (selected && !gtk_bitset_contains (selected, i))
+      continue;
+
+    app = g_list_model_get_item (model, i);
+    g_ptr_array_add (munged_app_ids, g_ref_string_acquire (app->munged_app_id));
   }
-  g_list_free_full (apps, g_object_unref);
+
+  /* Nothing to do, pdata isn't allocated for an empty array */
+  if (munged_app_ids->len == 0)
+    return;
+
+  profile = ms_feedback_profile_to_setting (adw_combo_row_get_selected (self->bulk_profile_row));
+  ms_app_settings_pool_set_value (pool, APP_SCHEMA, APP_PREFIX,
+                                  (const char * const *) munged_app_ids->pdata,
+                                  FEEDBACKD_KEY_PROFILE,
+                                  g_variant_new_string (profile));
+
+  gtk_selection_model_unselect_all (self->app_selection);
+}
+
+
+static void
+on_apply_selected_clicked (MsFeedbackPanel *self)
+{
+  apply_bulk_profile (self, TRUE);
+}
+
+
+static void
+on_apply_all_clicked (MsFeedbackPanel *self)
+{
+  apply_bulk_profile (self, FALSE);
 }
 
 
@@ -459,12 +736,16 @@ ms_feedback_panel_dispose (GObject *object)
 {
   MsFeedbackPanel *self = MS_FEEDBACK_PANEL (object);
 
+  g_cancellable_cancel (self->load_apps_cancel);
+  g_clear_object (&self->load_apps_cancel);
   g_clear_object (&self->sound_cancel);
 
   g_clear_object (&self->sound_context);
   g_clear_object (&self->settings);
   g_clear_object (&self->notifications_settings);
   g_clear_pointer (&self->known_applications, g_hash_table_unref);
+  g_clear_object (&self->app_selection);
+  g_clear_object (&self->apps);
 
   G_OBJECT_CLASS (ms_feedback_panel_parent_class)->dispose (object);
 }
@@ -492,7 +773,11 @@ ms_feedback_panel_class_init (MsFeedbackPanelClass *klass)
   g_type_ensure (MS_TYPE_FEEDBACK_PROFILE);
   gtk_widget_class_set_template_from_resource (widget_class,
                                                "/mobi/phosh/MobileSettings/ui/ms-feedback-panel.ui");
-  gtk_widget_class_bind_template_child (widget_class, MsFeedbackPanel, app_listbox);
+  gtk_widget_class_bind_template_child (widget_class, MsFeedbackPanel, app_listview);
+  gtk_widget_class_bind_template_child (widget_class, MsFeedbackPanel, bulk_profile_row);
+  gtk_widget_class_bind_template_child (widget_class, MsFeedbackPanel, apply_selected_button);
+  gtk_widget_class_bind_template_callback (widget_class, on_apply_selected_clicked);
+  gtk_widget_class_bind_template_callback (widget_class, on_apply_all_clicked);
   gtk_widget_class_bind_template_child (widget_class, MsFeedbackPanel, toast_overlay);
   gtk_widget_class_bind_template_callback (widget_class, item_feedback_profile_name);
 
@@ -510,9 +795,25 @@ static void
 ms_feedback_panel_init (MsFeedbackPanel *self)
 {
   g_autoptr (GError) error = NULL;
+  g_autoptr (GtkListItemFactory) factory = gtk_signal_list_item_factory_new ();
 
   gtk_widget_init_template (GTK_WIDGET (self));
 
+  /* Rows are only created and bound for the apps that are visible */
+  self->apps = g_list_store_new (MS_TYPE_FBD_APPLICATION);
+  g_object_connect (factory,
+                    "signal::setup", G_CALLBACK (setup_application_row), NULL,
+                    "signal::bind", G_CALLBACK (bind_application_row), NULL,
+                    "signal::unbind", G_CALLBACK (unbind_application_row), NULL,
+                    NULL);
+  gtk_list_view_set_factory (self->app_listview, factory);
+  self->app_selection = GTK_SELECTION_MODEL (gtk_multi_selection_new (G_LIST_MODEL (g_object_ref (self->apps))));
+  g_signal_connect_object (self->app_selection, "selection-changed",
+                           G_CALLBACK (on_app_selection_changed), self,
+                           G_CONNECT_SWAPPED);
+  gtk_list_view_set_model (self->app_listview, self->app_selection);
+  on_app_selection_changed (self);
+
   /* Notifications settings */
   self->notifications_settings = g_settings_new (NOTIFICATIONS_SCHEMA);
 
@@ -522,8 +823,10 @@ ms_feedback_panel_init (MsFeedbackPanel *self)
                            G_CALLBACK (on_notifications_settings_changed), self, G_CONNECT_SWAPPED);
   on_notifications_settings_changed (self);
 
-  self->known_applications = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                    NULL, g_free);
+  /* Munged app ids are interned so they can be compared by pointer */
+  self->known_applications = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                    (GDestroyNotify) g_ref_string_release,
+                                                    NULL);
 
   self->sound_context = gsound_context_new (NULL, &error);
   if (self->sound_context == NULL)
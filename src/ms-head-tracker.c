@@ -11,9 +11,25 @@
 #include "mobile-settings-config.h"
 
 #include "ms-head-tracker.h"
+#include "ms-wayland-stats.h"
 
 #include "protocols/wlr-output-management-unstable-v1-client-protocol.h"
 
+#include <float.h>
+
+/**
+ * MsHeadTracker:
+ *
+ * Tracks the compositor's heads (outputs) via wlr-output-management.
+ *
+ * The compositor sends a head's state as a series of events followed
+ * by the manager's `done` event. The events are collected in each
+ * head's pending state and only applied on `done` so a head's state
+ * is always consistent. Added and removed heads also only show up in
+ * the model on `done`. The heads are available as a `GListModel` and
+ * each head notifies about changes to its properties.
+ */
+
 enum {
   PROP_0,
   PROP_OUTPUT_MANAGER,
@@ -33,21 +49,138 @@ static guint signals[N_SIGNALS];
 struct _MsHeadTracker {
   GObject               parent;
 
-  GPtrArray            *heads;
+  GListStore           *heads;
   GPtrArray            *heads_added;
+  GPtrArray            *heads_removed;
+
+  MsWaylandStats       *stats;
 
   struct zwlr_output_manager_v1 *output_manager;
+  gboolean              stopped;
 };
 
 G_DEFINE_TYPE (MsHeadTracker, ms_head_tracker, G_TYPE_OBJECT)
 
-G_DEFINE_BOXED_TYPE (MsHead, ms_head, ms_head_ref, ms_head_unref);
+
+enum {
+  HEAD_PROP_0,
+  HEAD_PROP_NAME,
+  HEAD_PROP_DESCRIPTION,
+  HEAD_PROP_MAKE,
+  HEAD_PROP_MODEL,
+  HEAD_PROP_SERIAL_NUMBER,
+  HEAD_PROP_ENABLED,
+  HEAD_PROP_CURRENT_MODE,
+  HEAD_PROP_SCALE,
+  HEAD_PROP_TRANSFORM,
+  HEAD_PROP_X,
+  HEAD_PROP_Y,
+  HEAD_PROP_PHYSICAL_WIDTH,
+  HEAD_PROP_PHYSICAL_HEIGHT,
+  HEAD_PROP_LAST_PROP
+};
+static GParamSpec *head_props[HEAD_PROP_LAST_PROP];
+
+
+enum {
+  HEAD_CHANGED,
+  HEAD_N_SIGNALS
+};
+static guint head_signals[HEAD_N_SIGNALS];
+
+
+typedef struct {
+  char       *name;
+  char       *description;
+  char       *make;
+  char       *model;
+  char       *serial_number;
+  gboolean    enabled;
+  MsHeadMode *current_mode;
+  double      scale;
+  int32_t     transform;
+  int32_t     x, y;
+  int32_t     physical_width, physical_height;
+} MsHeadState;
+
+
+struct _MsHead {
+  GObject                     parent;
+
+  struct zwlr_output_head_v1 *wlr_head;
+  MsHeadTracker              *tracker;
+
+  MsHeadState                 state;
+  GPtrArray                  *modes;
+  /* Collected until the manager's done event */
+  MsHeadState                 pending;
+  GPtrArray                  *pending_modes;
+  gboolean                    dirty;
+};
+
+G_DEFINE_TYPE (MsHead, ms_head, G_TYPE_OBJECT)
+
+
+static void
+ms_head_mode_clear (MsHeadMode *mode)
+{
+  g_clear_pointer (&mode->wlr_mode, zwlr_output_mode_v1_destroy);
+}
+
+
+MsHeadMode *
+ms_head_mode_ref (MsHeadMode *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return g_rc_box_acquire (self);
+}
+
+
+void
+ms_head_mode_unref (MsHeadMode *self)
+{
+  g_return_if_fail (self != NULL);
+
+  g_rc_box_release_full (self, (GDestroyNotify) ms_head_mode_clear);
+}
+
+G_DEFINE_BOXED_TYPE (MsHeadMode, ms_head_mode, ms_head_mode_ref, ms_head_mode_unref);
+
+
+static void
+ms_head_state_clear (MsHeadState *state)
+{
+  g_clear_pointer (&state->name, g_free);
+  g_clear_pointer (&state->description, g_free);
+  g_clear_pointer (&state->make, g_free);
+  g_clear_pointer (&state->model, g_free);
+  g_clear_pointer (&state->serial_number, g_free);
+  g_clear_pointer (&state->current_mode, ms_head_mode_unref);
+}
+
+
+static void
+set_pending_string (MsHead *head, char **field, const char *value)
+{
+  if (g_strcmp0 (*field, value) == 0)
+    return;
+
+  g_free (*field);
+  *field = g_strdup (value);
+  head->dirty = TRUE;
+}
 
 
 static void
 zwlr_output_mode_v1_handle_size (void *data, struct zwlr_output_mode_v1 *wlr_mode,
                                  int32_t width, int32_t height)
 {
+  MsHeadMode *mode = data;
+
+  /* Mode properties are only sent once right after the mode is announced */
+  mode->width = width;
+  mode->height = height;
 }
 
 
@@ -56,6 +189,9 @@ zwlr_output_mode_v1_handle_refresh (void                       *data,
                                     struct zwlr_output_mode_v1 *wlr_mode,
                                     int32_t                     refresh)
 {
+  MsHeadMode *mode = data;
+
+  mode->refresh = refresh;
 }
 
 
@@ -63,6 +199,9 @@ static void
 zwlr_output_mode_v1_handle_preferred (void                       *data,
                                       struct zwlr_output_mode_v1 *wlr_mode)
 {
+  MsHeadMode *mode = data;
+
+  mode->preferred = TRUE;
 }
 
 
@@ -70,7 +209,10 @@ static void
 zwlr_output_mode_v1_handle_finished (void                       *data,
                                      struct zwlr_output_mode_v1 *wlr_mode)
 {
-  zwlr_output_mode_v1_destroy (wlr_mode);
+  MsHeadMode *mode = data;
+
+  /* The head drops the mode on the next done event */
+  g_clear_pointer (&mode->wlr_mode, zwlr_output_mode_v1_destroy);
 }
 
 
@@ -91,8 +233,9 @@ handle_zwlr_output_head_name (
 {
   MsHead *head = data;
 
-  g_free (head->name);
-  head->name = g_strdup (name);
+  ms_wayland_stats_event (head->tracker->stats, "head.name");
+
+  set_pending_string (head, &head->pending.name, name);
 
   g_debug ("%p: Got name %s", zwlr_output_head_v1, name);
 }
@@ -103,6 +246,11 @@ handle_zwlr_output_head_description(void *data,
                                     struct zwlr_output_head_v1 *zwlr_output_head_v1,
                                     const char*description)
 {
+  MsHead *head = data;
+
+  ms_wayland_stats_event (head->tracker->stats, "head.description");
+
+  set_pending_string (head, &head->pending.description, description);
 }
 
 
@@ -112,14 +260,30 @@ handle_zwlr_output_head_physical_size (void *data,
                                        int32_t width,
                                        int32_t height)
 {
+  MsHead *head = data;
+
+  ms_wayland_stats_event (head->tracker->stats, "head.physical_size");
+
+  head->pending.physical_width = width;
+  head->pending.physical_height = height;
+  head->dirty = TRUE;
 }
 
 static void
 handle_zwlr_output_head_mode (void *data,
                               struct zwlr_output_head_v1 *zwlr_output_head_v1,
-                              struct zwlr_output_mode_v1 *mode)
+                              struct zwlr_output_mode_v1 *wlr_mode)
 {
-  zwlr_output_mode_v1_add_listener (mode, &mode_listener, NULL);
+  MsHead *head = data;
+  MsHeadMode *mode = g_rc_box_new0 (MsHeadMode);
+
+  ms_wayland_stats_event (head->tracker->stats, "head.mode");
+
+  mode->wlr_mode = wlr_mode;
+  zwlr_output_mode_v1_add_listener (wlr_mode, &mode_listener, mode);
+
+  g_ptr_array_add (head->pending_modes, mode);
+  head->dirty = TRUE;
 }
 
 static void
@@ -127,14 +291,32 @@ handle_zwlr_output_head_enabled (void *data,
                                  struct zwlr_output_head_v1 *zwlr_output_head_v1,
                                  int32_t enabled)
 {
+  MsHead *head = data;
+
+  ms_wayland_stats_event (head->tracker->stats, "head.enabled");
+
+  head->pending.enabled = !!enabled;
+  /* A disabled head has no current mode */
+  if (!enabled)
+    g_clear_pointer (&head->pending.current_mode, ms_head_mode_unref);
+  head->dirty = TRUE;
 }
 
 
 static void
 handle_zwlr_output_head_current_mode (void *data,
                                       struct zwlr_output_head_v1 *zwlr_output_head_v1,
-                                      struct zwlr_output_mode_v1 *mode)
+                                      struct zwlr_output_mode_v1 *wlr_mode)
 {
+  MsHead *head = data;
+  MsHeadMode *mode = zwlr_output_mode_v1_get_user_data (wlr_mode);
+
+  ms_wayland_stats_event (head->tracker->stats, "head.current_mode");
+
+  g_clear_pointer (&head->pending.current_mode, ms_head_mode_unref);
+  if (mode)
+    head->pending.current_mode = ms_head_mode_ref (mode);
+  head->dirty = TRUE;
 }
 
 static void
@@ -143,6 +325,13 @@ handle_zwlr_output_head_position (void *data,
                                   int32_t x,
                                   int32_t y)
 {
+  MsHead *head = data;
+
+  ms_wayland_stats_event (head->tracker->stats, "head.position");
+
+  head->pending.x = x;
+  head->pending.y = y;
+  head->dirty = TRUE;
 }
 
 
@@ -151,6 +340,12 @@ handle_zwlr_output_head_transform (void *data,
                                    struct zwlr_output_head_v1 *zwlr_output_head_v1,
                                    int32_t transform)
 {
+  MsHead *head = data;
+
+  ms_wayland_stats_event (head->tracker->stats, "head.transform");
+
+  head->pending.transform = transform;
+  head->dirty = TRUE;
 }
 
 
@@ -159,6 +354,12 @@ handle_zwlr_output_head_scale (void *data,
                                struct zwlr_output_head_v1 *zwlr_output_head_v1,
                                wl_fixed_t scale)
 {
+  MsHead *head = data;
+
+  ms_wayland_stats_event (head->tracker->stats, "head.scale");
+
+  head->pending.scale = wl_fixed_to_double (scale);
+  head->dirty = TRUE;
 }
 
 
@@ -167,16 +368,16 @@ handle_zwlr_output_head_finished (void *data,
                                   struct zwlr_output_head_v1 *zwlr_output_head_v1)
 {
   MsHead *head = data;
-  guint index;
+  MsHeadTracker *tracker = head->tracker;
 
-  if (g_ptr_array_find (head->tracker->heads, head, &index) == FALSE) {
-    g_warning ("Trying to remove inexistent head %p", head);
-    return;
-  }
+  ms_wayland_stats_event (head->tracker->stats, "head.finished");
 
-  g_signal_emit (head->tracker, signals[HEAD_REMOVED], 0, head);
+  /* Not announced yet */
+  if (g_ptr_array_remove (tracker->heads_added, head))
+    return;
 
-  g_ptr_array_remove_index_fast (head->tracker->heads, index);
+  /* Removed from the model on the next done */
+  g_ptr_array_add (tracker->heads_removed, g_object_ref (head));
 }
 
 
@@ -187,8 +388,9 @@ handle_zwlr_output_head_make (void *data,
 {
   MsHead *head = data;
 
-  g_free (head->make);
-  head->make = g_strdup (make);
+  ms_wayland_stats_event (head->tracker->stats, "head.make");
+
+  set_pending_string (head, &head->pending.make, make);
 
   g_debug ("%p: Got make %s", zwlr_output_head_v1, make);
 }
@@ -201,8 +403,9 @@ handle_zwlr_output_head_model (void *data,
 {
   MsHead *head = data;
 
-  g_free (head->model);
-  head->model = g_strdup (model);
+  ms_wayland_stats_event (head->tracker->stats, "head.model");
+
+  set_pending_string (head, &head->pending.model, model);
 
   g_debug ("%p: Got model %s", zwlr_output_head_v1, model);
 }
@@ -215,8 +418,9 @@ handle_zwlr_output_head_serial_number (void *data,
 {
   MsHead *head = data;
 
-  g_free (head->serial_number);
-  head->serial_number = g_strdup (serial_number);
+  ms_wayland_stats_event (head->tracker->stats, "head.serial_number");
+
+  set_pending_string (head, &head->pending.serial_number, serial_number);
 
   g_debug ("%p: Got serial number %s", zwlr_output_head_v1, serial_number);
 }
@@ -241,42 +445,450 @@ static const struct zwlr_output_head_v1_listener zwlr_output_head_v1_listener =
 
 
 static void
-ms_head_destroy (gpointer data)
+commit_string (MsHead *head, char **field, const char *pending, guint prop)
 {
-  MsHead *head = data;
+  if (g_strcmp0 (*field, pending) == 0)
+    return;
+
+  g_free (*field);
+  *field = g_strdup (pending);
+  g_object_notify_by_pspec (G_OBJECT (head), head_props[prop]);
+}
+
+
+static void
+commit_int (MsHead *head, int32_t *field, int32_t pending, guint prop)
+{
+  if (*field == pending)
+    return;
+
+  *field = pending;
+  g_object_notify_by_pspec (G_OBJECT (head), head_props[prop]);
+}
+
+
+static gboolean
+modes_equal (GPtrArray *a, GPtrArray *b)
+{
+  if (a->len != b->len)
+    return FALSE;
+
+  for (guint i = 0; i < a->len; i++) {
+    if (g_ptr_array_index (a, i) != g_ptr_array_index (b, i))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Apply the pending state, invoked on the manager's done event */
+static void
+ms_head_commit (MsHead *self)
+{
+  MsHeadState *state = &self->state;
+  MsHeadState *pending = &self->pending;
+
+  /* Drop modes that went away */
+  for (guint i = self->pending_modes->len; i > 0; i--) {
+    MsHeadMode *mode = g_ptr_array_index (self->pending_modes, i - 1);
+
+    if (mode->wlr_mode == NULL) {
+      if (pending->current_mode == mode)
+        g_clear_pointer (&pending->current_mode, ms_head_mode_unref);
+      g_ptr_array_remove_index (self->pending_modes, i - 1);
+      self->dirty = TRUE;
+    }
+  }
+
+  if (!self->dirty)
+    return;
+
+  g_object_freeze_notify (G_OBJECT (self));
+
+  commit_string (self, &state->name, pending->name, HEAD_PROP_NAME);
+  commit_string (self, &state->description, pending->description, HEAD_PROP_DESCRIPTION);
+  commit_string (self, &state->make, pending->make, HEAD_PROP_MAKE);
+  commit_string (self, &state->model, pending->model, HEAD_PROP_MODEL);
+  commit_string (self, &state->serial_number, pending->serial_number, HEAD_PROP_SERIAL_NUMBER);
+
+  if (state->enabled != pending->enabled) {
+    state->enabled = pending->enabled;
+    g_object_notify_by_pspec (G_OBJECT (self), head_props[HEAD_PROP_ENABLED]);
+  }
+
+  if (!modes_equal (self->modes, self->pending_modes)) {
+    g_ptr_array_set_size (self->modes, 0);
+    for (guint i = 0; i < self->pending_modes->len; i++)
+      g_ptr_array_add (self->modes, ms_head_mode_ref (g_ptr_array_index (self->pending_modes, i)));
+  }
+
+  if (state->current_mode != pending->current_mode) {
+    g_clear_pointer (&state->current_mode, ms_head_mode_unref);
+    if (pending->current_mode)
+      state->current_mode = ms_head_mode_ref (pending->current_mode);
+    g_object_notify_by_pspec (G_OBJECT (self), head_props[HEAD_PROP_CURRENT_MODE]);
+  }
+
+  if (!G_APPROX_VALUE (state->scale, pending->scale, FLT_EPSILON)) {
+    state->scale = pending->scale;
+    g_object_notify_by_pspec (G_OBJECT (self), head_props[HEAD_PROP_SCALE]);
+  }
+
+  commit_int (self, &state->transform, pending->transform, HEAD_PROP_TRANSFORM);
+  commit_int (self, &state->x, pending->x, HEAD_PROP_X);
+  commit_int (self, &state->y, pending->y, HEAD_PROP_Y);
+  commit_int (self, &state->physical_width, pending->physical_width, HEAD_PROP_PHYSICAL_WIDTH);
+  commit_int (self, &state->physical_height, pending->physical_height, HEAD_PROP_PHYSICAL_HEIGHT);
+
+  self->dirty = FALSE;
+  g_object_thaw_notify (G_OBJECT (self));
+
+  g_signal_emit (self, head_signals[HEAD_CHANGED], 0);
+}
+
+
+static void
+ms_head_get_property (GObject    *object,
+                      guint       property_id,
+                      GValue     *value,
+                      GParamSpec *pspec)
+{
+  MsHead *self = MS_HEAD (object);
+
+  switch (property_id) {
+  case HEAD_PROP_NAME:
+    g_value_set_string (value, self->state.name);
+    break;
+  case HEAD_PROP_DESCRIPTION:
+    g_value_set_string (value, self->state.description);
+    break;
+  case HEAD_PROP_MAKE:
+    g_value_set_string (value, self->state.make);
+    break;
+  case HEAD_PROP_MODEL:
+    g_value_set_string (value, self->state.model);
+    break;
+  case HEAD_PROP_SERIAL_NUMBER:
+    g_value_set_string (value, self->state.serial_number);
+    break;
+  case HEAD_PROP_ENABLED:
+    g_value_set_boolean (value, self->state.enabled);
+    break;
+  case HEAD_PROP_CURRENT_MODE:
+    g_value_set_boxed (value, self->state.current_mode);
+    break;
+  case HEAD_PROP_SCALE:
+    g_value_set_double (value, self->state.scale);
+    break;
+  case HEAD_PROP_TRANSFORM:
+    g_value_set_int (value, self->state.transform);
+    break;
+  case HEAD_PROP_X:
+    g_value_set_int (value, self->state.x);
+    break;
+  case HEAD_PROP_Y:
+    g_value_set_int (value, self->state.y);
+    break;
+  case HEAD_PROP_PHYSICAL_WIDTH:
+    g_value_set_int (value, self->state.physical_width);
+    break;
+  case HEAD_PROP_PHYSICAL_HEIGHT:
+    g_value_set_int (value, self->state.physical_height);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+ms_head_finalize (GObject *object)
+{
+  MsHead *self = MS_HEAD (object);
 
-  g_debug ("Destroying head %s", head->name);
-  g_clear_pointer (&head->name, g_free);
-  g_clear_pointer (&head->make, g_free);
-  g_clear_pointer (&head->model, g_free);
-  g_clear_pointer (&head->serial_number, g_free);
-  g_clear_pointer (&head->head, zwlr_output_head_v1_destroy);
+  g_debug ("Destroying head %s", self->state.name);
+
+  /* Make sure no more mode events arrive */
+  for (guint i = 0; i < self->pending_modes->len; i++)
+    ms_head_mode_clear (g_ptr_array_index (self->pending_modes, i));
+
+  ms_head_state_clear (&self->state);
+  ms_head_state_clear (&self->pending);
+  g_clear_pointer (&self->modes, g_ptr_array_unref);
+  g_clear_pointer (&self->pending_modes, g_ptr_array_unref);
+  g_clear_pointer (&self->wlr_head, zwlr_output_head_v1_destroy);
+
+  G_OBJECT_CLASS (ms_head_parent_class)->finalize (object);
+}
+
+
+static void
+ms_head_class_init (MsHeadClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->get_property = ms_head_get_property;
+  object_class->finalize = ms_head_finalize;
+
+  head_props[HEAD_PROP_NAME] =
+    g_param_spec_string ("name", "", "",
+                         NULL,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  head_props[HEAD_PROP_DESCRIPTION] =
+    g_param_spec_string ("description", "", "",
+                         NULL,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  head_props[HEAD_PROP_MAKE] =
+    g_param_spec_string ("make", "", "",
+                         NULL,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  head_props[HEAD_PROP_MODEL] =
+    g_param_spec_string ("model", "", "",
+                         NULL,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  head_props[HEAD_PROP_SERIAL_NUMBER] =
+    g_param_spec_string ("serial-number", "", "",
+                         NULL,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  head_props[HEAD_PROP_ENABLED] =
+    g_param_spec_boolean ("enabled", "", "",
+                          FALSE,
+                          G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  head_props[HEAD_PROP_CURRENT_MODE] =
+    g_param_spec_boxed ("current-mode", "", "",
+                        MS_TYPE_HEAD_MODE,
+                        G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  head_props[HEAD_PROP_SCALE] =
+    g_param_spec_double ("scale", "", "",
+                         0.0, G_MAXDOUBLE, 1.0,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  /**
+   * MsHead:transform:
+   *
+   * The head's `wl_output_transform`
+   */
+  head_props[HEAD_PROP_TRANSFORM] =
+    g_param_spec_int ("transform", "", "",
+                      0, G_MAXINT, 0,
+                      G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  head_props[HEAD_PROP_X] =
+    g_param_spec_int ("x", "", "",
+                      G_MININT, G_MAXINT, 0,
+                      G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  head_props[HEAD_PROP_Y] =
+    g_param_spec_int ("y", "", "",
+                      G_MININT, G_MAXINT, 0,
+                      G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  /**
+   * MsHead:physical-width:
+   *
+   * The head's physical width in millimeters
+   */
+  head_props[HEAD_PROP_PHYSICAL_WIDTH] =
+    g_param_spec_int ("physical-width", "", "",
+                      0, G_MAXINT, 0,
+                      G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  /**
+   * MsHead:physical-height:
+   *
+   * The head's physical height in millimeters
+   */
+  head_props[HEAD_PROP_PHYSICAL_HEIGHT] =
+    g_param_spec_int ("physical-height", "", "",
+                      0, G_MAXINT, 0,
+                      G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, HEAD_PROP_LAST_PROP, head_props);
+
+  /**
+   * MsHead::changed:
+   *
+   * Emitted once per update of the head's state from the compositor
+   * after all property notifications. Use this when interested in
+   * changes to the list of modes.
+   */
+  head_signals[HEAD_CHANGED] = g_signal_new ("changed",
+                                             G_TYPE_FROM_CLASS (klass),
+                                             G_SIGNAL_RUN_LAST,
+                                             0, /* class offset */
+                                             NULL, /* accumulator */
+                                             NULL, /* accu_data */
+                                             NULL, /* marshaller */
+                                             G_TYPE_NONE, /* return */
+                                             0 /* n_params */);
+}
+
+
+static void
+ms_head_init (MsHead *self)
+{
+  self->state.scale = self->pending.scale = 1.0;
+  self->modes = g_ptr_array_new_with_free_func ((GDestroyNotify) ms_head_mode_unref);
+  self->pending_modes = g_ptr_array_new_with_free_func ((GDestroyNotify) ms_head_mode_unref);
 }
 
 
 static MsHead *
 ms_head_new (struct zwlr_output_head_v1 *zwlr_output_head_v1, MsHeadTracker *tracker)
 {
-  MsHead *head = g_new0 (MsHead, 1);
+  MsHead *head = g_object_new (MS_TYPE_HEAD, NULL);
 
-  g_atomic_ref_count_init (&head->ref_count);
-  head->head = zwlr_output_head_v1;
+  head->wlr_head = zwlr_output_head_v1;
   head->tracker = tracker;
 
-  zwlr_output_head_v1_add_listener (head->head,
+  zwlr_output_head_v1_add_listener (head->wlr_head,
                                     &zwlr_output_head_v1_listener, head);
   return head;
 }
 
 
+const char *
+ms_head_get_name (MsHead *self)
+{
+  g_return_val_if_fail (MS_IS_HEAD (self), NULL);
+
+  return self->state.name;
+}
+
+
+const char *
+ms_head_get_description (MsHead *self)
+{
+  g_return_val_if_fail (MS_IS_HEAD (self), NULL);
+
+  return self->state.description;
+}
+
+
+const char *
+ms_head_get_make (MsHead *self)
+{
+  g_return_val_if_fail (MS_IS_HEAD (self), NULL);
+
+  return self->state.make;
+}
+
+
+const char *
+ms_head_get_model (MsHead *self)
+{
+  g_return_val_if_fail (MS_IS_HEAD (self), NULL);
+
+  return self->state.model;
+}
+
+
+const char *
+ms_head_get_serial_number (MsHead *self)
+{
+  g_return_val_if_fail (MS_IS_HEAD (self), NULL);
+
+  return self->state.serial_number;
+}
+
+
+gboolean
+ms_head_get_enabled (MsHead *self)
+{
+  g_return_val_if_fail (MS_IS_HEAD (self), FALSE);
+
+  return self->state.enabled;
+}
+
+/**
+ * ms_head_get_modes:
+ * @self: The head
+ *
+ * Get the modes supported by the head.
+ *
+ * Returns:(transfer none)(element-type MsHeadMode): The modes
+ */
+GPtrArray *
+ms_head_get_modes (MsHead *self)
+{
+  g_return_val_if_fail (MS_IS_HEAD (self), NULL);
+
+  return self->modes;
+}
+
+/**
+ * ms_head_get_current_mode:
+ * @self: The head
+ *
+ * Get the head's current mode.
+ *
+ * Returns:(transfer none)(nullable): The current mode or %NULL if the head
+ *   is disabled.
+ */
+MsHeadMode *
+ms_head_get_current_mode (MsHead *self)
+{
+  g_return_val_if_fail (MS_IS_HEAD (self), NULL);
+
+  return self->state.current_mode;
+}
+
+
+double
+ms_head_get_scale (MsHead *self)
+{
+  g_return_val_if_fail (MS_IS_HEAD (self), 1.0);
+
+  return self->state.scale;
+}
+
+
+int
+ms_head_get_transform (MsHead *self)
+{
+  g_return_val_if_fail (MS_IS_HEAD (self), 0);
+
+  return self->state.transform;
+}
+
+
+void
+ms_head_get_position (MsHead *self, int *x, int *y)
+{
+  g_return_if_fail (MS_IS_HEAD (self));
+
+  if (x)
+    *x = self->state.x;
+  if (y)
+    *y = self->state.y;
+}
+
+
+void
+ms_head_get_physical_size (MsHead *self, int *width, int *height)
+{
+  g_return_if_fail (MS_IS_HEAD (self));
+
+  if (width)
+    *width = self->state.physical_width;
+  if (height)
+    *height = self->state.physical_height;
+}
+
+
 static void
 handle_zwlr_output_manager_head (void *data,
   struct zwlr_output_manager_v1 *zwlr_foreign_head_manager_v1,
   struct zwlr_output_head_v1     *zwlr_output_head_v1)
 {
-  MsHeadTracker *self = MS_HEAD_TRACKER (data);
+  MsHeadTracker *self;
   MsHead *head;
 
+  /* Tracker is gone but the compositor didn't process the stop yet */
+  if (data == NULL) {
+    zwlr_output_head_v1_destroy (zwlr_output_head_v1);
+    return;
+  }
+
+  self = MS_HEAD_TRACKER (data);
+  ms_wayland_stats_event (self->stats, "head");
+
   head = ms_head_new (zwlr_output_head_v1, self);
   g_ptr_array_add (self->heads_added, head);
 
@@ -289,14 +901,60 @@ handle_zwlr_output_manager_done (void *data,
                                  struct zwlr_output_manager_v1 *zwlr_output_manager_v1,
                                  uint32_t serial)
 {
-  MsHeadTracker *self = MS_HEAD_TRACKER (data);
+  MsHeadTracker *self;
+  guint n_heads;
+  g_autoptr (GPtrArray) added = NULL;
+  g_autoptr (GPtrArray) removed = NULL;
+
+  if (data == NULL)
+    return;
+
+  self = MS_HEAD_TRACKER (data);
+  n_heads = g_list_model_get_n_items (G_LIST_MODEL (self->heads));
+
+  g_debug ("Applying head state for serial %u", serial);
+
+  ms_wayland_stats_event (self->stats, "done");
+  ms_wayland_stats_batch_begin (self->stats);
+
+  for (guint i = 0; i < n_heads; i++) {
+    g_autoptr (MsHead) head = g_list_model_get_item (G_LIST_MODEL (self->heads), i);
+
+    ms_head_commit (head);
+  }
+
+  if (self->heads_added->len == 0 && self->heads_removed->len == 0) {
+    ms_wayland_stats_batch_end (self->stats);
+    return;
+  }
+
+  removed = g_steal_pointer (&self->heads_removed);
+  self->heads_removed = g_ptr_array_new_with_free_func (g_object_unref);
+  for (guint i = 0; i < removed->len; i++) {
+    MsHead *head = g_ptr_array_index (removed, i);
+    guint index;
 
-  while (self->heads_added->len) {
-    MsHead *head = g_ptr_array_steal_index_fast (self->heads_added, 0);
+    if (g_list_store_find (self->heads, head, &index) == FALSE) {
+      g_warning ("Trying to remove inexistent head %p", head);
+      continue;
+    }
 
-    g_ptr_array_add (self->heads, head);
-    g_signal_emit (head->tracker, signals[HEAD_ADDED], 0, head);
+    g_signal_emit (self, signals[HEAD_REMOVED], 0, head);
+    g_list_store_remove (self->heads, index);
   }
+  n_heads = g_list_model_get_n_items (G_LIST_MODEL (self->heads));
+
+  added = g_steal_pointer (&self->heads_added);
+  self->heads_added = g_ptr_array_new_with_free_func (g_object_unref);
+  for (guint i = 0; i < added->len; i++)
+    ms_head_commit (g_ptr_array_index (added, i));
+
+  g_list_store_splice (self->heads, n_heads, 0, added->pdata, added->len);
+  ms_wayland_stats_batch_end (self->stats);
+  ms_wayland_stats_set_live (self->stats, "heads", n_heads + added->len);
+
+  for (guint i = 0; i < added->len; i++)
+    g_signal_emit (self, signals[HEAD_ADDED], 0, g_ptr_array_index (added, i));
 }
 
 
@@ -304,7 +962,17 @@ static void
 handle_zwlr_output_manager_finished (void *data,
                                      struct zwlr_output_manager_v1 *zwlr_output_manager_v1)
 {
+  MsHeadTracker *self;
+
   g_debug ("wlr_output_manager_finished");
+  zwlr_output_manager_v1_destroy (zwlr_output_manager_v1);
+
+  if (data == NULL)
+    return;
+
+  self = MS_HEAD_TRACKER (data);
+  ms_wayland_stats_event (self->stats, "finished");
+  self->output_manager = NULL;
 }
 
 
@@ -365,13 +1033,41 @@ ms_head_tracker_constructed (GObject *object)
 }
 
 
+/* Heads can outlive the tracker, make sure they get no more events */
+static void
+head_detach (gpointer data, gpointer user_data)
+{
+  MsHead *head = MS_HEAD (data);
+
+  g_clear_pointer (&head->wlr_head, zwlr_output_head_v1_destroy);
+  head->tracker = NULL;
+}
+
+
 static void
 ms_head_tracker_finalize (GObject *object)
 {
   MsHeadTracker *self = MS_HEAD_TRACKER(object);
+  guint n_heads = g_list_model_get_n_items (G_LIST_MODEL (self->heads));
+
+  /* Late events are handled without us, the proxy is destroyed on finished */
+  if (self->output_manager) {
+    ms_head_tracker_stop (self);
+    wl_proxy_set_user_data ((struct wl_proxy *) self->output_manager, NULL);
+    self->output_manager = NULL;
+  }
+
+  for (guint i = 0; i < n_heads; i++) {
+    g_autoptr (MsHead) head = g_list_model_get_item (G_LIST_MODEL (self->heads), i);
 
-  g_clear_pointer (&self->heads, g_ptr_array_unref);
+    head_detach (head, NULL);
+  }
+  g_ptr_array_foreach (self->heads_added, head_detach, NULL);
+
+  g_clear_object (&self->heads);
   g_clear_pointer (&self->heads_added, g_ptr_array_unref);
+  g_clear_pointer (&self->heads_removed, g_ptr_array_unref);
+  g_clear_pointer (&self->stats, ms_wayland_stats_free);
 
   G_OBJECT_CLASS (ms_head_tracker_parent_class)->finalize (object);
 }
@@ -420,8 +1116,10 @@ ms_head_tracker_class_init (MsHeadTrackerClass *klass)
 static void
 ms_head_tracker_init (MsHeadTracker *self)
 {
-  self->heads = g_ptr_array_new_full (1, (GDestroyNotify) ms_head_unref);
-  self->heads_added = g_ptr_array_new_full (1, (GDestroyNotify) ms_head_unref);
+  self->heads = g_list_store_new (MS_TYPE_HEAD);
+  self->heads_added = g_ptr_array_new_with_free_func (g_object_unref);
+  self->heads_removed = g_ptr_array_new_with_free_func (g_object_unref);
+  self->stats = ms_wayland_stats_new ("Heads");
 }
 
 
@@ -433,33 +1131,57 @@ ms_head_tracker_new (gpointer output_manager)
                                         NULL));
 }
 
-
-GPtrArray *
+/**
+ * ms_head_tracker_get_heads:
+ * @self: The head tracker
+ *
+ * Get the current heads. The model only changes on the output
+ * manager's `done` event so heads in it are always in a consistent
+ * state.
+ *
+ * Returns:(transfer none): The heads
+ */
+GListModel *
 ms_head_tracker_get_heads (MsHeadTracker *self)
 {
   g_assert (MS_IS_HEAD_TRACKER (self));
 
-  return self->heads;
+  return G_LIST_MODEL (self->heads);
 }
 
 
-MsHead *
-ms_head_ref (MsHead *self)
+/**
+ * ms_head_tracker_get_stats:
+ * @self: The head tracker
+ *
+ * Get statistics about the handled Wayland events.
+ *
+ * Returns:(transfer none): The stats
+ */
+MsWaylandStats *
+ms_head_tracker_get_stats (MsHeadTracker *self)
 {
-  g_return_val_if_fail (self != NULL, NULL);
-  g_return_val_if_fail (self->ref_count, NULL);
+  g_return_val_if_fail (MS_IS_HEAD_TRACKER (self), NULL);
 
-  g_atomic_ref_count_inc (&self->ref_count);
-
-  return self;
+  return self->stats;
 }
 
+/**
+ * ms_head_tracker_stop:
+ * @self: The head tracker
+ *
+ * Asks the compositor to stop sending output events, e.g. because
+ * the manager's global went away. The manager is released once the
+ * compositor acknowledges this with `finished`.
+ */
 void
-ms_head_unref (MsHead *self)
+ms_head_tracker_stop (MsHeadTracker *self)
 {
-  g_return_if_fail (self != NULL);
-  g_return_if_fail (self->ref_count);
+  g_return_if_fail (MS_IS_HEAD_TRACKER (self));
+
+  if (self->output_manager == NULL || self->stopped)
+    return;
 
-  if (g_atomic_ref_count_dec (&self->ref_count))
-    ms_head_destroy (self);
+  zwlr_output_manager_v1_stop (self->output_manager);
+  self->stopped = TRUE;
 }
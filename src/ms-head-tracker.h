@@ -6,31 +6,60 @@
 
 #pragma once
 
-#include <glib-object.h>
+#include "ms-wayland-stats.h"
+
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
-#define MS_TYPE_HEAD_TRACKER (ms_head_tracker_get_type ())
+/**
+ * MsHeadMode:
+ * @width: The mode's width in physical pixels
+ * @height: The mode's height in physical pixels
+ * @refresh: The refresh rate in mHz or `0` if unknown
+ * @preferred: Whether this is the head's preferred mode
+ *
+ * A mode supported by a head.
+ */
+typedef struct {
+  int                         width;
+  int                         height;
+  int                         refresh;
+  gboolean                    preferred;
+  /*< private >*/
+  struct zwlr_output_mode_v1 *wlr_mode;
+} MsHeadMode;
 
-G_DECLARE_FINAL_TYPE (MsHeadTracker, ms_head_tracker, MS, HEAD_TRACKER, GObject)
+GType ms_head_mode_get_type (void) G_GNUC_CONST;
+#define MS_TYPE_HEAD_MODE (ms_head_mode_get_type ())
+
+MsHeadMode *ms_head_mode_ref (MsHeadMode *self);
+void        ms_head_mode_unref (MsHeadMode *self);
 
-typedef struct {
-  gatomicrefcount      ref_count;
-  char                *name;
-  char                *make;
-  char                *model;
-  char                *serial_number;
-  struct zwlr_output_head_v1 *head;
-  MsHeadTracker *tracker;
-} MsHead;
-
-GType ms_head_get_type (void) G_GNUC_CONST;
 #define MS_TYPE_HEAD (ms_head_get_type ())
 
-MsHead *ms_head_ref (MsHead *self);
-void    ms_head_unref (MsHead *self);
+G_DECLARE_FINAL_TYPE (MsHead, ms_head, MS, HEAD, GObject)
+
+const char    *ms_head_get_name (MsHead *self);
+const char    *ms_head_get_description (MsHead *self);
+const char    *ms_head_get_make (MsHead *self);
+const char    *ms_head_get_model (MsHead *self);
+const char    *ms_head_get_serial_number (MsHead *self);
+gboolean       ms_head_get_enabled (MsHead *self);
+GPtrArray     *ms_head_get_modes (MsHead *self);
+MsHeadMode    *ms_head_get_current_mode (MsHead *self);
+double         ms_head_get_scale (MsHead *self);
+int            ms_head_get_transform (MsHead *self);
+void           ms_head_get_position (MsHead *self, int *x, int *y);
+void           ms_head_get_physical_size (MsHead *self, int *width, int *height);
+
+#define MS_TYPE_HEAD_TRACKER (ms_head_tracker_get_type ())
+
+G_DECLARE_FINAL_TYPE (MsHeadTracker, ms_head_tracker, MS, HEAD_TRACKER, GObject)
 
 MsHeadTracker *ms_head_tracker_new (gpointer foreign_head_manager);
-GPtrArray     *ms_head_tracker_get_heads (MsHeadTracker *self);
+GListModel    *ms_head_tracker_get_heads (MsHeadTracker *self);
+MsWaylandStats *ms_head_tracker_get_stats (MsHeadTracker *self);
+void           ms_head_tracker_stop (MsHeadTracker *self);
 
 G_END_DECLS
@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ms-icon-cache"
+
+#include "mobile-settings-config.h"
+
+#include "ms-icon-cache.h"
+
+/**
+ * MsIconCache:
+ *
+ * Hands out shared paintables for (app) icons so panels showing the
+ * same apps don't look up and decode the same icons over and over.
+ *
+ * Icons are keyed by `GIcon`, size and scale. The icon theme lookup
+ * happens on the main thread but the icon is decoded in a thread. Until
+ * then the paintable shows a generic application icon. Cached icons
+ * are reloaded when the icon theme changes. The cache is bounded by the
+ * size of the decoded textures, least recently used icons get dropped
+ * first, icons that are still loading are kept. Dropped paintables
+ * stay valid for as long as they are in use.
+ */
+
+#define PLACEHOLDER_ICON "application-x-executable"
+#define MAX_CACHE_BYTES (16 * 1024 * 1024)
+
+/* MsIconPaintable: A paintable that can be updated once the icon is loaded */
+
+#define MS_TYPE_ICON_PAINTABLE (ms_icon_paintable_get_type ())
+G_DECLARE_FINAL_TYPE (MsIconPaintable, ms_icon_paintable, MS, ICON_PAINTABLE, GObject)
+
+struct _MsIconPaintable {
+  GObject       parent;
+
+  int           size;
+  GdkPaintable *paintable;
+};
+
+static void ms_icon_paintable_iface_init (GdkPaintableInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (MsIconPaintable, ms_icon_paintable, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GDK_TYPE_PAINTABLE, ms_icon_paintable_iface_init))
+
+
+static void
+ms_icon_paintable_snapshot (GdkPaintable *paintable,
+                            GdkSnapshot  *snapshot,
+                            double        width,
+                            double        height)
+{
+  MsIconPaintable *self = MS_ICON_PAINTABLE (paintable);
+
+  if (self->paintable)
+    gdk_paintable_snapshot (self->paintable, snapshot, width, height);
+}
+
+
+static GdkPaintableFlags
+ms_icon_paintable_get_flags (GdkPaintable *paintable)
+{
+  return GDK_PAINTABLE_STATIC_SIZE;
+}
+
+
+static int
+ms_icon_paintable_get_intrinsic_size (GdkPaintable *paintable)
+{
+  return MS_ICON_PAINTABLE (paintable)->size;
+}
+
+
+static void
+ms_icon_paintable_iface_init (GdkPaintableInterface *iface)
+{
+  iface->snapshot = ms_icon_paintable_snapshot;
+  iface->get_flags = ms_icon_paintable_get_flags;
+  iface->get_intrinsic_width = ms_icon_paintable_get_intrinsic_size;
+  iface->get_intrinsic_height = ms_icon_paintable_get_intrinsic_size;
+}
+
+
+static void
+ms_icon_paintable_finalize (GObject *object)
+{
+  MsIconPaintable *self = MS_ICON_PAINTABLE (object);
+
+  g_clear_object (&self->paintable);
+
+  G_OBJECT_CLASS (ms_icon_paintable_parent_class)->finalize (object);
+}
+
+
+static void
+ms_icon_paintable_class_init (MsIconPaintableClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ms_icon_paintable_finalize;
+}
+
+
+static void
+ms_icon_paintable_init (MsIconPaintable *self)
+{
+}
+
+
+static void
+ms_icon_paintable_set_paintable (MsIconPaintable *self, GdkPaintable *paintable)
+{
+  if (!g_set_object (&self->paintable, paintable))
+    return;
+
+  gdk_paintable_invalidate_contents (GDK_PAINTABLE (self));
+}
+
+/* MsIconCache */
+
+typedef struct {
+  GIcon           *icon;
+  int              size;
+  int              scale;
+
+  MsIconPaintable *paintable;
+  GCancellable    *cancel;
+  gsize            n_bytes;
+  GList            link;
+} MsIconCacheEntry;
+
+
+struct _MsIconCache {
+  GObject       parent;
+
+  GtkIconTheme *theme;
+  GHashTable   *entries;
+  GQueue        lru;
+  gsize         n_bytes;
+};
+G_DEFINE_TYPE (MsIconCache, ms_icon_cache, G_TYPE_OBJECT)
+
+
+static guint
+entry_hash (gconstpointer data)
+{
+  const MsIconCacheEntry *entry = data;
+
+  return g_icon_hash ((gpointer) entry->icon) ^ (entry->size << 8) ^ entry->scale;
+}
+
+
+static gboolean
+entry_equal (gconstpointer a, gconstpointer b)
+{
+  const MsIconCacheEntry *entry_a = a, *entry_b = b;
+
+  return entry_a->size == entry_b->size &&
+    entry_a->scale == entry_b->scale &&
+    g_icon_equal (entry_a->icon, entry_b->icon);
+}
+
+
+static void
+entry_free (gpointer data)
+{
+  MsIconCacheEntry *entry = data;
+
+  g_cancellable_cancel (entry->cancel);
+  g_clear_object (&entry->cancel);
+  g_clear_object (&entry->paintable);
+  g_clear_object (&entry->icon);
+  g_free (entry);
+}
+
+
+typedef struct {
+  GFile *file;
+  int    px;
+} MsIconLoadData;
+
+
+static void
+load_data_free (gpointer data)
+{
+  MsIconLoadData *load_data = data;
+
+  g_clear_object (&load_data->file);
+  g_free (load_data);
+}
+
+
+static void
+load_texture_thread (GTask        *task,
+                     gpointer      source_object,
+                     gpointer      task_data,
+                     GCancellable *cancellable)
+{
+  MsIconLoadData *load_data = task_data;
+  g_autoptr (GFileInputStream) stream = NULL;
+  g_autoptr (GdkPixbuf) pixbuf = NULL;
+  GError *err = NULL;
+
+  stream = g_file_read (load_data->file, cancellable, &err);
+  if (stream == NULL) {
+    g_task_return_error (task, err);
+    return;
+  }
+
+  pixbuf = gdk_pixbuf_new_from_stream_at_scale (G_INPUT_STREAM (stream),
+                                                load_data->px, load_data->px, TRUE,
+                                                cancellable, &err);
+  if (pixbuf == NULL) {
+    g_task_return_error (task, err);
+    return;
+  }
+
+  g_task_return_pointer (task, gdk_texture_new_for_pixbuf (pixbuf), g_object_unref);
+}
+
+
+static void
+evict_entries (MsIconCache *self)
+{
+  GList *l = self->lru.head;
+
+  /* The most recently used entry is always kept */
+  while (self->n_bytes > MAX_CACHE_BYTES && l && l->next) {
+    MsIconCacheEntry *entry = l->data;
+
+    l = l->next;
+    /* Dropping it would cancel the load and leave its users with the placeholder */
+    if (entry->cancel)
+      continue;
+
+    g_queue_unlink (&self->lru, &entry->link);
+    self->n_bytes -= entry->n_bytes;
+    g_hash_table_remove (self->entries, entry);
+  }
+}
+
+
+static void
+set_entry_paintable (MsIconCache *self, MsIconCacheEntry *entry, GdkPaintable *paintable)
+{
+  int width = gdk_paintable_get_intrinsic_width (paintable);
+  int height = gdk_paintable_get_intrinsic_height (paintable);
+
+  self->n_bytes -= entry->n_bytes;
+  entry->n_bytes = (gsize) width * height * 4;
+  self->n_bytes += entry->n_bytes;
+
+  ms_icon_paintable_set_paintable (entry->paintable, paintable);
+}
+
+
+static void
+on_texture_loaded (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  MsIconCacheEntry *entry = user_data;
+  g_autoptr (GdkTexture) texture = NULL;
+  g_autoptr (GError) err = NULL;
+  MsIconCache *self;
+
+  texture = g_task_propagate_pointer (G_TASK (res), &err);
+  if (texture == NULL) {
+    /* The entry got dropped or is being reloaded */
+    if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      return;
+
+    g_warning ("Failed to load icon: %s", err->message);
+    g_clear_object (&entry->cancel);
+    return;
+  }
+
+  self = MS_ICON_CACHE (source_object);
+  g_clear_object (&entry->cancel);
+  set_entry_paintable (self, entry, GDK_PAINTABLE (texture));
+  evict_entries (self);
+}
+
+
+static void
+load_entry (MsIconCache *self, MsIconCacheEntry *entry)
+{
+  g_autoptr (GtkIconPaintable) icon_paintable = NULL;
+  g_autoptr (GFile) file = NULL;
+  g_autoptr (GTask) task = NULL;
+  MsIconLoadData *load_data;
+
+  g_cancellable_cancel (entry->cancel);
+  g_clear_object (&entry->cancel);
+
+  icon_paintable = gtk_icon_theme_lookup_by_gicon (self->theme, entry->icon,
+                                                   entry->size, entry->scale,
+                                                   GTK_TEXT_DIR_NONE, 0);
+  file = gtk_icon_paintable_get_file (icon_paintable);
+
+  /* Let GTK handle symbolics and icons not backed by a file */
+  if (file == NULL || gtk_icon_paintable_is_symbolic (icon_paintable)) {
+    set_entry_paintable (self, entry, GDK_PAINTABLE (icon_paintable));
+    return;
+  }
+
+  entry->cancel = g_cancellable_new ();
+  task = g_task_new (self, entry->cancel, on_texture_loaded, entry);
+  g_task_set_source_tag (task, load_entry);
+  load_data = g_new0 (MsIconLoadData, 1);
+  load_data->file = g_steal_pointer (&file);
+  load_data->px = entry->size * entry->scale;
+  g_task_set_task_data (task, load_data, load_data_free);
+  g_task_run_in_thread (task, load_texture_thread);
+}
+
+
+static void
+on_icon_theme_changed (MsIconCache *self)
+{
+  GHashTableIter iter;
+  gpointer entry;
+
+  g_debug ("Icon theme changed, reloading %u icons", g_hash_table_size (self->entries));
+
+  g_hash_table_iter_init (&iter, self->entries);
+  while (g_hash_table_iter_next (&iter, &entry, NULL))
+    load_entry (self, entry);
+
+  evict_entries (self);
+}
+
+
+static void
+ms_icon_cache_finalize (GObject *object)
+{
+  MsIconCache *self = MS_ICON_CACHE (object);
+
+  g_queue_clear (&self->lru);
+  g_clear_pointer (&self->entries, g_hash_table_destroy);
+  if (self->theme)
+    g_signal_handlers_disconnect_by_data (self->theme, self);
+  g_clear_object (&self->theme);
+
+  G_OBJECT_CLASS (ms_icon_cache_parent_class)->finalize (object);
+}
+
+
+static void
+ms_icon_cache_class_init (MsIconCacheClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = ms_icon_cache_finalize;
+}
+
+
+static void
+ms_icon_cache_init (MsIconCache *self)
+{
+  self->entries = g_hash_table_new_full (entry_hash, entry_equal, entry_free, NULL);
+  g_queue_init (&self->lru);
+}
+
+
+MsIconCache *
+ms_icon_cache_new (void)
+{
+  return MS_ICON_CACHE (g_object_new (MS_TYPE_ICON_CACHE, NULL));
+}
+
+/**
+ * ms_icon_cache_lookup:
+ * @self: The icon cache
+ * @icon: The icon to look up
+ * @size: The icon size in logical pixels
+ * @scale: The scale factor
+ *
+ * Looks up a paintable for the given icon. The paintable might not
+ * have the icon loaded yet in which case it shows a placeholder and
+ * gets updated once the icon is available.
+ *
+ * Returns:(transfer full): The icon's paintable
+ */
+GdkPaintable *
+ms_icon_cache_lookup (MsIconCache *self, GIcon *icon, int size, int scale)
+{
+  MsIconCacheEntry probe = { .icon = icon, .size = size, .scale = scale };
+  MsIconCacheEntry *entry;
+  g_autoptr (GtkIconPaintable) placeholder = NULL;
+
+  g_return_val_if_fail (MS_IS_ICON_CACHE (self), NULL);
+  g_return_val_if_fail (G_IS_ICON (icon), NULL);
+
+  if (self->theme == NULL) {
+    self->theme = g_object_ref (gtk_icon_theme_get_for_display (gdk_display_get_default ()));
+    g_signal_connect_swapped (self->theme, "changed", G_CALLBACK (on_icon_theme_changed), self);
+  }
+
+  entry = g_hash_table_lookup (self->entries, &probe);
+  if (entry) {
+    /* Most recently used go to the tail */
+    g_queue_unlink (&self->lru, &entry->link);
+    g_queue_push_tail_link (&self->lru, &entry->link);
+    return g_object_ref (GDK_PAINTABLE (entry->paintable));
+  }
+
+  entry = g_new0 (MsIconCacheEntry, 1);
+  entry->icon = g_object_ref (icon);
+  entry->size = size;
+  entry->scale = scale;
+  entry->link.data = entry;
+  entry->paintable = g_object_new (MS_TYPE_ICON_PAINTABLE, NULL);
+  entry->paintable->size = size;
+
+  placeholder = gtk_icon_theme_lookup_icon (self->theme, PLACEHOLDER_ICON, NULL,
+                                            size, scale, GTK_TEXT_DIR_NONE, 0);
+  ms_icon_paintable_set_paintable (entry->paintable, GDK_PAINTABLE (placeholder));
+
+  g_hash_table_add (self->entries, entry);
+  g_queue_push_tail_link (&self->lru, &entry->link);
+  load_entry (self, entry);
+  /* The new entry is the most recently used one so it's kept */
+  evict_entries (self);
+
+  return g_object_ref (GDK_PAINTABLE (entry->paintable));
+}
+
+/**
+ * ms_icon_cache_new_image:
+ * @self: The icon cache
+ * @icon: The icon to look up
+ * @size: The icon size in logical pixels
+ * @scale: The scale factor
+ *
+ * Convenience wrapper around ms_icon_cache_lookup() that returns
+ * a `GtkImage` showing the icon.
+ *
+ * Returns:(transfer floating): The image
+ */
+GtkWidget *
+ms_icon_cache_new_image (MsIconCache *self, GIcon *icon, int size, int scale)
+{
+  g_autoptr (GdkPaintable) paintable = ms_icon_cache_lookup (self, icon, size, scale);
+
+  return gtk_image_new_from_paintable (paintable);
+}
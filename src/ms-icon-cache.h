@@ -0,0 +1,21 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define MS_TYPE_ICON_CACHE (ms_icon_cache_get_type ())
+
+G_DECLARE_FINAL_TYPE (MsIconCache, ms_icon_cache, MS, ICON_CACHE, GObject)
+
+MsIconCache  *ms_icon_cache_new (void);
+GdkPaintable *ms_icon_cache_lookup (MsIconCache *self, GIcon *icon, int size, int scale);
+GtkWidget    *ms_icon_cache_new_image (MsIconCache *self, GIcon *icon, int size, int scale);
+
+G_END_DECLS
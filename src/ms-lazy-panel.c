@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ms-lazy-panel"
+
+#include "mobile-settings-config.h"
+
+#include "ms-lazy-panel.h"
+#include "ms-profile.h"
+
+/**
+ * MsLazyPanel:
+ *
+ * A placeholder for a panel in the main window's stack. The actual
+ * panel of type `panel-type` is only constructed once
+ * ms_lazy_panel_ensure_panel() is invoked which happens when the
+ * page becomes visible for the first time. This keeps panels that
+ * are never looked at from adding to startup time.
+ */
+
+enum {
+  PROP_0,
+  PROP_PANEL_TYPE,
+  PROP_PANEL,
+  PROP_LAST_PROP
+};
+static GParamSpec *props[PROP_LAST_PROP];
+
+struct _MsLazyPanel {
+  AdwBin     parent;
+
+  GType      panel_type;
+  GtkWidget *panel;
+};
+G_DEFINE_TYPE (MsLazyPanel, ms_lazy_panel, ADW_TYPE_BIN)
+
+
+static void
+ms_lazy_panel_set_property (GObject      *object,
+                            guint         property_id,
+                            const GValue *value,
+                            GParamSpec   *pspec)
+{
+  MsLazyPanel *self = MS_LAZY_PANEL (object);
+
+  switch (property_id) {
+  case PROP_PANEL_TYPE:
+    self->panel_type = g_value_get_gtype (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+ms_lazy_panel_get_property (GObject    *object,
+                            guint       property_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
+{
+  MsLazyPanel *self = MS_LAZY_PANEL (object);
+
+  switch (property_id) {
+  case PROP_PANEL_TYPE:
+    g_value_set_gtype (value, self->panel_type);
+    break;
+  case PROP_PANEL:
+    g_value_set_object (value, self->panel);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+ms_lazy_panel_class_init (MsLazyPanelClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->get_property = ms_lazy_panel_get_property;
+  object_class->set_property = ms_lazy_panel_set_property;
+
+  /**
+   * MsLazyPanel:panel-type:
+   *
+   * The type of the panel to construct on demand
+   */
+  props[PROP_PANEL_TYPE] =
+    g_param_spec_gtype ("panel-type", "", "",
+                        GTK_TYPE_WIDGET,
+                        G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  /**
+   * MsLazyPanel:panel:
+   *
+   * The constructed panel or %NULL if it wasn't constructed yet
+   */
+  props[PROP_PANEL] =
+    g_param_spec_object ("panel", "", "",
+                         GTK_TYPE_WIDGET,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
+}
+
+
+static void
+ms_lazy_panel_init (MsLazyPanel *self)
+{
+  self->panel_type = G_TYPE_INVALID;
+}
+
+
+MsLazyPanel *
+ms_lazy_panel_new (GType panel_type)
+{
+  return MS_LAZY_PANEL (g_object_new (MS_TYPE_LAZY_PANEL, "panel-type", panel_type, NULL));
+}
+
+
+GType
+ms_lazy_panel_get_panel_type (MsLazyPanel *self)
+{
+  g_return_val_if_fail (MS_IS_LAZY_PANEL (self), G_TYPE_INVALID);
+
+  return self->panel_type;
+}
+
+/**
+ * ms_lazy_panel_get_panel:
+ * @self: The lazy panel
+ *
+ * Get the panel if it was already constructed.
+ *
+ * Returns:(transfer none)(nullable): The panel
+ */
+GtkWidget *
+ms_lazy_panel_get_panel (MsLazyPanel *self)
+{
+  g_return_val_if_fail (MS_IS_LAZY_PANEL (self), NULL);
+
+  return self->panel;
+}
+
+/**
+ * ms_lazy_panel_ensure_panel:
+ * @self: The lazy panel
+ *
+ * Constructs the panel unless that already happened.
+ *
+ * Returns:(transfer none): The panel
+ */
+GtkWidget *
+ms_lazy_panel_ensure_panel (MsLazyPanel *self)
+{
+  gint64 begin;
+
+  g_return_val_if_fail (MS_IS_LAZY_PANEL (self), NULL);
+
+  if (self->panel)
+    return self->panel;
+
+  g_return_val_if_fail (g_type_is_a (self->panel_type, GTK_TYPE_WIDGET), NULL);
+
+  g_debug ("Constructing %s", g_type_name (self->panel_type));
+  begin = ms_profile_begin ();
+  self->panel = g_object_new (self->panel_type, NULL);
+  ms_profile_end (begin, "panel", g_type_name (self->panel_type));
+  adw_bin_set_child (ADW_BIN (self), self->panel);
+
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_PANEL]);
+
+  return self->panel;
+}
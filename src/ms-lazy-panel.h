@@ -0,0 +1,22 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <adwaita.h>
+
+G_BEGIN_DECLS
+
+#define MS_TYPE_LAZY_PANEL (ms_lazy_panel_get_type ())
+
+G_DECLARE_FINAL_TYPE (MsLazyPanel, ms_lazy_panel, MS, LAZY_PANEL, AdwBin)
+
+MsLazyPanel *ms_lazy_panel_new (GType panel_type);
+GType        ms_lazy_panel_get_panel_type (MsLazyPanel *self);
+GtkWidget   *ms_lazy_panel_get_panel (MsLazyPanel *self);
+GtkWidget   *ms_lazy_panel_ensure_panel (MsLazyPanel *self);
+
+G_END_DECLS
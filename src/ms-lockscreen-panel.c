@@ -10,6 +10,8 @@
 
 #include "mobile-settings-config.h"
 #include "ms-lockscreen-panel.h"
+#include "ms-lockscreen-plugin-index.h"
+#include "ms-plugin-loader.h"
 #include "ms-plugin-row.h"
 
 #include <gio/gdesktopappinfo.h>
@@ -24,9 +26,6 @@
 #define LOCKSCREEN_PLUGINS_SCHEMA_ID "sm.puri.phosh.plugins"
 #define LOCKSCREEN_PLUGINS_KEY "lock-screen"
 
-#define PLUGIN_PREFIX ""
-#define PLUGIN_SUFFIX ".plugin"
-
 struct _MsLockscreenPanel {
   AdwBin      parent;
 
@@ -40,54 +39,79 @@ struct _MsLockscreenPanel {
   MsPluginRow *selected_row;
 
   GSimpleActionGroup *action_group;
+  GCancellable       *cancel;
+  GPtrArray          *plugin_infos;
 };
 
 G_DEFINE_TYPE (MsLockscreenPanel, ms_lockscreen_panel, ADW_TYPE_BIN)
 
 
 static AdwPreferencesWindow *
-load_prefs_window (const char *name)
+load_prefs_window (MsLockscreenPluginInfo *info)
 {
   GIOExtensionPoint *ep;
   GIOExtension *ext;
   GType type;
 
+  if (!ms_plugin_loader_load_module (info->prefs_plugin))
+    return NULL;
+
   ep = g_io_extension_point_lookup (PHOSH_PLUGIN_EXTENSION_POINT_LOCKSCREEN_WIDGET_PREFS);
   g_return_val_if_fail (ep, NULL);
 
-  ext = g_io_extension_point_get_extension_by_name (ep, name);
+  ext = g_io_extension_point_get_extension_by_name (ep, info->prefs_id);
+  if (ext == NULL) {
+    g_warning ("Prefs module %s doesn't provide %s", info->prefs_plugin, info->prefs_id);
+    return NULL;
+  }
 
-  g_debug ("Loading plugin %s", name);
+  g_debug ("Loading plugin %s", info->prefs_id);
   type = g_io_extension_get_type (ext);
   return g_object_new (type, NULL);
 }
 
 
+static MsLockscreenPluginInfo *
+lookup_plugin_info (MsLockscreenPanel *self, const char *filename)
+{
+  if (self->plugin_infos == NULL)
+    return NULL;
+
+  for (guint i = 0; i < self->plugin_infos->len; i++) {
+    MsLockscreenPluginInfo *info = g_ptr_array_index (self->plugin_infos, i);
+
+    if (g_strcmp0 (info->filename, filename) == 0)
+      return info;
+  }
+
+  return NULL;
+}
+
+
 static void
 open_plugin_prefs_activated (GSimpleAction *action, GVariant *parameter, gpointer data)
 {
+  MsLockscreenPanel *self = MS_LOCKSCREEN_PANEL (data);
+  MsLockscreenPluginInfo *info;
   AdwPreferencesWindow *prefs;
   GtkWindow*parent;
-  g_autoptr (GError) error = NULL;
-  g_autoptr (GKeyFile) keyfile = g_key_file_new ();
-  g_autofree char *name = NULL;
   const char *filename;
 
   g_variant_get (parameter, "&s", &filename);
   g_assert (filename);
   g_debug ("Prefs for'%s' activated", filename);
 
-  if (g_key_file_load_from_file (keyfile, filename, G_KEY_FILE_NONE, &error) == FALSE) {
-    g_warning ("Failed to load prefs plugin info '%s': %s", filename, error->message);
+  info = lookup_plugin_info (self, filename);
+  if (info == NULL || info->prefs_id == NULL || info->prefs_plugin == NULL) {
+    g_warning ("No prefs plugin info for '%s'", filename);
     return;
   }
 
-  name = g_key_file_get_string (keyfile, "Prefs", "Id", NULL);
   parent = gtk_application_get_active_window (
     GTK_APPLICATION (g_application_get_default ()));
   g_assert (parent);
 
-  prefs = load_prefs_window (name);
+  prefs = load_prefs_window (info);
   g_return_if_fail (prefs);
 
   gtk_window_set_transient_for (GTK_WINDOW (prefs), parent);
@@ -233,69 +257,37 @@ sort_plugins_store (MsLockscreenPanel *self)
 
 
 static void
-ms_lockscreen_panel_scan_phosh_lockscreen_plugins (MsLockscreenPanel *self)
+on_plugins_loaded (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
+  MsLockscreenPanel *self;
   g_autoptr (GError) err = NULL;
-  g_autoptr (GDir) dir = g_dir_open (MOBILE_SETTINGS_PHOSH_PLUGINS_DIR, 0, &err);
-  const char *filename;
+  g_autoptr (GPtrArray) infos = NULL;
   g_auto (GStrv) enabled_plugins = NULL;
 
-
-  if (dir == NULL) {
-    g_warning ("Failed to read phosh plugins from " MOBILE_SETTINGS_PHOSH_PLUGINS_DIR ": %s",
-               err->message);
+  infos = ms_lockscreen_plugin_index_load_finish (res, &err);
+  if (infos == NULL) {
+    if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning ("Failed to read phosh plugins from " MOBILE_SETTINGS_PHOSH_PLUGINS_DIR ": %s",
+                 err->message);
     return;
   }
 
+  self = MS_LOCKSCREEN_PANEL (user_data);
   enabled_plugins = g_settings_get_strv (self->plugins_settings, LOCKSCREEN_PLUGINS_KEY);
-  while ((filename = g_dir_read_name (dir))) {
+  for (guint i = 0; i < infos->len; i++) {
+    MsLockscreenPluginInfo *info = g_ptr_array_index (infos, i);
     GtkWidget *row;
     gboolean enabled;
-    g_autofree char *name = NULL;
-    g_autofree char *title = NULL;
-    g_autofree char *description = NULL;
-    g_autofree char *path = NULL;
-    g_autofree char *plugin_path = NULL;
-    g_autofree char *prefs_path = NULL;
-    g_autoptr (GError) error = NULL;
-    g_autoptr (GKeyFile) keyfile = g_key_file_new ();
-
-    if (!g_str_has_prefix (filename, PLUGIN_PREFIX) || !g_str_has_suffix (filename, PLUGIN_SUFFIX))
-      continue;
-
-    path = g_build_filename (MOBILE_SETTINGS_PHOSH_PLUGINS_DIR, filename, NULL);
-    if (g_key_file_load_from_file (keyfile, path, G_KEY_FILE_NONE, &error) == FALSE) {
-      g_warning ("Failed to load plugin info '%s': %s", filename, error->message);
-      continue;
-    }
-
-    name = g_key_file_get_string (keyfile, "Plugin", "Id", NULL);
-    if (name == NULL)
-      continue;
-
-    plugin_path = g_key_file_get_string (keyfile, "Plugin", "Plugin", NULL);
-    if (plugin_path == NULL)
-      continue;
 
-    if (g_file_test (plugin_path, G_FILE_TEST_EXISTS) == FALSE) {
-      g_warning ("Plugin at %s does not exist", plugin_path);
-      continue;
-    }
-
-    prefs_path = g_key_file_get_string (keyfile, "Prefs", "Plugin", NULL);
-
-    title = g_key_file_get_locale_string (keyfile, "Plugin", "Name", NULL, NULL);
-    description = g_key_file_get_locale_string (keyfile, "Plugin", "Comment", NULL, NULL);
-
-    enabled = g_strv_contains ((const gchar * const*)enabled_plugins, name);
-    g_debug ("Found plugin %s, name %s, enabled: %d, prefs: %d", filename, name, enabled, !!prefs_path);
+    enabled = g_strv_contains ((const gchar * const*)enabled_plugins, info->id);
+    g_debug ("Adding plugin %s, enabled: %d", info->id, enabled);
     row = g_object_new (MS_TYPE_PLUGIN_ROW,
-                        "plugin-name", name,
-                        "title", title,
-                        "subtitle", description,
+                        "plugin-name", info->id,
+                        "title", info->title,
+                        "subtitle", info->description,
                         "enabled", enabled,
-                        "has-prefs", !!prefs_path,
-                        "filename", path,
+                        "has-prefs", info->prefs_id && info->prefs_plugin,
+                        "filename", info->filename,
                         NULL);
     g_signal_connect_object (row,
                              "notify::enabled",
@@ -310,8 +302,24 @@ ms_lockscreen_panel_scan_phosh_lockscreen_plugins (MsLockscreenPanel *self)
                              G_CONNECT_SWAPPED);
   }
   sort_plugins_store (self);
+
+  /* Used to load the prefs plugins on demand */
+  self->plugin_infos = g_steal_pointer (&infos);
+}
+
+
+static void
+ms_lockscreen_panel_dispose (GObject *object)
+{
+  MsLockscreenPanel *self = MS_LOCKSCREEN_PANEL (object);
+
+  g_cancellable_cancel (self->cancel);
+  g_clear_object (&self->cancel);
+
+  G_OBJECT_CLASS (ms_lockscreen_panel_parent_class)->dispose (object);
 }
 
+
 static void
 ms_lockscreen_panel_finalize (GObject *object)
 {
@@ -321,6 +329,7 @@ ms_lockscreen_panel_finalize (GObject *object)
   g_clear_object (&self->plugins_settings);
   g_clear_object (&self->plugins_store);
   g_clear_object (&self->action_group);
+  g_clear_pointer (&self->plugin_infos, g_ptr_array_unref);
 
   G_OBJECT_CLASS (ms_lockscreen_panel_parent_class)->finalize (object);
 }
@@ -332,6 +341,7 @@ ms_lockscreen_panel_class_init (MsLockscreenPanelClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
+  object_class->dispose = ms_lockscreen_panel_dispose;
   object_class->finalize = ms_lockscreen_panel_finalize;
 
   gtk_widget_class_set_template_from_resource (widget_class,
@@ -349,9 +359,6 @@ static GActionEntry entries[] =
 static void
 ms_lockscreen_panel_init (MsLockscreenPanel *self)
 {
-  /* Scan prefs plugins */
-  g_io_modules_scan_all_in_directory (MOBILE_SETTINGS_PHOSH_PREFS_DIR);
-
   gtk_widget_init_template (GTK_WIDGET (self));
 
   self->settings = g_settings_new (LOCKSCREEN_SCHEMA_ID);
@@ -367,7 +374,9 @@ ms_lockscreen_panel_init (MsLockscreenPanel *self)
                            G_LIST_MODEL (self->plugins_store),
                            create_plugins_row,
                            self, NULL);
-  ms_lockscreen_panel_scan_phosh_lockscreen_plugins (self);
+
+  self->cancel = g_cancellable_new ();
+  ms_lockscreen_plugin_index_load_async (self->cancel, on_plugins_loaded, self);
 
   self->action_group = g_simple_action_group_new ();
   g_action_map_add_action_entries (G_ACTION_MAP (self->action_group),
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ms-lockscreen-plugin-index"
+
+#include "mobile-settings-config.h"
+
+#include "ms-lockscreen-plugin-index.h"
+#include "ms-util.h"
+
+/**
+ * MsLockscreenPluginIndex:
+ *
+ * Discovers phosh's lock screen plugins by parsing their `.plugin`
+ * files in a thread. The parsed metadata is cached in
+ * `$XDG_CACHE_HOME` together with the mtimes of the plugin directory
+ * and the directories holding the plugin modules. As long as none of
+ * these changed the cache is used instead of parsing the key files
+ * and checking for the modules again.
+ */
+
+#define INDEX_NAME "lockscreen-plugins.gvariant"
+#define INDEX_VERSION 1
+#define INDEX_STAMP_TYPE "(sx)"
+#define INDEX_PLUGIN_TYPE "(ssssss)"
+#define INDEX_TYPE "(usa" INDEX_STAMP_TYPE "a" INDEX_PLUGIN_TYPE ")"
+
+#define PLUGIN_SUFFIX ".plugin"
+
+
+void
+ms_lockscreen_plugin_info_free (MsLockscreenPluginInfo *info)
+{
+  g_return_if_fail (info);
+
+  g_free (info->id);
+  g_free (info->title);
+  g_free (info->description);
+  g_free (info->filename);
+  g_free (info->prefs_id);
+  g_free (info->prefs_plugin);
+  g_free (info);
+}
+
+
+static GPtrArray *
+plugin_infos_new (void)
+{
+  return g_ptr_array_new_with_free_func ((GDestroyNotify) ms_lockscreen_plugin_info_free);
+}
+
+
+static gboolean
+index_is_valid (GVariant *index, const char *locale)
+{
+  g_autoptr (GVariant) stamps = NULL;
+  const char *index_locale, *path;
+  guint32 version;
+  gint64 mtime;
+  GVariantIter iter;
+
+  g_variant_get_child (index, 0, "u", &version);
+  if (version != INDEX_VERSION) {
+    g_debug ("Plugin index version %u, expected %u", version, INDEX_VERSION);
+    return FALSE;
+  }
+
+  /* Names and descriptions are localized */
+  g_variant_get_child (index, 1, "&s", &index_locale);
+  if (g_strcmp0 (index_locale, locale)) {
+    g_debug ("Plugin index locale '%s' does not match '%s'", index_locale, locale);
+    return FALSE;
+  }
+
+  stamps = g_variant_get_child_value (index, 2);
+  g_variant_iter_init (&iter, stamps);
+  while (g_variant_iter_next (&iter, "(&sx)", &path, &mtime)) {
+    if (ms_get_mtime (path) != mtime) {
+      g_debug ("%s changed, rescanning plugins", path);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+
+static GPtrArray *
+plugin_infos_from_index (GVariant *index)
+{
+  g_autoptr (GVariant) plugins = g_variant_get_child_value (index, 3);
+  GPtrArray *infos = plugin_infos_new ();
+  const char *id, *title, *description, *filename, *prefs_id, *prefs_plugin;
+  GVariantIter iter;
+
+  g_variant_iter_init (&iter, plugins);
+  while (g_variant_iter_next (&iter, "(&s&s&s&s&s&s)",
+                              &id, &title, &description, &filename, &prefs_id, &prefs_plugin)) {
+    MsLockscreenPluginInfo *info = g_new0 (MsLockscreenPluginInfo, 1);
+
+    info->id = g_strdup (id);
+    info->title = g_strdup (title);
+    info->description = g_strdup (description);
+    info->filename = g_strdup (filename);
+    info->prefs_id = STR_IS_NULL_OR_EMPTY (prefs_id) ? NULL : g_strdup (prefs_id);
+    info->prefs_plugin = STR_IS_NULL_OR_EMPTY (prefs_plugin) ? NULL : g_strdup (prefs_plugin);
+    g_ptr_array_add (infos, info);
+  }
+
+  return infos;
+}
+
+
+/*
+ * Remember a directory's mtime before looking at its contents so
+ * changes made while scanning invalidate the saved index.
+ */
+static void
+stamp_dir (GHashTable *dirs, char *dir)
+{
+  gint64 *mtime;
+
+  if (g_hash_table_contains (dirs, dir)) {
+    g_free (dir);
+    return;
+  }
+
+  mtime = g_new (gint64, 1);
+  *mtime = ms_get_mtime (dir);
+  g_hash_table_insert (dirs, dir, mtime);
+}
+
+
+static void
+save_index (GPtrArray *infos, GHashTable *dirs, const char *locale)
+{
+  GVariantBuilder stamps, plugins;
+  GHashTableIter iter;
+  const char *dir;
+  gint64 *mtime;
+
+  g_variant_builder_init (&stamps, G_VARIANT_TYPE ("a" INDEX_STAMP_TYPE));
+  g_hash_table_iter_init (&iter, dirs);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&dir, (gpointer *)&mtime))
+    g_variant_builder_add (&stamps, INDEX_STAMP_TYPE, dir, *mtime);
+
+  g_variant_builder_init (&plugins, G_VARIANT_TYPE ("a" INDEX_PLUGIN_TYPE));
+  for (guint i = 0; i < infos->len; i++) {
+    MsLockscreenPluginInfo *info = g_ptr_array_index (infos, i);
+
+    g_variant_builder_add (&plugins, INDEX_PLUGIN_TYPE,
+                           info->id,
+                           info->title ?: "",
+                           info->description ?: "",
+                           info->filename,
+                           info->prefs_id ?: "",
+                           info->prefs_plugin ?: "");
+  }
+
+  ms_cache_save (INDEX_NAME, g_variant_new ("(us@a" INDEX_STAMP_TYPE "@a" INDEX_PLUGIN_TYPE ")",
+                                            INDEX_VERSION,
+                                            locale,
+                                            g_variant_builder_end (&stamps),
+                                            g_variant_builder_end (&plugins)));
+}
+
+
+static MsLockscreenPluginInfo *
+parse_plugin_file (const char *path, GHashTable *dirs)
+{
+  g_autoptr (GError) error = NULL;
+  g_autoptr (GKeyFile) keyfile = g_key_file_new ();
+  g_autoptr (MsLockscreenPluginInfo) info = NULL;
+  g_autofree char *plugin_path = NULL;
+
+  if (g_key_file_load_from_file (keyfile, path, G_KEY_FILE_NONE, &error) == FALSE) {
+    g_warning ("Failed to load plugin info '%s': %s", path, error->message);
+    return NULL;
+  }
+
+  info = g_new0 (MsLockscreenPluginInfo, 1);
+  info->id = g_key_file_get_string (keyfile, "Plugin", "Id", NULL);
+  if (info->id == NULL)
+    return NULL;
+
+  plugin_path = g_key_file_get_string (keyfile, "Plugin", "Plugin", NULL);
+  if (plugin_path == NULL)
+    return NULL;
+
+  /* Track the module's dir too so we notice it going away */
+  stamp_dir (dirs, g_path_get_dirname (plugin_path));
+  if (g_file_test (plugin_path, G_FILE_TEST_EXISTS) == FALSE) {
+    g_warning ("Plugin at %s does not exist", plugin_path);
+    return NULL;
+  }
+
+  info->title = g_key_file_get_locale_string (keyfile, "Plugin", "Name", NULL, NULL);
+  info->description = g_key_file_get_locale_string (keyfile, "Plugin", "Comment", NULL, NULL);
+  info->filename = g_strdup (path);
+  info->prefs_id = g_key_file_get_string (keyfile, "Prefs", "Id", NULL);
+  info->prefs_plugin = g_key_file_get_string (keyfile, "Prefs", "Plugin", NULL);
+
+  return g_steal_pointer (&info);
+}
+
+
+static GPtrArray *
+scan_plugins (GHashTable *dirs, GCancellable *cancellable, GError **error)
+{
+  g_autoptr (GPtrArray) infos = plugin_infos_new ();
+  g_autoptr (GDir) dir = NULL;
+  const char *filename;
+
+  stamp_dir (dirs, g_strdup (MOBILE_SETTINGS_PHOSH_PLUGINS_DIR));
+  dir = g_dir_open (MOBILE_SETTINGS_PHOSH_PLUGINS_DIR, 0, error);
+  if (dir == NULL)
+    return NULL;
+  while ((filename = g_dir_read_name (dir))) {
+    g_autofree char *path = NULL;
+    MsLockscreenPluginInfo *info;
+
+    if (g_cancellable_set_error_if_cancelled (cancellable, error))
+      return NULL;
+
+    if (!g_str_has_suffix (filename, PLUGIN_SUFFIX))
+      continue;
+
+    path = g_build_filename (MOBILE_SETTINGS_PHOSH_PLUGINS_DIR, filename, NULL);
+    info = parse_plugin_file (path, dirs);
+    if (info == NULL)
+      continue;
+
+    g_debug ("Found plugin %s, name %s, prefs: %d", filename, info->id, !!info->prefs_plugin);
+    g_ptr_array_add (infos, info);
+  }
+
+  return g_steal_pointer (&infos);
+}
+
+
+static void
+load_plugins_thread (GTask        *task,
+                     gpointer      source_object,
+                     gpointer      task_data,
+                     GCancellable *cancellable)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GVariant) index = NULL;
+  g_autoptr (GHashTable) dirs = NULL;
+  GPtrArray *infos;
+  const char *locale = g_get_language_names ()[0];
+
+  index = ms_cache_load (INDEX_NAME, G_VARIANT_TYPE (INDEX_TYPE));
+  if (index && index_is_valid (index, locale)) {
+    g_task_return_pointer (task, plugin_infos_from_index (index), (GDestroyNotify) g_ptr_array_unref);
+    return;
+  }
+
+  /* dir -> mtime at the time it got scanned */
+  dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  infos = scan_plugins (dirs, cancellable, &err);
+  if (infos == NULL) {
+    g_task_return_error (task, g_steal_pointer (&err));
+    return;
+  }
+
+  g_debug ("Updating plugin index");
+  save_index (infos, dirs, locale);
+
+  g_task_return_pointer (task, infos, (GDestroyNotify) g_ptr_array_unref);
+}
+
+/**
+ * ms_lockscreen_plugin_index_load_async:
+ * @cancellable: A cancellable
+ * @callback: The callback to invoke when done
+ * @user_data: User data for the callback
+ *
+ * Asynchronously looks up the available lock screen plugins.
+ */
+void
+ms_lockscreen_plugin_index_load_async (GCancellable        *cancellable,
+                                       GAsyncReadyCallback  callback,
+                                       gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, ms_lockscreen_plugin_index_load_async);
+  g_task_run_in_thread (task, load_plugins_thread);
+}
+
+/**
+ * ms_lockscreen_plugin_index_load_finish:
+ * @res: The async result
+ * @error: The error
+ *
+ * Finishes an operation started with ms_lockscreen_plugin_index_load_async ().
+ *
+ * Returns:(transfer full)(element-type MsLockscreenPluginInfo): The plugins
+ */
+GPtrArray *
+ms_lockscreen_plugin_index_load_finish (GAsyncResult *res, GError **error)
+{
+  g_return_val_if_fail (g_task_is_valid (res, NULL), NULL);
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
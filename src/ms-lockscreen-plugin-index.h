@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/**
+ * MsLockscreenPluginInfo:
+ * @id: The plugin's id
+ * @title: The plugin's (localized) name
+ * @description: The plugin's (localized) description
+ * @filename: The path of the `.plugin` file
+ * @prefs_id:(nullable): The id of the plugin's preferences
+ * @prefs_plugin:(nullable): The path to the plugin's preferences module
+ *
+ * Metadata of a lock screen plugin as parsed from its `.plugin` file.
+ */
+typedef struct {
+  char *id;
+  char *title;
+  char *description;
+  char *filename;
+  char *prefs_id;
+  char *prefs_plugin;
+} MsLockscreenPluginInfo;
+
+void       ms_lockscreen_plugin_info_free          (MsLockscreenPluginInfo *info);
+
+void       ms_lockscreen_plugin_index_load_async   (GCancellable        *cancellable,
+                                                    GAsyncReadyCallback  callback,
+                                                    gpointer             user_data);
+GPtrArray *ms_lockscreen_plugin_index_load_finish  (GAsyncResult        *res,
+                                                    GError             **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (MsLockscreenPluginInfo, ms_lockscreen_plugin_info_free)
+
+G_END_DECLS
@@ -59,6 +59,11 @@ struct _MsOskPanel {
   GtkWidget        *shortcuts_box;
   GListStore       *shortcuts;
   gboolean          shortcuts_updating;
+
+  /* OSK detection */
+  guint             osk_watch_id;
+  GCancellable     *osk_cancel;
+  gboolean          is_osk_stub;
 };
 
 G_DEFINE_TYPE (MsOskPanel, ms_osk_panel, ADW_TYPE_BIN)
@@ -223,54 +228,145 @@ on_completion_switch_activate_changed (MsOskPanel *self, GParamSpec *spec, GtkWi
 }
 
 
-static gboolean
-is_osk_stub (void)
+static void
+setup_osk_stub_settings (MsOskPanel *self)
 {
-  g_autoptr (GError) error = NULL;
-  g_autoptr (GDBusProxy) proxy = NULL;
+  if (self->pos_settings)
+    return;
+
+  self->pos_settings = g_settings_new (PHOSH_OSK_SETTINGS);
+  self->mode = g_settings_get_flags (self->pos_settings, WORD_COMPLETION_KEY);
+  g_signal_connect_swapped (self->pos_settings, "changed::" WORD_COMPLETION_KEY,
+                            G_CALLBACK (on_word_completion_key_changed),
+                            self);
+  on_word_completion_key_changed (self);
+
+  self->shortcuts = g_list_store_new (GTK_TYPE_STRING_OBJECT);
+  gtk_flow_box_bind_model (GTK_FLOW_BOX (self->shortcuts_box),
+                           G_LIST_MODEL (self->shortcuts),
+                           create_shortcuts_row,
+                           self,
+                           NULL);
+
+  self->pos_terminal_settings = g_settings_new (PHOSH_OSK_TERMINAL_SETTINGS);
+  g_signal_connect_swapped (self->pos_terminal_settings, "changed::" SHORTCUTS_KEY,
+                            G_CALLBACK (on_terminal_shortcuts_changed),
+                            self);
+  on_terminal_shortcuts_changed (self);
+}
+
+
+static void
+set_is_osk_stub (MsOskPanel *self, gboolean is_osk_stub)
+{
+  if (self->is_osk_stub == is_osk_stub)
+    return;
+
+  self->is_osk_stub = is_osk_stub;
+  g_debug ("OSK is %sphosh-osk-stub", is_osk_stub ? "" : "not ");
+
+  /* Only bother with the stub's settings once we've seen the stub */
+  if (is_osk_stub)
+    setup_osk_stub_settings (self);
+
+  gtk_widget_set_visible (self->completion_group, is_osk_stub);
+  gtk_widget_set_visible (self->terminal_layout_group, is_osk_stub);
+}
+
+
+static void
+on_osk_pid_ready (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  MsOskPanel *self;
+  g_autoptr (GError) err = NULL;
   g_autoptr (GVariant) ret = NULL;
   g_autofree char *proc_path = NULL;
   g_autofree char *exe = NULL;
   guint32 pid;
 
-  proxy =  g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
-                                          G_DBUS_PROXY_FLAGS_NONE,
-                                          NULL,
-                                          "org.freedesktop.DBus",
-                                          "/org/freesktop/DBus",
-                                          "org.freedesktop.DBus",
-                                          NULL,
-                                          &error);
-  if (proxy == NULL) {
-    g_warning ("Failed to query dbus: %s", error->message);
-    return FALSE;
-  }
+  ret = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source_object), res, &err);
+  if (ret == NULL) {
+    if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      return;
 
-  ret = g_dbus_proxy_call_sync (proxy,
-                                "GetConnectionUnixProcessID",
-                                g_variant_new ("(s)", PHOSH_OSK_DBUS_NAME),
-                                G_DBUS_CALL_FLAGS_NONE,
-                                1000,
-                                NULL,
-                                &error);
-  if (proxy == NULL || ret == NULL) {
-    g_warning ("Failed to query osk pid: %s", error->message);
-    return FALSE;
+    g_warning ("Failed to query osk pid: %s", err->message);
+    self = MS_OSK_PANEL (user_data);
+    set_is_osk_stub (self, FALSE);
+    return;
   }
 
+  self = MS_OSK_PANEL (user_data);
+  g_clear_object (&self->osk_cancel);
+
   g_variant_get (ret, "(u)", &pid);
-  proc_path = g_strdup_printf ("/proc/%d/exe", pid);
+  proc_path = g_strdup_printf ("/proc/%u/exe", pid);
 
-  exe = g_file_read_link (proc_path, &error);
+  exe = g_file_read_link (proc_path, &err);
   if (exe == NULL) {
-    g_warning ("Failed to query osk exe: %s", error->message);
-    return FALSE;
+    g_warning ("Failed to query osk exe: %s", err->message);
+    set_is_osk_stub (self, FALSE);
+    return;
   }
 
-  if (g_str_has_suffix (exe, "/phosh-osk-stub"))
-    return TRUE;
+  set_is_osk_stub (self, g_str_has_suffix (exe, "/phosh-osk-stub"));
+}
+
 
-  return FALSE;
+static void
+on_osk_name_appeared (GDBusConnection *connection,
+                      const char      *name,
+                      const char      *name_owner,
+                      gpointer         user_data)
+{
+  MsOskPanel *self = MS_OSK_PANEL (user_data);
+
+  g_debug ("%s appeared, owned by %s", name, name_owner);
+
+  g_cancellable_cancel (self->osk_cancel);
+  g_clear_object (&self->osk_cancel);
+  self->osk_cancel = g_cancellable_new ();
+
+  /* Use the unique name so we look at the process that just showed up */
+  g_dbus_connection_call (connection,
+                          "org.freedesktop.DBus",
+                          "/org/freedesktop/DBus",
+                          "org.freedesktop.DBus",
+                          "GetConnectionUnixProcessID",
+                          g_variant_new ("(s)", name_owner),
+                          G_VARIANT_TYPE ("(u)"),
+                          G_DBUS_CALL_FLAGS_NONE,
+                          -1,
+                          self->osk_cancel,
+                          on_osk_pid_ready,
+                          self);
+}
+
+
+static void
+on_osk_name_vanished (GDBusConnection *connection,
+                      const char      *name,
+                      gpointer         user_data)
+{
+  MsOskPanel *self = MS_OSK_PANEL (user_data);
+
+  g_debug ("%s vanished", name);
+
+  g_cancellable_cancel (self->osk_cancel);
+  g_clear_object (&self->osk_cancel);
+  set_is_osk_stub (self, FALSE);
+}
+
+
+static void
+ms_osk_panel_dispose (GObject *object)
+{
+  MsOskPanel *self = MS_OSK_PANEL (object);
+
+  g_clear_handle_id (&self->osk_watch_id, g_bus_unwatch_name);
+  g_cancellable_cancel (self->osk_cancel);
+  g_clear_object (&self->osk_cancel);
+
+  G_OBJECT_CLASS (ms_osk_panel_parent_class)->dispose (object);
 }
 
 
@@ -295,6 +391,7 @@ ms_osk_panel_class_init (MsOskPanelClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
+  object_class->dispose = ms_osk_panel_dispose;
   object_class->finalize = ms_osk_panel_finalize;
 
   gtk_widget_class_set_template_from_resource (widget_class,
@@ -374,30 +471,14 @@ ms_osk_panel_init (MsOskPanel *self)
                                 self,
                                 NULL);
 
-  if (is_osk_stub ()) {
-    gtk_widget_set_visible (self->completion_group, TRUE);
-
-    self->pos_settings = g_settings_new (PHOSH_OSK_SETTINGS);
-    self->mode = g_settings_get_flags (self->pos_settings, WORD_COMPLETION_KEY);
-    g_signal_connect_swapped (self->pos_settings, "changed::" WORD_COMPLETION_KEY,
-                              G_CALLBACK (on_word_completion_key_changed),
-                              self);
-    on_word_completion_key_changed (self);
-
-    gtk_widget_set_visible (self->terminal_layout_group, TRUE);
-    self->shortcuts = g_list_store_new (GTK_TYPE_STRING_OBJECT);
-    gtk_flow_box_bind_model (GTK_FLOW_BOX (self->shortcuts_box),
-                             G_LIST_MODEL (self->shortcuts),
-                             create_shortcuts_row,
-                             self,
-                             NULL);
-
-    self->pos_terminal_settings = g_settings_new (PHOSH_OSK_TERMINAL_SETTINGS);
-    g_signal_connect_swapped (self->pos_terminal_settings, "changed::" SHORTCUTS_KEY,
-                              G_CALLBACK (on_terminal_shortcuts_changed),
-                              self);
-    on_terminal_shortcuts_changed (self);
-  }
+  /* The stub specific groups are shown once we know phosh-osk-stub is running */
+  self->osk_watch_id = g_bus_watch_name (G_BUS_TYPE_SESSION,
+                                         PHOSH_OSK_DBUS_NAME,
+                                         G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                         on_osk_name_appeared,
+                                         on_osk_name_vanished,
+                                         self,
+                                         NULL);
 }
 
 
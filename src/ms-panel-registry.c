@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ms-panel-registry"
+
+#include "mobile-settings-config.h"
+
+#include "ms-applications-panel.h"
+#include "ms-compositor-panel.h"
+#include "ms-convergence-panel.h"
+#include "ms-features-panel.h"
+#include "ms-feedback-panel.h"
+#include "ms-lockscreen-panel.h"
+#include "ms-osk-panel.h"
+#include "ms-panel-registry.h"
+#include "ms-sensor-panel.h"
+
+#include <glib/gi18n.h>
+
+/**
+ * MsPanelRegistry:
+ *
+ * The list of panels built into mobile settings in the order they
+ * appear in the panel switcher. The main window and the panel switcher
+ * are built from this and command line handling can look up panels
+ * without constructing any widgets.
+ */
+
+static const MsPanelInfo panels[] = {
+  {
+    .name = "welcome",
+    .title = N_("Welcome"),
+    .icon_name = "starred-symbolic",
+    .get_type = NULL,
+    .keywords = NULL,
+  },
+  {
+    .name = "applications",
+    .title = N_("Applications"),
+    .icon_name = "applications-symbolic",
+    .get_type = ms_applications_panel_get_type,
+    /* Translators: Search terms, must end with a semicolon */
+    .keywords = N_("Favorites;Apps;"),
+  },
+  {
+    .name = "feedback",
+    .title = N_("Feedback"),
+    .icon_name = "feedback-quiet-symbolic",
+    .get_type = ms_feedback_panel_get_type,
+    /* Translators: Search terms, must end with a semicolon */
+    .keywords = N_("Sound;Vibration;Haptic;LED;Notifications;"),
+  },
+  {
+    .name = "compositor",
+    .title = N_("Compositor"),
+    .icon_name = "phone-docked-symbolic",
+    .get_type = ms_compositor_panel_get_type,
+    /* Translators: Search terms, must end with a semicolon */
+    .keywords = N_("Scaling;Scale to fit;Running apps;"),
+  },
+  {
+    .name = "lockscreen",
+    .title = N_("Lockscreen"),
+    .icon_name = "padlock-symbolic",
+    .get_type = ms_lockscreen_panel_get_type,
+    /* Translators: Search terms, must end with a semicolon */
+    .keywords = N_("Lock screen;Plugins;Keypad;"),
+  },
+  {
+    .name = "convergence",
+    .title = N_("Convergence"),
+    .icon_name = "phonelink2-symbolic",
+    .get_type = ms_convergence_panel_get_type,
+    /* Translators: Search terms, must end with a semicolon */
+    .keywords = N_("Dock;Monitor;Display;Touch screen;"),
+  },
+  {
+    .name = "osk",
+    .title = N_("On Screen Keyboard"),
+    .icon_name = "input-keyboard-symbolic",
+    .get_type = ms_osk_panel_get_type,
+    /* Translators: Search terms, must end with a semicolon */
+    .keywords = N_("OSK;Keyboard;Completion;Terminal;"),
+  },
+  {
+    .name = "sensors",
+    .title = N_("Sensors"),
+    .icon_name = "computer-chip-symbolic",
+    .get_type = ms_sensor_panel_get_type,
+    /* Translators: Search terms, must end with a semicolon */
+    .keywords = N_("Proximity;Ambient light;Accelerometer;High contrast;"),
+  },
+  {
+    .name = "features",
+    .title = N_("Experimental features"),
+    .icon_name = "applications-science-symbolic",
+    .get_type = ms_features_panel_get_type,
+    /* Translators: Search terms, must end with a semicolon */
+    .keywords = N_("Emergency calls;Suspend;"),
+  },
+};
+
+/**
+ * ms_panel_registry_get_panels:
+ * @n_panels:(out): The number of panels
+ *
+ * Get information about all the built in panels.
+ *
+ * Returns:(transfer none): The panels
+ */
+const MsPanelInfo *
+ms_panel_registry_get_panels (guint *n_panels)
+{
+  g_assert (n_panels);
+
+  *n_panels = G_N_ELEMENTS (panels);
+  return panels;
+}
+
+/**
+ * ms_panel_registry_lookup:
+ * @name: The panel name
+ *
+ * Look up a built in panel by its name.
+ *
+ * Returns:(transfer none)(nullable): The panel info or %NULL if
+ *   there's no such panel.
+ */
+const MsPanelInfo *
+ms_panel_registry_lookup (const char *name)
+{
+  g_return_val_if_fail (name, NULL);
+
+  for (guint i = 0; i < G_N_ELEMENTS (panels); i++) {
+    if (g_strcmp0 (panels[i].name, name) == 0)
+      return &panels[i];
+  }
+
+  return NULL;
+}
+
+/**
+ * ms_panel_info_get_keywords:
+ * @info: The panel info
+ *
+ * Get the translated search terms of a panel.
+ *
+ * Returns:(transfer full): The keywords
+ */
+GStrv
+ms_panel_info_get_keywords (const MsPanelInfo *info)
+{
+  g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+  g_auto (GStrv) keywords = NULL;
+
+  g_return_val_if_fail (info, NULL);
+
+  if (info->keywords == NULL)
+    return g_strv_builder_end (builder);
+
+  keywords = g_strsplit (_(info->keywords), ";", -1);
+  for (int i = 0; keywords[i]; i++) {
+    if (keywords[i][0] != '\0')
+      g_strv_builder_add (builder, keywords[i]);
+  }
+
+  return g_strv_builder_end (builder);
+}
+
+
+static void
+append_json_string (GString *str, const char *value)
+{
+  g_string_append_c (str, '"');
+  for (const char *c = value; *c; c++) {
+    switch (*c) {
+    case '"':
+      g_string_append (str, "\\\"");
+      break;
+    case '\\':
+      g_string_append (str, "\\\\");
+      break;
+    case '\n':
+      g_string_append (str, "\\n");
+      break;
+    case '\t':
+      g_string_append (str, "\\t");
+      break;
+    default:
+      if ((guchar)*c < 0x20)
+        g_string_append_printf (str, "\\u%04x", (guint)*c);
+      else
+        g_string_append_c (str, *c);
+    }
+  }
+  g_string_append_c (str, '"');
+}
+
+/**
+ * ms_panel_registry_to_json:
+ *
+ * Serializes the panel information as JSON so it can be consumed by
+ * scripts.
+ *
+ * Returns:(transfer full): The JSON representation of the registered panels
+ */
+char *
+ms_panel_registry_to_json (void)
+{
+  GString *str = g_string_new ("[\n");
+
+  for (guint i = 0; i < G_N_ELEMENTS (panels); i++) {
+    const MsPanelInfo *info = &panels[i];
+    g_auto (GStrv) keywords = ms_panel_info_get_keywords (info);
+
+    g_string_append (str, "  {\n    \"name\": ");
+    append_json_string (str, info->name);
+    g_string_append (str, ",\n    \"title\": ");
+    append_json_string (str, _(info->title));
+    g_string_append (str, ",\n    \"icon-name\": ");
+    append_json_string (str, info->icon_name);
+    g_string_append (str, ",\n    \"keywords\": [");
+    for (int j = 0; keywords[j]; j++) {
+      if (j)
+        g_string_append (str, ", ");
+      append_json_string (str, keywords[j]);
+    }
+    g_string_append_printf (str, "]\n  }%s\n", i + 1 < G_N_ELEMENTS (panels) ? "," : "");
+  }
+  g_string_append (str, "]\n");
+
+  return g_string_free (str, FALSE);
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* The panel provided by a device plugin, only known at runtime */
+#define MS_PANEL_NAME_DEVICE "device"
+
+/**
+ * MsPanelInfo:
+ * @name: The panel's name as used on the command line and in `set-panel`
+ * @title: The (untranslated) title shown in the panel switcher
+ * @icon_name: The icon shown in the panel switcher
+ * @get_type: Function returning the panel's type. %NULL for panels that are
+ *   part of the main window's template.
+ * @keywords: Semicolon separated, untranslated search terms
+ *
+ * Static information about a panel. Looking at this doesn't require
+ * any widgets (or even GTK) to be set up.
+ */
+typedef struct {
+  const char *name;
+  const char *title;
+  const char *icon_name;
+  GType     (*get_type) (void);
+  const char *keywords;
+} MsPanelInfo;
+
+const MsPanelInfo *ms_panel_registry_get_panels (guint *n_panels);
+const MsPanelInfo *ms_panel_registry_lookup (const char *name);
+GStrv              ms_panel_info_get_keywords (const MsPanelInfo *info);
+char              *ms_panel_registry_to_json (void);
+
+G_END_DECLS
@@ -11,10 +11,48 @@
 #include "mobile-settings-config.h"
 
 #include "ms-plugin-loader.h"
+#include "ms-profile.h"
 
 #include <gio/gio.h>
 #include <gtk/gtk.h>
 
+#define GMOBILE_USE_UNSTABLE_API
+#include <gmobile.h>
+
+/**
+ * MsPluginLoader:
+ *
+ * Loads plugins for an extension point. Plugins ship a small manifest
+ * next to their module:
+ *
+ * ```
+ * [Plugin]
+ * Id=device-panel-librem5
+ * ExtensionPoint=ms-device-panel
+ * Module=libms-plugin-librem5.so
+ * Priority=10
+ * Compatibles=purism,librem5;
+ * ```
+ *
+ * This allows to pick the plugin matching the running device
+ * without loading any modules. Only the module of the plugin that
+ * is actually used gets loaded. Modules no manifest refers to are
+ * loaded as before.
+ */
+
+#define MANIFEST_SUFFIX ".plugin"
+#define MANIFEST_GROUP "Plugin"
+
+typedef struct {
+  char   *id;
+  char   *module;
+  int     priority;
+  GStrv   compatibles;
+  gint64  load_time;
+  gint64  init_time;
+} MsPluginManifest;
+
+
 enum {
   PROP_0,
   PROP_PLUGIN_DIRS,
@@ -26,12 +64,164 @@ static GParamSpec *props[PROP_LAST_PROP];
 struct _MsPluginLoader {
   GObject parent;
 
-  GStrv   plugin_dirs;
-  char   *extension_point;
+  GStrv      plugin_dirs;
+  char      *extension_point;
+  /* Manifests matching the device, highest priority first */
+  GPtrArray *manifests;
 };
 
 G_DEFINE_TYPE (MsPluginLoader, ms_plugin_loader, G_TYPE_OBJECT)
 
+
+static void
+ms_plugin_manifest_free (MsPluginManifest *manifest)
+{
+  g_free (manifest->id);
+  g_free (manifest->module);
+  g_strfreev (manifest->compatibles);
+  g_free (manifest);
+}
+
+
+static gint
+compare_manifest_priority (gconstpointer a, gconstpointer b)
+{
+  const MsPluginManifest *manifest_a = *((MsPluginManifest **) a);
+  const MsPluginManifest *manifest_b = *((MsPluginManifest **) b);
+
+  return manifest_b->priority - manifest_a->priority;
+}
+
+
+static gboolean
+manifest_matches_device (MsPluginManifest *manifest, const char * const *compatibles)
+{
+  const char *assume_device = g_getenv ("MOBILE_SETTINGS_ASSUME_DEVICE");
+
+  /* No compatibles means the plugin works everywhere */
+  if (manifest->compatibles == NULL || manifest->compatibles[0] == NULL)
+    return TRUE;
+
+  /* Allow to override detected device for debugging */
+  if (assume_device && g_strv_contains ((const char * const *)manifest->compatibles, assume_device))
+    return TRUE;
+
+  for (int i = 0; compatibles && compatibles[i]; i++) {
+    if (g_strv_contains ((const char * const *)manifest->compatibles, compatibles[i]))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+
+/* Adds the manifest's module to `claimed`, whatever extension point it's for */
+static MsPluginManifest *
+load_manifest (MsPluginLoader *self, const char *dir, const char *filename, GHashTable *claimed)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GKeyFile) keyfile = g_key_file_new ();
+  g_autofree char *path = g_build_filename (dir, filename, NULL);
+  g_autofree char *extension_point = NULL;
+  g_autofree char *module = NULL;
+  MsPluginManifest *manifest;
+
+  if (!g_key_file_load_from_file (keyfile, path, G_KEY_FILE_NONE, &err)) {
+    g_warning ("Failed to load plugin manifest '%s': %s", path, err->message);
+    return NULL;
+  }
+
+  module = g_key_file_get_string (keyfile, MANIFEST_GROUP, "Module", NULL);
+  if (module == NULL) {
+    g_warning ("Plugin manifest '%s' lacks a module", path);
+    return NULL;
+  }
+  if (!g_path_is_absolute (module)) {
+    char *module_path = g_build_filename (dir, module, NULL);
+
+    g_free (module);
+    module = module_path;
+  }
+  g_hash_table_add (claimed, g_strdup (module));
+
+  extension_point = g_key_file_get_string (keyfile, MANIFEST_GROUP, "ExtensionPoint", NULL);
+  if (g_strcmp0 (extension_point, self->extension_point))
+    return NULL;
+
+  manifest = g_new0 (MsPluginManifest, 1);
+  manifest->id = g_key_file_get_string (keyfile, MANIFEST_GROUP, "Id", NULL);
+  manifest->module = g_steal_pointer (&module);
+  manifest->priority = g_key_file_get_integer (keyfile, MANIFEST_GROUP, "Priority", NULL);
+  manifest->compatibles = g_key_file_get_string_list (keyfile, MANIFEST_GROUP, "Compatibles",
+                                                      NULL, NULL);
+  if (manifest->id == NULL) {
+    g_warning ("Plugin manifest '%s' lacks an id", path);
+    ms_plugin_manifest_free (manifest);
+    return NULL;
+  }
+
+  return manifest;
+}
+
+/* Adds the modules the dir's manifests refer to to `claimed` */
+static void
+load_manifests (MsPluginLoader     *self,
+                const char         *plugin_dir,
+                const char * const *compatibles,
+                GHashTable         *claimed)
+{
+  g_autoptr (GDir) dir = g_dir_open (plugin_dir, 0, NULL);
+  const char *filename;
+
+  if (dir == NULL)
+    return;
+
+  while ((filename = g_dir_read_name (dir))) {
+    MsPluginManifest *manifest;
+
+    if (!g_str_has_suffix (filename, MANIFEST_SUFFIX))
+      continue;
+
+    manifest = load_manifest (self, plugin_dir, filename, claimed);
+    if (manifest == NULL)
+      continue;
+
+    if (!manifest_matches_device (manifest, compatibles)) {
+      g_debug ("Plugin %s doesn't match device", manifest->id);
+      ms_plugin_manifest_free (manifest);
+      continue;
+    }
+
+    g_debug ("Plugin %s (priority %d) matches device", manifest->id, manifest->priority);
+    g_ptr_array_add (self->manifests, manifest);
+  }
+}
+
+/* Loads the modules in the dir no manifest refers to, like g_io_modules_scan_all_in_directory () */
+static void
+load_unclaimed_modules (const char *plugin_dir, GHashTable *claimed)
+{
+  g_autoptr (GDir) dir = g_dir_open (plugin_dir, 0, NULL);
+  const char *filename;
+
+  if (dir == NULL)
+    return;
+
+  while ((filename = g_dir_read_name (dir))) {
+    g_autofree char *path = NULL;
+
+    if (!g_str_has_prefix (filename, "lib") || !g_str_has_suffix (filename, "." G_MODULE_SUFFIX))
+      continue;
+
+    path = g_build_filename (plugin_dir, filename, NULL);
+    if (g_hash_table_contains (claimed, path))
+      continue;
+
+    g_debug ("No plugin manifest for '%s', loading it", path);
+    ms_plugin_loader_load_module (path);
+  }
+}
+
 static void
 ms_plugin_loader_set_property (GObject      *object,
                                guint         property_id,
@@ -82,6 +272,8 @@ static void
 ms_plugin_loader_constructed (GObject *object)
 {
   MsPluginLoader *self = MS_PLUGIN_LOADER (object);
+  g_autoptr (GError) err = NULL;
+  g_auto (GStrv) compatibles = NULL;
   GIOExtensionPoint *ep;
 
   G_OBJECT_CLASS (ms_plugin_loader_parent_class)->constructed (object);
@@ -95,10 +287,24 @@ ms_plugin_loader_constructed (GObject *object)
   /* TODO: Make configurable */
   g_io_extension_point_set_required_type (ep, GTK_TYPE_WIDGET);
 
+  compatibles = gm_device_tree_get_compatibles (NULL, &err);
+  if (compatibles == NULL)
+    g_debug ("Couldn't get device tree information: %s", err->message);
+
   for (int i = 0; i < g_strv_length (self->plugin_dirs); i++) {
+    g_autoptr (GHashTable) claimed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
     g_debug ("Will load plugins from '%s' for '%s'", self->plugin_dirs[i], self->extension_point);
-    g_io_modules_scan_all_in_directory (self->plugin_dirs[i]);
+    load_manifests (self, self->plugin_dirs[i], (const char * const *)compatibles, claimed);
+
+    if (g_hash_table_size (claimed) == 0) {
+      g_debug ("No plugin manifests in '%s', loading all modules", self->plugin_dirs[i]);
+      g_io_modules_scan_all_in_directory (self->plugin_dirs[i]);
+    } else {
+      load_unclaimed_modules (self->plugin_dirs[i], claimed);
+    }
   }
+  g_ptr_array_sort (self->manifests, compare_manifest_priority);
 }
 
 
@@ -109,6 +315,7 @@ ms_plugin_loader_dispose (GObject *object)
 
   g_clear_pointer (&self->plugin_dirs, g_strfreev);
   g_clear_pointer (&self->extension_point, g_free);
+  g_clear_pointer (&self->manifests, g_ptr_array_unref);
 
   G_OBJECT_CLASS (ms_plugin_loader_parent_class)->dispose (object);
 }
@@ -151,6 +358,7 @@ ms_plugin_loader_class_init (MsPluginLoaderClass *klass)
 static void
 ms_plugin_loader_init (MsPluginLoader *self)
 {
+  self->manifests = g_ptr_array_new_with_free_func ((GDestroyNotify) ms_plugin_manifest_free);
 }
 
 
@@ -164,6 +372,72 @@ ms_plugin_loader_new (const char * const *plugin_dirs, const char *extension_poi
 }
 
 
+/**
+ * ms_plugin_loader_load_module:
+ * @path: The path to the module
+ *
+ * Loads the module at the given path unless already loaded. Modules
+ * stay loaded as the types they register can't go away.
+ *
+ * Returns: %TRUE if the module is loaded, otherwise %FALSE
+ */
+gboolean
+ms_plugin_loader_load_module (const char *path)
+{
+  static GHashTable *modules;
+  g_autoptr (GIOModule) module = NULL;
+
+  g_return_val_if_fail (path, FALSE);
+
+  if (modules == NULL)
+    modules = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+
+  if (g_hash_table_contains (modules, path))
+    return TRUE;
+
+  g_debug ("Loading module %s", path);
+  module = g_io_module_new (path);
+  if (!g_type_module_use (G_TYPE_MODULE (module))) {
+    g_warning ("Failed to load module %s", path);
+    return FALSE;
+  }
+
+  g_hash_table_insert (modules, g_strdup (path), g_steal_pointer (&module));
+  return TRUE;
+}
+
+
+static GtkWidget *
+load_plugin_from_manifest (MsPluginLoader *self, MsPluginManifest *manifest)
+{
+  GIOExtensionPoint *ep;
+  GIOExtension *extension;
+  GtkWidget *widget;
+  gint64 begin;
+
+  begin = ms_profile_begin ();
+  if (!ms_plugin_loader_load_module (manifest->module))
+    return NULL;
+  manifest->load_time = g_get_monotonic_time () - begin;
+  ms_profile_end (begin, "plugin-load", manifest->id);
+
+  ep = g_io_extension_point_lookup (self->extension_point);
+  extension = g_io_extension_point_get_extension_by_name (ep, manifest->id);
+  if (extension == NULL) {
+    g_warning ("Module %s doesn't provide %s", manifest->module, manifest->id);
+    return NULL;
+  }
+
+  g_debug ("Loading plugin %s", manifest->id);
+  begin = ms_profile_begin ();
+  widget = g_object_new (g_io_extension_get_type (extension), NULL);
+  manifest->init_time = g_get_monotonic_time () - begin;
+  ms_profile_end (begin, "plugin-init", manifest->id);
+
+  return widget;
+}
+
+
 GtkWidget *
 ms_plugin_loader_load_plugin (MsPluginLoader *self)
 {
@@ -174,6 +448,14 @@ ms_plugin_loader_load_plugin (MsPluginLoader *self)
 
   g_return_val_if_fail (MS_IS_PLUGIN_LOADER (self), NULL);
 
+  for (guint i = 0; i < self->manifests->len; i++) {
+    GtkWidget *widget = load_plugin_from_manifest (self, g_ptr_array_index (self->manifests, i));
+
+    if (widget)
+      return widget;
+  }
+
+  /* Plugins without a manifest */
   ep = g_io_extension_point_lookup (self->extension_point);
   extensions = g_io_extension_point_get_extensions (ep);
 
@@ -186,3 +468,34 @@ ms_plugin_loader_load_plugin (MsPluginLoader *self)
   type = g_io_extension_get_type (extensions->data);
   return g_object_new (type, NULL);
 }
+
+/**
+ * ms_plugin_loader_get_debug_info:
+ * @self: The plugin loader
+ *
+ * Get information about the plugins matching this device including
+ * the time it took to load and instantiate them.
+ *
+ * Returns:(transfer full): The plugin information
+ */
+char *
+ms_plugin_loader_get_debug_info (MsPluginLoader *self)
+{
+  GString *str = g_string_new (NULL);
+
+  g_return_val_if_fail (MS_IS_PLUGIN_LOADER (self), NULL);
+
+  for (guint i = 0; i < self->manifests->len; i++) {
+    MsPluginManifest *manifest = g_ptr_array_index (self->manifests, i);
+
+    g_string_append_printf (str, "- %s (priority %d)", manifest->id, manifest->priority);
+    if (manifest->load_time) {
+      g_string_append_printf (str, ": load %.3f ms, init %.3f ms",
+                              manifest->load_time / 1000.0,
+                              manifest->init_time / 1000.0);
+    }
+    g_string_append (str, "\n");
+  }
+
+  return g_string_free (str, FALSE);
+}
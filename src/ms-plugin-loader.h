@@ -19,5 +19,7 @@ G_DECLARE_FINAL_TYPE (MsPluginLoader, ms_plugin_loader, MS, PLUGIN_LOADER, GObje
 
 MsPluginLoader *ms_plugin_loader_new (const char * const * plugin_dirs, const char *extension_point);
 GtkWidget *ms_plugin_loader_load_plugin (MsPluginLoader *self);
+char      *ms_plugin_loader_get_debug_info (MsPluginLoader *self);
+gboolean   ms_plugin_loader_load_module (const char *path);
 
 G_END_DECLS
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ms-profile"
+
+#include "mobile-settings-config.h"
+
+#include "ms-profile.h"
+
+#ifdef HAVE_SYSPROF
+# include <sysprof-capture.h>
+#endif
+
+/**
+ * MsProfile:
+ *
+ * Timing marks for the phases of startup. Marks are always recorded
+ * so they can be included in the debug information. With `MS_PROFILE=1`
+ * they're also printed to stderr as they happen. When built with sysprof
+ * support they're emitted as sysprof marks as well.
+ */
+
+#define MS_PROFILE_ENV "MS_PROFILE"
+#define MS_PROFILE_SYSPROF_GROUP "phosh-mobile-settings"
+
+typedef struct {
+  char   *name;
+  char   *detail;
+  gint64  begin;   /* usec, relative to ms_profile_init () */
+  gint64  duration;
+} MsProfileMark;
+
+static struct {
+  gint64   start;
+  gboolean to_stderr;
+  GArray  *marks;
+} profile;
+
+
+static void
+clear_mark (gpointer data)
+{
+  MsProfileMark *mark = data;
+
+  g_free (mark->name);
+  g_free (mark->detail);
+}
+
+/**
+ * ms_profile_init:
+ *
+ * Initialize profiling. This should happen as early as possible
+ * as all marks are relative to this point in time.
+ */
+void
+ms_profile_init (void)
+{
+  g_return_if_fail (profile.marks == NULL);
+
+  profile.start = g_get_monotonic_time ();
+  profile.to_stderr = !!g_strcmp0 (g_getenv (MS_PROFILE_ENV) ?: "0", "0");
+  profile.marks = g_array_new (FALSE, TRUE, sizeof (MsProfileMark));
+  g_array_set_clear_func (profile.marks, clear_mark);
+}
+
+/**
+ * ms_profile_begin:
+ *
+ * Start a timing mark.
+ *
+ * Returns: The begin time to pass to `ms_profile_end`
+ */
+gint64
+ms_profile_begin (void)
+{
+  return g_get_monotonic_time ();
+}
+
+/**
+ * ms_profile_end:
+ * @begin: The begin time as returned by ms_profile_begin ()
+ * @name: The name of the phase
+ * @detail:(nullable): Additional information
+ *
+ * Ends a timing mark started with ms_profile_begin () and records it.
+ */
+void
+ms_profile_end (gint64 begin, const char *name, const char *detail)
+{
+  gint64 now = g_get_monotonic_time ();
+  MsProfileMark mark;
+
+  g_return_if_fail (name);
+
+  /* Not initialized, e.g. when used from a plugin test */
+  if (profile.marks == NULL)
+    return;
+
+  mark = (MsProfileMark) {
+    .name = g_strdup (name),
+    .detail = g_strdup (detail),
+    .begin = begin - profile.start,
+    .duration = now - begin,
+  };
+  g_array_append_val (profile.marks, mark);
+
+  if (profile.to_stderr) {
+    g_printerr ("MS_PROFILE: %8.3f ms (+%8.3f ms): %s%s%s\n",
+                mark.begin / 1000.0,
+                mark.duration / 1000.0,
+                name,
+                detail ? " " : "",
+                detail ?: "");
+  }
+
+#ifdef HAVE_SYSPROF
+  sysprof_collector_mark (begin * 1000, (now - begin) * 1000,
+                          MS_PROFILE_SYSPROF_GROUP, name, detail);
+#endif
+}
+
+
+static void
+on_after_paint (GdkFrameClock *frame_clock, GtkWidget *widget)
+{
+  ms_profile_end (profile.start, "first-frame", G_OBJECT_TYPE_NAME (widget));
+
+  g_signal_handlers_disconnect_by_func (frame_clock, on_after_paint, widget);
+}
+
+
+static void
+on_realize (GtkWidget *widget)
+{
+  GdkFrameClock *frame_clock = gtk_widget_get_frame_clock (widget);
+
+  g_signal_handlers_disconnect_by_func (widget, on_realize, NULL);
+
+  g_return_if_fail (GDK_IS_FRAME_CLOCK (frame_clock));
+  g_signal_connect_object (frame_clock, "after-paint", G_CALLBACK (on_after_paint), widget, 0);
+}
+
+/**
+ * ms_profile_track_first_frame:
+ * @widget: A toplevel widget
+ *
+ * Records the time from ms_profile_init () until the first
+ * frame of the given widget got painted.
+ */
+void
+ms_profile_track_first_frame (GtkWidget *widget)
+{
+  g_return_if_fail (GTK_IS_WIDGET (widget));
+
+  if (gtk_widget_get_realized (widget))
+    return;
+
+  g_signal_connect (widget, "realize", G_CALLBACK (on_realize), NULL);
+}
+
+/**
+ * ms_profile_get_report:
+ *
+ * Get the recorded timing marks in a human readable form.
+ *
+ * Returns:(transfer full): The timing marks
+ */
+char *
+ms_profile_get_report (void)
+{
+  GString *str = g_string_new (NULL);
+
+  if (profile.marks == NULL)
+    return g_string_free (str, FALSE);
+
+  for (guint i = 0; i < profile.marks->len; i++) {
+    MsProfileMark *mark = &g_array_index (profile.marks, MsProfileMark, i);
+
+    g_string_append_printf (str, "- %s%s%s: %.3f ms (at %.3f ms)\n",
+                            mark->name,
+                            mark->detail ? " " : "",
+                            mark->detail ?: "",
+                            mark->duration / 1000.0,
+                            mark->begin / 1000.0);
+  }
+
+  return g_string_free (str, FALSE);
+}
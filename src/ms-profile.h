@@ -0,0 +1,19 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+void    ms_profile_init (void);
+gint64  ms_profile_begin (void);
+void    ms_profile_end (gint64 begin, const char *name, const char *detail);
+void    ms_profile_track_first_frame (GtkWidget *widget);
+char   *ms_profile_get_report (void);
+
+G_END_DECLS
@@ -9,6 +9,7 @@
 #define G_LOG_DOMAIN "ms-scale_to_fit-row"
 
 #include "mobile-settings-config.h"
+#include "mobile-settings-application.h"
 #include "mobile-settings-enums.h"
 #include "ms-enum-types.h"
 #include "ms-util.h"
@@ -18,6 +19,8 @@
 #define APP_KEY_SCALE_TO_FIT "scale-to-fit"
 #define APP_SCHEMA "sm.puri.phoc.application"
 #define APP_PREFIX "/sm/puri/phoc/application/"
+/* Matches GTK_ICON_SIZE_LARGE */
+#define APP_ICON_SIZE 32
 
 
 enum {
@@ -35,6 +38,8 @@ struct _MsScaleToFitRow {
   GSettings   *settings;
   gboolean     scale_to_fit;
   GtkWidget   *scale_to_fit_switch;
+  GtkWidget   *icon;
+  GIcon       *gicon;
 };
 G_DEFINE_TYPE (MsScaleToFitRow, ms_scale_to_fit_row, ADW_TYPE_ACTION_ROW)
 
@@ -51,8 +56,7 @@ ms_scale_to_fit_row_set_property (GObject      *object,
     self->scale_to_fit = g_value_get_boolean (value);
     break;
   case PROP_APP_ID:
-    g_free (self->app_id);
-    self->app_id = g_value_dup_string (value);
+    ms_scale_to_fit_row_set_app_id (self, g_value_get_string (value));
     break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -84,64 +88,31 @@ ms_scale_to_fit_row_get_property (GObject    *object,
 
 
 static void
-ms_scale_to_fit_row_constructed (GObject *object)
+ms_scale_to_fit_row_finalize (GObject *object)
 {
   MsScaleToFitRow *self = MS_SCALE_TO_FIT_ROW (object);
-  g_autofree char *path = NULL;
-  g_autofree char *munged_id = NULL;
-  g_autoptr (GDesktopAppInfo) app_info = NULL;
-  g_autoptr (GIcon) icon = NULL;
-  GtkWidget *w;
-  const char *title = NULL;
-
-  G_OBJECT_CLASS (ms_scale_to_fit_row_parent_class)->constructed (object);
-
-  munged_id = ms_munge_app_id (self->app_id);
-  path = g_strconcat (APP_PREFIX, munged_id, "/", NULL);
-  g_debug ("Monitoring settings path: %s", path);
-  self->settings = g_settings_new_with_path (APP_SCHEMA, path);
-
-  g_settings_bind (self->settings, APP_KEY_SCALE_TO_FIT,
-                   self, "scale-to-fit",
-                   G_SETTINGS_BIND_DEFAULT);
-
-  app_info = ms_get_desktop_app_info_for_app_id (self->app_id);
-
-  if (app_info == NULL)
-    icon = g_themed_icon_new ("application-x-executable");
-
-  if (icon == NULL)
-    icon = g_app_info_get_icon (G_APP_INFO (app_info));
-
-  if (icon == NULL)
-    icon = g_themed_icon_new ("application-x-executable");
-  else
-    g_object_ref (icon);
-
-  w = gtk_image_new_from_gicon (icon);
-  gtk_widget_add_css_class (w, "lowres-icon");
-  gtk_image_set_icon_size (GTK_IMAGE (w), GTK_ICON_SIZE_LARGE);
-  adw_action_row_add_prefix (ADW_ACTION_ROW (self), w);
 
-  if (app_info)
-    title = g_app_info_get_name (G_APP_INFO (app_info));
-
-  if (title == NULL)
-    title = self->app_id;
+  g_clear_pointer (&self->app_id, g_ref_string_release);
+  g_clear_object (&self->settings);
+  g_clear_object (&self->gicon);
 
-  adw_preferences_row_set_title (ADW_PREFERENCES_ROW (self), title);
+  G_OBJECT_CLASS (ms_scale_to_fit_row_parent_class)->finalize (object);
 }
 
 
+/* Looks up the icon for the current scale so it stays sharp on other outputs */
 static void
-ms_scale_to_fit_row_finalize (GObject *object)
+update_icon (MsScaleToFitRow *self)
 {
-  MsScaleToFitRow *self = MS_SCALE_TO_FIT_ROW (object);
+  MobileSettingsApplication *app = MOBILE_SETTINGS_APPLICATION (g_application_get_default ());
+  g_autoptr (GdkPaintable) paintable = NULL;
 
-  g_clear_pointer (&self->app_id, g_free);
-  g_clear_object (&self->settings);
+  if (self->gicon == NULL)
+    return;
 
-  G_OBJECT_CLASS (ms_scale_to_fit_row_parent_class)->finalize (object);
+  paintable = ms_icon_cache_lookup (mobile_settings_application_get_icon_cache (app), self->gicon,
+                                    APP_ICON_SIZE, gtk_widget_get_scale_factor (GTK_WIDGET (self)));
+  gtk_image_set_from_paintable (GTK_IMAGE (self->icon), paintable);
 }
 
 
@@ -151,7 +122,6 @@ ms_scale_to_fit_row_class_init (MsScaleToFitRowClass *klass)
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
-  object_class->constructed = ms_scale_to_fit_row_constructed;
   object_class->finalize = ms_scale_to_fit_row_finalize;
   object_class->get_property = ms_scale_to_fit_row_get_property;
   object_class->set_property = ms_scale_to_fit_row_set_property;
@@ -164,7 +134,7 @@ ms_scale_to_fit_row_class_init (MsScaleToFitRowClass *klass)
   props[PROP_APP_ID] =
     g_param_spec_string ("app-id", "", "",
                          NULL,
-                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+                         G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
 
   g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
 
@@ -179,6 +149,12 @@ ms_scale_to_fit_row_init (MsScaleToFitRow *self)
 {
   gtk_widget_init_template (GTK_WIDGET (self));
 
+  self->icon = gtk_image_new ();
+  gtk_widget_add_css_class (self->icon, "lowres-icon");
+  gtk_image_set_icon_size (GTK_IMAGE (self->icon), GTK_ICON_SIZE_LARGE);
+  adw_action_row_add_prefix (ADW_ACTION_ROW (self), self->icon);
+  g_signal_connect (self, "notify::scale-factor", G_CALLBACK (update_icon), NULL);
+
   g_object_bind_property (self,
                           "scale-to-fit",
                           self->scale_to_fit_switch,
@@ -202,3 +178,84 @@ ms_scale_to_fit_row_get_app_id (MsScaleToFitRow *self)
 
   return self->app_id;
 }
+
+/**
+ * ms_scale_to_fit_row_set_app_id:
+ * @self: The row
+ * @app_id:(nullable): The app-id
+ *
+ * Sets the app the row configures. This allows to reuse a row for
+ * different apps, e.g. in a `GtkListView`.
+ */
+void
+ms_scale_to_fit_row_set_app_id (MsScaleToFitRow *self, const char *app_id)
+{
+  MobileSettingsApplication *app = MOBILE_SETTINGS_APPLICATION (g_application_get_default ());
+  MsAppSettingsPool *pool = mobile_settings_application_get_app_settings_pool (app);
+  g_autoptr (GRefString) munged_id = NULL;
+  g_autoptr (GDesktopAppInfo) app_info = NULL;
+  GIcon *icon = NULL;
+  const char *title = NULL;
+
+  g_return_if_fail (MS_IS_SCALE_TO_FIT_ROW (self));
+
+  if (g_strcmp0 (self->app_id, app_id) == 0)
+    return;
+
+  if (self->settings) {
+    g_settings_unbind (self, "scale-to-fit");
+    g_clear_object (&self->settings);
+  }
+
+  g_clear_pointer (&self->app_id, g_ref_string_release);
+  self->app_id = ms_app_id_intern (app_id);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_APP_ID]);
+
+  if (self->app_id == NULL)
+    return;
+
+  munged_id = ms_munged_app_id_intern (self->app_id);
+  self->settings = ms_app_settings_pool_get (pool, APP_SCHEMA, APP_PREFIX, munged_id);
+
+  g_settings_bind (self->settings, APP_KEY_SCALE_TO_FIT,
+                   self, "scale-to-fit",
+                   G_SETTINGS_BIND_DEFAULT);
+
+  app_info = ms_get_desktop_app_info_for_app_id (self->app_id);
+
+  if (app_info)
+    icon = g_app_info_get_icon (G_APP_INFO (app_info));
+
+  g_clear_object (&self->gicon);
+  if (icon == NULL)
+    self->gicon = g_themed_icon_new ("application-x-executable");
+  else
+    self->gicon = g_object_ref (icon);
+  update_icon (self);
+
+  if (app_info)
+    title = g_app_info_get_name (G_APP_INFO (app_info));
+
+  if (title == NULL)
+    title = self->app_id;
+
+  adw_preferences_row_set_title (ADW_PREFERENCES_ROW (self), title);
+}
+
+/**
+ * ms_scale_to_fit_row_reset:
+ * @self: The row
+ *
+ * Drops the app's scale-to-fit override so the compositor's
+ * default applies again.
+ */
+void
+ms_scale_to_fit_row_reset (MsScaleToFitRow *self)
+{
+  g_return_if_fail (MS_IS_SCALE_TO_FIT_ROW (self));
+
+  if (self->settings == NULL)
+    return;
+
+  g_settings_reset (self->settings, APP_KEY_SCALE_TO_FIT);
+}
@@ -16,5 +16,7 @@ G_DECLARE_FINAL_TYPE (MsScaleToFitRow, ms_scale_to_fit_row, MS, SCALE_TO_FIT_ROW
 
 MsScaleToFitRow *ms_scale_to_fit_row_new (const char *app_id);
 const char      *ms_scale_to_fit_row_get_app_id (MsScaleToFitRow *self);
+void             ms_scale_to_fit_row_set_app_id (MsScaleToFitRow *self, const char *app_id);
+void             ms_scale_to_fit_row_reset (MsScaleToFitRow *self);
 
 G_END_DECLS
@@ -59,8 +59,33 @@ ms_sound_row_get_theme_dir (void)
 }
 
 
+/*
+ * Changes to the custom sound theme that aren't on disk yet. These
+ * are shared by all rows so changes made in one go end up in a
+ * single commit.
+ */
+typedef struct {
+  /* effect name -> target path, NULL to remove the effect */
+  GHashTable *links;
+  char       *default_theme;
+} MsSoundThemeChanges;
+
+static MsSoundThemeChanges *pending_changes;
+static guint commit_id;
+static gboolean committing;
+
+
+static void
+ms_sound_theme_changes_free (MsSoundThemeChanges *changes)
+{
+  g_clear_pointer (&changes->links, g_hash_table_unref);
+  g_clear_pointer (&changes->default_theme, g_free);
+  g_free (changes);
+}
+
+
 static void
-ms_sound_row_update_dir_mtime (const char *dir_path)
+update_dir_mtime (const char *dir_path)
 {
   g_autoptr (GFile) dir = NULL;
   g_autoptr (GDateTime) now = NULL;
@@ -80,24 +105,18 @@ ms_sound_row_update_dir_mtime (const char *dir_path)
 }
 
 
-/* Update the sound theme if needed */
+/* Update the sound theme's index file if needed */
 static void
-ms_sound_row_set_custom_sound_theme (MsSoundRow *self)
+write_custom_sound_theme (const char *dir, const char *default_theme)
 {
-  g_autofree char *dir = NULL;
   g_autofree char *theme_path = NULL;
-  g_autofree char *sounds_path = NULL;
   g_autofree char *custom_theme_dir = NULL;
   g_autoptr (GKeyFile) theme_file = NULL;
-  g_autoptr (GVariant) default_theme = NULL;
   g_autoptr (GError) load_error = NULL;
   g_autoptr (GError) save_error = NULL;
 
-  dir = ms_sound_row_get_theme_dir ();
   theme_path = g_build_filename (dir, "index.theme", NULL);
 
-  default_theme = g_settings_get_default_value (self->sound_settings, "theme-name");
-
   theme_file = g_key_file_new ();
   if (!g_key_file_load_from_file (theme_file, theme_path, G_KEY_FILE_KEEP_COMMENTS, &load_error)) {
     if (!g_error_matches (load_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
@@ -108,7 +127,7 @@ ms_sound_row_set_custom_sound_theme (MsSoundRow *self)
   if (g_strcmp0 (custom_theme_dir, ".")) {
     g_key_file_set_string (theme_file, "Sound Theme", "Name", _("Custom"));
     if (default_theme != NULL)
-      g_key_file_set_string (theme_file, "Sound Theme", "Inherits", g_variant_get_string (default_theme, NULL));
+      g_key_file_set_string (theme_file, "Sound Theme", "Inherits", default_theme);
     g_key_file_set_string (theme_file, "Sound Theme", "Directories", ".");
 
     if (!g_key_file_save_to_file (theme_file, theme_path, &save_error))
@@ -116,40 +135,133 @@ ms_sound_row_set_custom_sound_theme (MsSoundRow *self)
   } else {
     g_debug ("Skipping theme write");
   }
-
-  /* Ensure canberra's event-sound-cache will get updated */
-  sounds_path = g_build_filename (g_get_user_data_dir (), "sounds", NULL);
-  ms_sound_row_update_dir_mtime (sounds_path);
-
-  g_settings_set_string (self->sound_settings, "theme-name", CUSTOM_SOUND_THEME_NAME);
 }
 
 
-static void
-ms_sound_row_set_symlink (MsSoundRow *self, const char *target_path)
+static gboolean
+write_symlink (const char *dir, const char *effect_name, const char *target_path)
 {
-  g_autofree char *dir = NULL;
   g_autofree char *link_filename = NULL;
   g_autofree char *link_name = NULL;
   g_autoptr (GFile) file = NULL;
   g_autoptr (GError) error = NULL;
 
-  dir = ms_sound_row_get_theme_dir ();
-  link_filename = g_strdup_printf ("%s.ogg", self->effect_name);
+  link_filename = g_strdup_printf ("%s.ogg", effect_name);
   link_name = g_build_filename (dir, link_filename, NULL);
 
   file = g_file_new_for_path (link_name);
   if (!g_file_delete (file, NULL, &error)) {
     if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
       g_warning ("Failed to remove existing sound symbolic link %s: %s", link_name, error->message);
+    g_clear_error (&error);
   }
 
-  if (target_path) {
-    g_mkdir_with_parents (dir, DIR_MODE);
-    if (!g_file_make_symbolic_link (file, target_path, NULL, &error))
-      g_warning ("Failed to make sound theme symbolic link %s->%s: %s", link_name, target_path, error->message);
+  if (target_path == NULL)
+    return FALSE;
+
+  g_mkdir_with_parents (dir, DIR_MODE);
+  if (!g_file_make_symbolic_link (file, target_path, NULL, &error))
+    g_warning ("Failed to make sound theme symbolic link %s->%s: %s", link_name, target_path, error->message);
+
+  return TRUE;
+}
+
+
+static void
+commit_changes_thread (GTask        *task,
+                       gpointer      source_object,
+                       gpointer      task_data,
+                       GCancellable *cancellable)
+{
+  MsSoundThemeChanges *changes = task_data;
+  g_autofree char *dir = ms_sound_row_get_theme_dir ();
+  g_autofree char *sounds_path = NULL;
+  gboolean uses_theme = FALSE;
+  GHashTableIter iter;
+  gpointer effect_name, target_path;
+
+  g_hash_table_iter_init (&iter, changes->links);
+  while (g_hash_table_iter_next (&iter, &effect_name, &target_path))
+    uses_theme |= write_symlink (dir, effect_name, target_path);
+
+  if (uses_theme)
+    write_custom_sound_theme (dir, changes->default_theme);
+
+  /* Ensure canberra's event-sound-cache will get updated */
+  sounds_path = g_build_filename (g_get_user_data_dir (), "sounds", NULL);
+  update_dir_mtime (sounds_path);
 
-    ms_sound_row_set_custom_sound_theme (self);
+  g_task_return_boolean (task, uses_theme);
+}
+
+
+static gboolean commit_pending_changes (gpointer unused);
+
+static void
+on_commit_changes_done (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr (GSettings) settings = NULL;
+  g_autofree char *theme_name = NULL;
+
+  committing = FALSE;
+
+  /* Changes came in while we were writing */
+  if (pending_changes && commit_id == 0)
+    commit_pending_changes (NULL);
+
+  if (!g_task_propagate_boolean (G_TASK (res), NULL))
+    return;
+
+  settings = g_settings_new (SOUND_KEY_SCHEMA);
+  theme_name = g_settings_get_string (settings, "theme-name");
+  if (g_strcmp0 (theme_name, CUSTOM_SOUND_THEME_NAME))
+    g_settings_set_string (settings, "theme-name", CUSTOM_SOUND_THEME_NAME);
+}
+
+
+static gboolean
+commit_pending_changes (gpointer unused)
+{
+  g_autoptr (GTask) task = NULL;
+
+  commit_id = 0;
+
+  /* Only one commit at a time so links are written in order */
+  if (committing)
+    return G_SOURCE_REMOVE;
+
+  committing = TRUE;
+  task = g_task_new (NULL, NULL, on_commit_changes_done, NULL);
+  g_task_set_source_tag (task, commit_pending_changes);
+  g_task_set_task_data (task, g_steal_pointer (&pending_changes),
+                        (GDestroyNotify) ms_sound_theme_changes_free);
+  g_task_run_in_thread (task, commit_changes_thread);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Queue the row's sound to be written to the custom sound theme. The
+ * actual disk writes happen in a thread once the main loop is idle.
+ */
+static void
+ms_sound_row_queue_commit (MsSoundRow *self)
+{
+  if (pending_changes == NULL) {
+    g_autoptr (GVariant) default_theme = NULL;
+
+    pending_changes = g_new0 (MsSoundThemeChanges, 1);
+    pending_changes->links = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    default_theme = g_settings_get_default_value (self->sound_settings, "theme-name");
+    if (default_theme)
+      pending_changes->default_theme = g_variant_dup_string (default_theme, NULL);
+  }
+
+  g_hash_table_insert (pending_changes->links, g_strdup (self->effect_name), g_strdup (self->filename));
+
+  if (commit_id == 0) {
+    commit_id = g_idle_add (commit_pending_changes, NULL);
+    g_source_set_name_by_id (commit_id, "[ms] commit sound theme");
   }
 }
 
@@ -272,6 +384,25 @@ open_filechooser_activated (GtkWidget *widget,  const char* action_name, GVarian
 }
 
 
+static gboolean
+set_filename (MsSoundRow *self, const char *filename)
+{
+  if (g_strcmp0 (self->filename, filename) == 0)
+      return FALSE;
+
+  g_free (self->filename);
+  self->filename = g_strdup (filename);
+
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "sound-row.clear-filename",
+                                 !STR_IS_NULL_OR_EMPTY (self->filename));
+  gtk_widget_action_set_enabled (GTK_WIDGET (self), "sound-row.play-sound",
+                                 !STR_IS_NULL_OR_EMPTY (self->filename));
+
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_FILENAME]);
+  return TRUE;
+}
+
+/* Only loads the current state, the theme on disk is left alone */
 static void
 set_effect_name (MsSoundRow *self, const char *effect_name)
 {
@@ -279,7 +410,7 @@ set_effect_name (MsSoundRow *self, const char *effect_name)
 
   self->effect_name = g_strdup (effect_name);
   target = ms_sound_row_get_target (self);
-  ms_sound_row_set_filename (self, target);
+  set_filename (self, target);
 }
 
 
@@ -401,24 +532,27 @@ ms_sound_row_new (void)
 }
 
 
+/**
+ * ms_sound_row_set_filename:
+ * @self: The sound row
+ * @filename:(nullable): The sound file to use for the row's effect
+ *
+ * Sets the sound file for the row's effect and queues the change to
+ * be written to the custom sound theme.
+ */
 void
 ms_sound_row_set_filename (MsSoundRow *self, const char *filename)
 {
   g_return_if_fail (MS_IS_SOUND_ROW (self));
 
-  if (g_strcmp0 (self->filename, filename) == 0)
-      return;
-
-  g_free (self->filename);
-  self->filename = g_strdup (filename);
+  if (!set_filename (self, filename))
+    return;
 
-  gtk_widget_action_set_enabled (GTK_WIDGET (self), "sound-row.clear-filename",
-                                 !STR_IS_NULL_OR_EMPTY (self->filename));
-  gtk_widget_action_set_enabled (GTK_WIDGET (self), "sound-row.play-sound",
-                                 !STR_IS_NULL_OR_EMPTY (self->filename));
   gtk_widget_activate_action (GTK_WIDGET (self), "sound-player.stop", NULL, NULL);
 
-  ms_sound_row_set_symlink (self, self->filename);
+  /* Nothing to apply to as long as we're being constructed */
+  if (self->effect_name == NULL)
+    return;
 
-  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_FILENAME]);
+  ms_sound_row_queue_commit (self);
 }
@@ -10,13 +10,36 @@
 
 #include "mobile-settings-config.h"
 
+#include "ms-enum-types.h"
 #include "ms-toplevel-tracker.h"
+#include "ms-util.h"
+#include "ms-wayland-stats.h"
 
 #include "protocols/wlr-foreign-toplevel-management-unstable-v1-client-protocol.h"
 
+/**
+ * MsToplevelTracker:
+ *
+ * Tracks the compositor's toplevels via wlr-foreign-toplevel-management.
+ *
+ * The tracker is a `GListModel` of `MsRunningApp`s sorted by app-id
+ * with one item per app-id that has at least one toplevel. A hash
+ * table indexes the items by app-id.
+ *
+ * A toplevel's title, app-id, state and outputs are staged until the
+ * compositor sends `done` and are then committed atomically. Apps affected by
+ * commits are collected and the model is updated once per dispatch
+ * so e.g. a session restoring dozens of windows results in a single
+ * `items-changed` emission.
+ *
+ * App-ids are interned (see ms_app_id_intern()) so toplevels, apps
+ * and rows share a single copy per app.
+ */
+
 enum {
   PROP_0,
   PROP_FOREIGN_TOPLEVEL_MANAGER,
+  PROP_ACTIVATED_APP,
   PROP_LAST_PROP
 };
 static GParamSpec *props[PROP_LAST_PROP];
@@ -33,9 +56,19 @@ static guint signals[N_SIGNALS];
 typedef struct {
   char *app_id;
   char *title;
+  /* Staged until the next done event, %NULL if unchanged */
+  char *pending_app_id;
+  char *pending_title;
+
+  MsToplevelState state;
+  MsToplevelState pending_state;
+  /* The (unowned) wl_outputs the toplevel is on */
+  GPtrArray      *outputs;
+  GPtrArray      *pending_outputs;
 
   struct zwlr_foreign_toplevel_handle_v1 *handle;
   MsToplevelTracker *tracker;
+  MsRunningApp      *app;
 } MsToplevel;
 
 
@@ -43,12 +76,536 @@ struct _MsToplevelTracker {
   GObject               parent;
 
   GHashTable           *toplevels;
-  GHashTable           *app_ids;
+  /* The running apps sorted by app-id and indexed by app-id */
+  GPtrArray            *apps;
+  GHashTable           *apps_by_id;
+  /* Apps affected by commits since the last model update */
+  GHashTable           *dirty_apps;
+  guint                 flush_id;
+  MsRunningApp         *activated_app;
+
+  MsWaylandStats       *stats;
 
   struct zwlr_foreign_toplevel_manager_v1 *foreign_toplevel_manager;
+  gboolean              stopped;
 };
 
-G_DEFINE_TYPE (MsToplevelTracker, ms_toplevel_tracker, G_TYPE_OBJECT)
+static void ms_toplevel_tracker_list_model_iface_init (GListModelInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (MsToplevelTracker, ms_toplevel_tracker, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL,
+                                                ms_toplevel_tracker_list_model_iface_init))
+
+
+enum {
+  APP_PROP_0,
+  APP_PROP_APP_ID,
+  APP_PROP_N_TOPLEVELS,
+  APP_PROP_TITLES,
+  APP_PROP_STATE,
+  APP_PROP_OUTPUTS,
+  APP_PROP_LAST_PROP
+};
+static GParamSpec *app_props[APP_PROP_LAST_PROP];
+
+/**
+ * MsRunningApp:
+ *
+ * An app-id with running toplevels.
+ */
+struct _MsRunningApp {
+  GObject    parent;
+
+  char      *app_id;
+  /* The app's toplevels, owned by the tracker */
+  GPtrArray *toplevels;
+  /* Whether the app is currently part of the tracker's list model */
+  gboolean   in_model;
+};
+
+G_DEFINE_TYPE (MsRunningApp, ms_running_app, G_TYPE_OBJECT)
+
+
+static void
+ms_running_app_set_property (GObject      *object,
+                             guint         property_id,
+                             const GValue *value,
+                             GParamSpec   *pspec)
+{
+  MsRunningApp *self = MS_RUNNING_APP (object);
+
+  switch (property_id) {
+  case APP_PROP_APP_ID:
+    self->app_id = ms_app_id_intern (g_value_get_string (value));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+ms_running_app_get_property (GObject    *object,
+                             guint       property_id,
+                             GValue     *value,
+                             GParamSpec *pspec)
+{
+  MsRunningApp *self = MS_RUNNING_APP (object);
+
+  switch (property_id) {
+  case APP_PROP_APP_ID:
+    g_value_set_string (value, self->app_id);
+    break;
+  case APP_PROP_N_TOPLEVELS:
+    g_value_set_uint (value, self->toplevels->len);
+    break;
+  case APP_PROP_TITLES:
+    g_value_take_boxed (value, ms_running_app_get_titles (self));
+    break;
+  case APP_PROP_STATE:
+    g_value_set_flags (value, ms_running_app_get_state (self));
+    break;
+  case APP_PROP_OUTPUTS:
+    g_value_take_boxed (value, ms_running_app_get_outputs (self));
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+ms_running_app_finalize (GObject *object)
+{
+  MsRunningApp *self = MS_RUNNING_APP (object);
+
+  g_clear_pointer (&self->app_id, g_ref_string_release);
+  g_clear_pointer (&self->toplevels, g_ptr_array_unref);
+
+  G_OBJECT_CLASS (ms_running_app_parent_class)->finalize (object);
+}
+
+
+static void
+ms_running_app_class_init (MsRunningAppClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->get_property = ms_running_app_get_property;
+  object_class->set_property = ms_running_app_set_property;
+  object_class->finalize = ms_running_app_finalize;
+
+  app_props[APP_PROP_APP_ID] =
+    g_param_spec_string ("app-id", "", "",
+                         NULL,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  /**
+   * MsRunningApp:n-toplevels:
+   *
+   * The number of toplevels with this app-id
+   */
+  app_props[APP_PROP_N_TOPLEVELS] =
+    g_param_spec_uint ("n-toplevels", "", "",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  /**
+   * MsRunningApp:titles:
+   *
+   * The titles of the toplevels with this app-id
+   */
+  app_props[APP_PROP_TITLES] =
+    g_param_spec_boxed ("titles", "", "",
+                        G_TYPE_STRV,
+                        G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  /**
+   * MsRunningApp:state:
+   *
+   * The combined state of the toplevels with this app-id. E.g. if one
+   * of them is activated the app is considered activated.
+   */
+  app_props[APP_PROP_STATE] =
+    g_param_spec_flags ("state", "", "",
+                        MS_TYPE_TOPLEVEL_STATE,
+                        MS_TOPLEVEL_STATE_NONE,
+                        G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  /**
+   * MsRunningApp:outputs:
+   *
+   * The `wl_output`s the toplevels with this app-id are on
+   */
+  app_props[APP_PROP_OUTPUTS] =
+    g_param_spec_boxed ("outputs", "", "",
+                        G_TYPE_PTR_ARRAY,
+                        G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, APP_PROP_LAST_PROP, app_props);
+}
+
+
+static void
+ms_running_app_init (MsRunningApp *self)
+{
+  self->toplevels = g_ptr_array_new ();
+}
+
+
+const char *
+ms_running_app_get_app_id (MsRunningApp *self)
+{
+  g_return_val_if_fail (MS_IS_RUNNING_APP (self), NULL);
+
+  return self->app_id;
+}
+
+
+guint
+ms_running_app_get_n_toplevels (MsRunningApp *self)
+{
+  g_return_val_if_fail (MS_IS_RUNNING_APP (self), 0);
+
+  return self->toplevels->len;
+}
+
+/**
+ * ms_running_app_get_titles:
+ * @self: The running app
+ *
+ * Get the titles of the app's toplevels.
+ *
+ * Returns:(transfer full): The titles
+ */
+GStrv
+ms_running_app_get_titles (MsRunningApp *self)
+{
+  g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+
+  g_return_val_if_fail (MS_IS_RUNNING_APP (self), NULL);
+
+  for (guint i = 0; i < self->toplevels->len; i++) {
+    MsToplevel *toplevel = g_ptr_array_index (self->toplevels, i);
+
+    if (toplevel->title)
+      g_strv_builder_add (builder, toplevel->title);
+  }
+
+  return g_strv_builder_end (builder);
+}
+
+/**
+ * ms_running_app_get_state:
+ * @self: The running app
+ *
+ * Get the combined state of the app's toplevels.
+ *
+ * Returns: The state
+ */
+MsToplevelState
+ms_running_app_get_state (MsRunningApp *self)
+{
+  MsToplevelState state = MS_TOPLEVEL_STATE_NONE;
+
+  g_return_val_if_fail (MS_IS_RUNNING_APP (self), MS_TOPLEVEL_STATE_NONE);
+
+  for (guint i = 0; i < self->toplevels->len; i++) {
+    MsToplevel *toplevel = g_ptr_array_index (self->toplevels, i);
+
+    state |= toplevel->state;
+  }
+
+  return state;
+}
+
+/**
+ * ms_running_app_get_outputs:
+ * @self: The running app
+ *
+ * Get the outputs the app's toplevels are on. Each output is only
+ * listed once.
+ *
+ * Returns:(transfer container)(element-type struct wl_output): The outputs
+ */
+GPtrArray *
+ms_running_app_get_outputs (MsRunningApp *self)
+{
+  GPtrArray *outputs = g_ptr_array_new ();
+
+  g_return_val_if_fail (MS_IS_RUNNING_APP (self), outputs);
+
+  for (guint i = 0; i < self->toplevels->len; i++) {
+    MsToplevel *toplevel = g_ptr_array_index (self->toplevels, i);
+
+    for (guint j = 0; j < toplevel->outputs->len; j++) {
+      gpointer output = g_ptr_array_index (toplevel->outputs, j);
+
+      if (!g_ptr_array_find (outputs, output, NULL))
+        g_ptr_array_add (outputs, output);
+    }
+  }
+
+  return outputs;
+}
+
+/**
+ * ms_running_app_has_output:
+ * @self: The running app
+ * @output: A `wl_output`
+ *
+ * Returns: %TRUE if any of the app's toplevels is on the given output
+ */
+gboolean
+ms_running_app_has_output (MsRunningApp *self, struct wl_output *output)
+{
+  g_return_val_if_fail (MS_IS_RUNNING_APP (self), FALSE);
+
+  for (guint i = 0; i < self->toplevels->len; i++) {
+    MsToplevel *toplevel = g_ptr_array_index (self->toplevels, i);
+
+    if (g_ptr_array_find (toplevel->outputs, output, NULL))
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+
+static int
+compare_apps (gconstpointer a, gconstpointer b)
+{
+  const MsRunningApp *app_a = *(MsRunningApp **)a;
+  const MsRunningApp *app_b = *(MsRunningApp **)b;
+
+  return g_strcmp0 (app_a->app_id, app_b->app_id);
+}
+
+
+static void
+notify_app (MsRunningApp *app)
+{
+  g_object_freeze_notify (G_OBJECT (app));
+  g_object_notify_by_pspec (G_OBJECT (app), app_props[APP_PROP_N_TOPLEVELS]);
+  g_object_notify_by_pspec (G_OBJECT (app), app_props[APP_PROP_TITLES]);
+  g_object_notify_by_pspec (G_OBJECT (app), app_props[APP_PROP_STATE]);
+  g_object_notify_by_pspec (G_OBJECT (app), app_props[APP_PROP_OUTPUTS]);
+  g_object_thaw_notify (G_OBJECT (app));
+}
+
+
+static void
+update_activated_app (MsToplevelTracker *self)
+{
+  MsRunningApp *activated = NULL;
+
+  for (guint i = 0; i < self->apps->len; i++) {
+    MsRunningApp *app = g_ptr_array_index (self->apps, i);
+
+    if (ms_running_app_get_state (app) & MS_TOPLEVEL_STATE_ACTIVATED) {
+      activated = app;
+      break;
+    }
+  }
+
+  if (g_set_object (&self->activated_app, activated))
+    g_object_notify_by_pspec (G_OBJECT (self), props[PROP_ACTIVATED_APP]);
+}
+
+
+static gboolean
+on_flush_idle (gpointer data)
+{
+  MsToplevelTracker *self = MS_TOPLEVEL_TRACKER (data);
+  g_autoptr (GPtrArray) changed = g_ptr_array_new_with_free_func (g_object_unref);
+  g_autoptr (GPtrArray) added = g_ptr_array_new ();
+  g_autoptr (GPtrArray) removed = g_ptr_array_new ();
+  g_autoptr (GPtrArray) old_apps = NULL;
+  GHashTableIter iter;
+  MsRunningApp *app;
+  guint old_len, new_len, prefix = 0, suffix = 0;
+
+  self->flush_id = 0;
+
+  g_hash_table_iter_init (&iter, self->dirty_apps);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&app, NULL)) {
+    gboolean in_model = app->toplevels->len > 0;
+
+    /* Keep the app alive while we emit signals */
+    g_ptr_array_add (changed, app);
+    g_hash_table_iter_steal (&iter);
+
+    if (in_model == FALSE)
+      g_hash_table_remove (self->apps_by_id, app->app_id);
+
+    if (in_model == app->in_model)
+      continue;
+
+    app->in_model = in_model;
+    g_ptr_array_add (in_model ? added : removed, app);
+  }
+
+  if (added->len || removed->len) {
+    GHashTableIter apps_iter;
+
+    /* Rebuild the sorted list and emit a single update covering all changes */
+    old_apps = g_steal_pointer (&self->apps);
+    self->apps = g_ptr_array_new_full (g_hash_table_size (self->apps_by_id), g_object_unref);
+    g_hash_table_iter_init (&apps_iter, self->apps_by_id);
+    while (g_hash_table_iter_next (&apps_iter, NULL, (gpointer *)&app))
+      g_ptr_array_add (self->apps, g_object_ref (app));
+    g_ptr_array_sort (self->apps, compare_apps);
+
+    old_len = old_apps->len;
+    new_len = self->apps->len;
+    while (prefix < old_len && prefix < new_len &&
+           g_ptr_array_index (old_apps, prefix) == g_ptr_array_index (self->apps, prefix))
+      prefix++;
+    while (suffix < old_len - prefix && suffix < new_len - prefix &&
+           g_ptr_array_index (old_apps, old_len - suffix - 1) ==
+           g_ptr_array_index (self->apps, new_len - suffix - 1))
+      suffix++;
+
+    g_debug ("Updating running apps: %u added, %u removed", added->len, removed->len);
+    g_list_model_items_changed (G_LIST_MODEL (self),
+                                prefix,
+                                old_len - prefix - suffix,
+                                new_len - prefix - suffix);
+    ms_wayland_stats_set_live (self->stats, "apps", self->apps->len);
+  }
+  ms_wayland_stats_batch_end (self->stats);
+
+  for (guint i = 0; i < removed->len; i++) {
+    app = g_ptr_array_index (removed, i);
+    g_signal_emit (self, signals[APP_ID_REMOVED], 0, app->app_id);
+  }
+
+  for (guint i = 0; i < added->len; i++) {
+    app = g_ptr_array_index (added, i);
+    g_signal_emit (self, signals[APP_ID_ADDED], 0, app->app_id);
+  }
+
+  for (guint i = 0; i < changed->len; i++) {
+    app = g_ptr_array_index (changed, i);
+    if (app->in_model)
+      notify_app (app);
+  }
+
+  update_activated_app (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+mark_app_dirty (MsToplevelTracker *self, MsRunningApp *app)
+{
+  /* Commits happen on done or closed, measure from the first one */
+  ms_wayland_stats_batch_begin (self->stats);
+
+  if (!g_hash_table_contains (self->dirty_apps, app))
+    g_hash_table_add (self->dirty_apps, g_object_ref (app));
+
+  /* Run after the current dispatch so all commits end up in one update */
+  if (self->flush_id == 0) {
+    self->flush_id = g_idle_add_full (G_PRIORITY_HIGH_IDLE, on_flush_idle, self, NULL);
+    g_source_set_name_by_id (self->flush_id, "[ms] flush toplevel changes");
+  }
+}
+
+
+static void
+toplevel_detach (MsToplevel *toplevel)
+{
+  MsRunningApp *app = toplevel->app;
+
+  if (app == NULL)
+    return;
+
+  toplevel->app = NULL;
+  g_ptr_array_remove_fast (app->toplevels, toplevel);
+  g_debug ("%u toplevels with app-id %s remain", app->toplevels->len, app->app_id);
+
+  mark_app_dirty (toplevel->tracker, app);
+}
+
+
+static void
+toplevel_attach (MsToplevel *toplevel)
+{
+  MsToplevelTracker *self = toplevel->tracker;
+  MsRunningApp *app;
+
+  g_assert (toplevel->app == NULL);
+
+  app = g_hash_table_lookup (self->apps_by_id, toplevel->app_id);
+  if (app == NULL) {
+    app = g_object_new (MS_TYPE_RUNNING_APP, "app-id", toplevel->app_id, NULL);
+    g_hash_table_insert (self->apps_by_id, app->app_id, app);
+  }
+
+  g_ptr_array_add (app->toplevels, toplevel);
+  toplevel->app = app;
+  g_debug ("%u toplevels with app-id %s", app->toplevels->len, app->app_id);
+
+  mark_app_dirty (self, app);
+}
+
+
+static gboolean
+outputs_equal (GPtrArray *a, GPtrArray *b)
+{
+  if (a->len != b->len)
+    return FALSE;
+
+  for (guint i = 0; i < a->len; i++) {
+    if (!g_ptr_array_find (b, g_ptr_array_index (a, i), NULL))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static void
+toplevel_commit (MsToplevel *toplevel)
+{
+  gboolean changed = FALSE;
+
+  if (toplevel->state != toplevel->pending_state) {
+    toplevel->state = toplevel->pending_state;
+    changed = TRUE;
+  }
+
+  if (!outputs_equal (toplevel->outputs, toplevel->pending_outputs)) {
+    g_ptr_array_set_size (toplevel->outputs, 0);
+    g_ptr_array_extend (toplevel->outputs, toplevel->pending_outputs, NULL, NULL);
+    changed = TRUE;
+  }
+
+  if (changed && toplevel->app)
+    mark_app_dirty (toplevel->tracker, toplevel->app);
+
+  if (toplevel->pending_title) {
+    g_free (toplevel->title);
+    toplevel->title = g_steal_pointer (&toplevel->pending_title);
+
+    if (toplevel->app)
+      mark_app_dirty (toplevel->tracker, toplevel->app);
+  }
+
+  if (toplevel->pending_app_id) {
+    /* Interned, so comparing pointers is enough */
+    if (toplevel->app_id == toplevel->pending_app_id) {
+      g_clear_pointer (&toplevel->pending_app_id, g_ref_string_release);
+      return;
+    }
+
+    /* Moves the toplevel over to the new app-id */
+    toplevel_detach (toplevel);
+    g_clear_pointer (&toplevel->app_id, g_ref_string_release);
+    toplevel->app_id = g_steal_pointer (&toplevel->pending_app_id);
+    toplevel_attach (toplevel);
+  }
+}
 
 
 static void
@@ -59,8 +616,10 @@ handle_zwlr_foreign_toplevel_handle_title (
 {
   MsToplevel *toplevel = data;
 
-  g_free (toplevel->title);
-  toplevel->title = g_strdup (title);
+  ms_wayland_stats_event (toplevel->tracker->stats, "title");
+
+  g_free (toplevel->pending_title);
+  toplevel->pending_title = g_strdup (title);
 
   g_debug ("%p: Got title %s", zwlr_foreign_toplevel_handle_v1, title);
 }
@@ -72,19 +631,13 @@ handle_zwlr_foreign_toplevel_handle_app_id (void *data,
   const char* app_id)
 {
   MsToplevel *toplevel = data;
-  int num;
 
-  g_free (toplevel->app_id);
-  toplevel->app_id = g_strdup (app_id);
+  ms_wayland_stats_event (toplevel->tracker->stats, "app_id");
 
-  num = GPOINTER_TO_INT (g_hash_table_lookup (toplevel->tracker->app_ids, app_id));
-  if (num == 0) {
-    g_signal_emit (toplevel->tracker, signals[APP_ID_ADDED], 0, app_id);
-  }
+  g_clear_pointer (&toplevel->pending_app_id, g_ref_string_release);
+  toplevel->pending_app_id = ms_app_id_intern (app_id);
 
-  num++;
-  g_debug ("%d toplevels with app-id %s", num, app_id);
-  g_hash_table_insert (toplevel->tracker->app_ids, g_strdup (app_id), GINT_TO_POINTER (num));
+  g_debug ("%p: Got app-id %s", zwlr_foreign_toplevel_handle_v1, app_id);
 }
 
 
@@ -93,6 +646,12 @@ handle_zwlr_foreign_toplevel_handle_output_enter(void *data,
   struct zwlr_foreign_toplevel_handle_v1 *zwlr_foreign_toplevel_handle_v1,
   struct wl_output *output)
 {
+  MsToplevel *toplevel = data;
+
+  ms_wayland_stats_event (toplevel->tracker->stats, "output_enter");
+
+  if (!g_ptr_array_find (toplevel->pending_outputs, output, NULL))
+    g_ptr_array_add (toplevel->pending_outputs, output);
 }
 
 
@@ -101,6 +660,11 @@ handle_zwlr_foreign_toplevel_handle_output_leave(void *data,
   struct zwlr_foreign_toplevel_handle_v1 *zwlr_foreign_toplevel_handle_v1,
   struct wl_output *output)
 {
+  MsToplevel *toplevel = data;
+
+  ms_wayland_stats_event (toplevel->tracker->stats, "output_leave");
+
+  g_ptr_array_remove_fast (toplevel->pending_outputs, output);
 }
 
 
@@ -109,6 +673,33 @@ handle_zwlr_foreign_toplevel_handle_state (void *data,
   struct zwlr_foreign_toplevel_handle_v1 *zwlr_foreign_toplevel_handle_v1,
   struct wl_array *state)
 {
+  MsToplevel *toplevel = data;
+  MsToplevelState new_state = MS_TOPLEVEL_STATE_NONE;
+  uint32_t *entry;
+
+  ms_wayland_stats_event (toplevel->tracker->stats, "state");
+
+  wl_array_for_each (entry, state) {
+    switch (*entry) {
+    case ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MAXIMIZED:
+      new_state |= MS_TOPLEVEL_STATE_MAXIMIZED;
+      break;
+    case ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_MINIMIZED:
+      new_state |= MS_TOPLEVEL_STATE_MINIMIZED;
+      break;
+    case ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_ACTIVATED:
+      new_state |= MS_TOPLEVEL_STATE_ACTIVATED;
+      break;
+    case ZWLR_FOREIGN_TOPLEVEL_HANDLE_V1_STATE_FULLSCREEN:
+      new_state |= MS_TOPLEVEL_STATE_FULLSCREEN;
+      break;
+    default:
+      /* Unknown states from newer protocol versions */
+      break;
+    }
+  }
+
+  toplevel->pending_state = new_state;
 }
 
 
@@ -116,6 +707,12 @@ static void
 handle_zwlr_foreign_toplevel_handle_done (void *data,
   struct zwlr_foreign_toplevel_handle_v1 *zwlr_foreign_toplevel_handle_v1)
 {
+  MsToplevel *toplevel = data;
+
+  g_return_if_fail (toplevel->handle == zwlr_foreign_toplevel_handle_v1);
+
+  ms_wayland_stats_event (toplevel->tracker->stats, "done");
+  toplevel_commit (toplevel);
 }
 
 
@@ -124,24 +721,17 @@ handle_zwlr_foreign_toplevel_handle_closed (void *data,
   struct zwlr_foreign_toplevel_handle_v1 *zwlr_foreign_toplevel_handle_v1)
 {
   MsToplevel *toplevel = data;
-  int num;
+  MsToplevelTracker *self = toplevel->tracker;
 
   g_return_if_fail (toplevel->handle == zwlr_foreign_toplevel_handle_v1);
 
-  num = GPOINTER_TO_INT (g_hash_table_lookup (toplevel->tracker->app_ids, toplevel->app_id));
-  num--;
-  if (num == 0) {
-    /* We're removing the last toplevel with that app-id */
-    g_signal_emit (toplevel->tracker, signals[APP_ID_REMOVED], 0, toplevel->app_id);
-    g_hash_table_remove (toplevel->tracker->app_ids, toplevel->app_id);
-  } else {
-    g_hash_table_insert (toplevel->tracker->app_ids, g_strdup (toplevel->app_id),
-                         GINT_TO_POINTER (num));
-  }
+  ms_wayland_stats_event (self->stats, "closed");
+  toplevel_detach (toplevel);
 
-  g_debug ("%d toplevels with app-id %s remain", num, toplevel->app_id);
-  if (g_hash_table_remove (toplevel->tracker->toplevels, toplevel->handle) == FALSE)
+  /* Toplevels are keyed by themselves, not by their handle */
+  if (g_hash_table_remove (self->toplevels, toplevel) == FALSE)
     g_warning ("Failed to find %p handle in toplevel tracker", toplevel->handle);
+  ms_wayland_stats_set_live (self->stats, "toplevels", g_hash_table_size (self->toplevels));
 }
 
 
@@ -161,8 +751,12 @@ toplevel_destroy (gpointer data)
 {
   MsToplevel *toplevel = data;
 
-  g_clear_pointer (&toplevel->app_id, g_free);
+  g_clear_pointer (&toplevel->app_id, g_ref_string_release);
   g_clear_pointer (&toplevel->title, g_free);
+  g_clear_pointer (&toplevel->pending_app_id, g_ref_string_release);
+  g_clear_pointer (&toplevel->pending_title, g_free);
+  g_clear_pointer (&toplevel->outputs, g_ptr_array_unref);
+  g_clear_pointer (&toplevel->pending_outputs, g_ptr_array_unref);
   g_clear_pointer (&toplevel->handle, zwlr_foreign_toplevel_handle_v1_destroy);
 
   g_free (toplevel);
@@ -176,6 +770,8 @@ ms_toplevel_new (struct zwlr_foreign_toplevel_handle_v1 *handle, MsToplevelTrack
 
   toplevel->handle = handle;
   toplevel->tracker = tracker;
+  toplevel->outputs = g_ptr_array_new ();
+  toplevel->pending_outputs = g_ptr_array_new ();
 
   zwlr_foreign_toplevel_handle_v1_add_listener (toplevel->handle,
                                                 &zwlr_foreign_toplevel_handle_listener, toplevel);
@@ -188,11 +784,21 @@ handle_zwlr_foreign_toplevel_manager_toplevel (void *data,
   struct zwlr_foreign_toplevel_manager_v1 *zwlr_foreign_toplevel_manager_v1,
   struct zwlr_foreign_toplevel_handle_v1  *handle)
 {
-  MsToplevelTracker *self = MS_TOPLEVEL_TRACKER (data);
+  MsToplevelTracker *self;
   MsToplevel *toplevel;
 
+  /* Tracker is gone but the compositor didn't process the stop yet */
+  if (data == NULL) {
+    zwlr_foreign_toplevel_handle_v1_destroy (handle);
+    return;
+  }
+
+  self = MS_TOPLEVEL_TRACKER (data);
+  ms_wayland_stats_event (self->stats, "toplevel");
+
   toplevel = ms_toplevel_new (handle, self);
   g_hash_table_insert (self->toplevels, toplevel, toplevel);
+  ms_wayland_stats_set_live (self->stats, "toplevels", g_hash_table_size (self->toplevels));
 
   g_debug ("Got toplevel %p", toplevel);
 }
@@ -202,7 +808,17 @@ static void
 handle_zwlr_foreign_toplevel_manager_finished (void *data,
   struct zwlr_foreign_toplevel_manager_v1 *zwlr_foreign_toplevel_manager_v1)
 {
+  MsToplevelTracker *self;
+
   g_debug ("wlr_foreign_toplevel_manager_finished");
+  zwlr_foreign_toplevel_manager_v1_destroy (zwlr_foreign_toplevel_manager_v1);
+
+  if (data == NULL)
+    return;
+
+  self = MS_TOPLEVEL_TRACKER (data);
+  ms_wayland_stats_event (self->stats, "finished");
+  self->foreign_toplevel_manager = NULL;
 }
 
 
@@ -243,6 +859,9 @@ ms_toplevel_tracker_get_property (GObject    *object,
   case PROP_FOREIGN_TOPLEVEL_MANAGER:
     g_value_set_pointer (value, self->foreign_toplevel_manager);
     break;
+  case PROP_ACTIVATED_APP:
+    g_value_set_object (value, self->activated_app);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -262,13 +881,47 @@ ms_toplevel_tracker_constructed (GObject *object)
 }
 
 
+static void
+app_detach_toplevels (gpointer key, gpointer value, gpointer user_data)
+{
+  MsRunningApp *app = MS_RUNNING_APP (value);
+
+  if (app->toplevels->len == 0)
+    return;
+
+  g_ptr_array_set_size (app->toplevels, 0);
+  app->in_model = FALSE;
+
+  g_object_freeze_notify (G_OBJECT (app));
+  g_object_notify_by_pspec (G_OBJECT (app), app_props[APP_PROP_N_TOPLEVELS]);
+  g_object_notify_by_pspec (G_OBJECT (app), app_props[APP_PROP_TITLES]);
+  g_object_notify_by_pspec (G_OBJECT (app), app_props[APP_PROP_STATE]);
+  g_object_notify_by_pspec (G_OBJECT (app), app_props[APP_PROP_OUTPUTS]);
+  g_object_thaw_notify (G_OBJECT (app));
+}
+
+
 static void
 ms_toplevel_tracker_finalize (GObject *object)
 {
   MsToplevelTracker *self = MS_TOPLEVEL_TRACKER(object);
 
+  /* Late events are handled without us, the proxy is destroyed on finished */
+  if (self->foreign_toplevel_manager) {
+    ms_toplevel_tracker_stop (self);
+    wl_proxy_set_user_data ((struct wl_proxy *) self->foreign_toplevel_manager, NULL);
+    self->foreign_toplevel_manager = NULL;
+  }
+
+  g_clear_handle_id (&self->flush_id, g_source_remove);
+  g_clear_object (&self->activated_app);
+  g_clear_pointer (&self->dirty_apps, g_hash_table_destroy);
+  /* Apps can outlive us so don't leave them with dangling toplevels */
+  g_hash_table_foreach (self->apps_by_id, app_detach_toplevels, NULL);
   g_clear_pointer (&self->toplevels, g_hash_table_destroy);
-  g_clear_pointer (&self->app_ids, g_hash_table_destroy);
+  g_clear_pointer (&self->apps_by_id, g_hash_table_destroy);
+  g_clear_pointer (&self->apps, g_ptr_array_unref);
+  g_clear_pointer (&self->stats, ms_wayland_stats_free);
 
   G_OBJECT_CLASS (ms_toplevel_tracker_parent_class)->finalize (object);
 }
@@ -287,6 +940,15 @@ ms_toplevel_tracker_class_init (MsToplevelTrackerClass *klass)
   props[PROP_FOREIGN_TOPLEVEL_MANAGER] =
     g_param_spec_pointer ("foreign-toplevel-tracker", "", "",
                           G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_EXPLICIT_NOTIFY);
+  /**
+   * MsToplevelTracker:activated-app:
+   *
+   * The app owning the currently activated toplevel
+   */
+  props[PROP_ACTIVATED_APP] =
+    g_param_spec_object ("activated-app", "", "",
+                         MS_TYPE_RUNNING_APP,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
 
   g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
 
@@ -314,11 +976,52 @@ ms_toplevel_tracker_class_init (MsToplevelTrackerClass *klass)
 }
 
 
+static GType
+ms_toplevel_tracker_list_model_get_item_type (GListModel *list)
+{
+  return MS_TYPE_RUNNING_APP;
+}
+
+
+static guint
+ms_toplevel_tracker_list_model_get_n_items (GListModel *list)
+{
+  MsToplevelTracker *self = MS_TOPLEVEL_TRACKER (list);
+
+  return self->apps->len;
+}
+
+
+static gpointer
+ms_toplevel_tracker_list_model_get_item (GListModel *list, guint position)
+{
+  MsToplevelTracker *self = MS_TOPLEVEL_TRACKER (list);
+
+  if (position >= self->apps->len)
+    return NULL;
+
+  return g_object_ref (g_ptr_array_index (self->apps, position));
+}
+
+
+static void
+ms_toplevel_tracker_list_model_iface_init (GListModelInterface *iface)
+{
+  iface->get_item_type = ms_toplevel_tracker_list_model_get_item_type;
+  iface->get_n_items = ms_toplevel_tracker_list_model_get_n_items;
+  iface->get_item = ms_toplevel_tracker_list_model_get_item;
+}
+
+
 static void
 ms_toplevel_tracker_init (MsToplevelTracker *self)
 {
   self->toplevels = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, toplevel_destroy);
-  self->app_ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->apps = g_ptr_array_new_with_free_func (g_object_unref);
+  /* Keys are owned by the apps */
+  self->apps_by_id = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
+  self->dirty_apps = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
+  self->stats = ms_wayland_stats_new ("Toplevels");
 }
 
 
@@ -334,16 +1037,93 @@ ms_toplevel_tracker_new (gpointer foreign_toplevel_manager)
 GStrv
 ms_toplevel_tracker_get_app_ids (MsToplevelTracker *self)
 {
-  g_autoptr (GList) keys = NULL;
-  g_autoptr (GPtrArray) app_ids = NULL;
+  g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+
+  g_return_val_if_fail (MS_IS_TOPLEVEL_TRACKER (self), NULL);
+
+  for (guint i = 0; i < self->apps->len; i++) {
+    MsRunningApp *app = g_ptr_array_index (self->apps, i);
+
+    g_strv_builder_add (builder, app->app_id);
+  }
+
+  return g_strv_builder_end (builder);
+}
+
+/**
+ * ms_toplevel_tracker_lookup_app:
+ * @self: The toplevel tracker
+ * @app_id: The app-id to look up
+ *
+ * Look up a running app by its app-id.
+ *
+ * Returns:(transfer none)(nullable): The running app or %NULL if
+ *   there's no toplevel with that app-id.
+ */
+MsRunningApp *
+ms_toplevel_tracker_lookup_app (MsToplevelTracker *self, const char *app_id)
+{
+  MsRunningApp *app;
+
+  g_return_val_if_fail (MS_IS_TOPLEVEL_TRACKER (self), NULL);
+
+  app = g_hash_table_lookup (self->apps_by_id, app_id);
+  if (app == NULL || app->in_model == FALSE)
+    return NULL;
+
+  return app;
+}
+
+
+/**
+ * ms_toplevel_tracker_get_stats:
+ * @self: The toplevel tracker
+ *
+ * Get statistics about the handled Wayland events.
+ *
+ * Returns:(transfer none): The stats
+ */
+MsWaylandStats *
+ms_toplevel_tracker_get_stats (MsToplevelTracker *self)
+{
+  g_return_val_if_fail (MS_IS_TOPLEVEL_TRACKER (self), NULL);
+
+  return self->stats;
+}
+
+
+/**
+ * ms_toplevel_tracker_get_activated_app:
+ * @self: The toplevel tracker
+ *
+ * Get the app owning the currently activated toplevel.
+ *
+ * Returns:(transfer none)(nullable): The activated app
+ */
+MsRunningApp *
+ms_toplevel_tracker_get_activated_app (MsToplevelTracker *self)
+{
+  g_return_val_if_fail (MS_IS_TOPLEVEL_TRACKER (self), NULL);
 
-  keys = g_hash_table_get_keys (self->app_ids);
+  return self->activated_app;
+}
 
-  app_ids = g_ptr_array_new ();
-  for (GList *elem = keys; elem; elem = elem->next)
-    g_ptr_array_add (app_ids, g_strdup (elem->data));
+/**
+ * ms_toplevel_tracker_stop:
+ * @self: The toplevel tracker
+ *
+ * Asks the compositor to stop sending toplevel events, e.g. because
+ * the manager's global went away. The manager is released once the
+ * compositor acknowledges this with `finished`.
+ */
+void
+ms_toplevel_tracker_stop (MsToplevelTracker *self)
+{
+  g_return_if_fail (MS_IS_TOPLEVEL_TRACKER (self));
 
-  g_ptr_array_add (app_ids, NULL);
+  if (self->foreign_toplevel_manager == NULL || self->stopped)
+    return;
 
-  return (char **)g_ptr_array_steal (app_ids, NULL);
+  zwlr_foreign_toplevel_manager_v1_stop (self->foreign_toplevel_manager);
+  self->stopped = TRUE;
 }
@@ -6,15 +6,35 @@
 
 #pragma once
 
-#include <glib-object.h>
+#include "mobile-settings-enums.h"
+#include "ms-wayland-stats.h"
+
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
+struct wl_output;
+
+#define MS_TYPE_RUNNING_APP (ms_running_app_get_type ())
+
+G_DECLARE_FINAL_TYPE (MsRunningApp, ms_running_app, MS, RUNNING_APP, GObject)
+
+const char        *ms_running_app_get_app_id (MsRunningApp *self);
+guint              ms_running_app_get_n_toplevels (MsRunningApp *self);
+GStrv              ms_running_app_get_titles (MsRunningApp *self);
+MsToplevelState    ms_running_app_get_state (MsRunningApp *self);
+GPtrArray         *ms_running_app_get_outputs (MsRunningApp *self);
+gboolean           ms_running_app_has_output (MsRunningApp *self, struct wl_output *output);
+
 #define MS_TYPE_TOPLEVEL_TRACKER (ms_toplevel_tracker_get_type ())
 
 G_DECLARE_FINAL_TYPE (MsToplevelTracker, ms_toplevel_tracker, MS, TOPLEVEL_TRACKER, GObject)
 
 MsToplevelTracker *ms_toplevel_tracker_new (gpointer foreign_toplevel_manager);
 GStrv              ms_toplevel_tracker_get_app_ids (MsToplevelTracker *self);
+MsRunningApp      *ms_toplevel_tracker_lookup_app (MsToplevelTracker *self, const char *app_id);
+MsWaylandStats    *ms_toplevel_tracker_get_stats (MsToplevelTracker *self);
+MsRunningApp      *ms_toplevel_tracker_get_activated_app (MsToplevelTracker *self);
+void               ms_toplevel_tracker_stop (MsToplevelTracker *self);
 
 G_END_DECLS
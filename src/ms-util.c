@@ -9,6 +9,8 @@
 #include <ms-util.h>
 #include <glib/gi18n.h>
 
+#include <errno.h>
+
 /**
  * ms_munge_app_id:
  * @app_id: the app_id
@@ -44,39 +46,144 @@ ms_munge_app_id (const char *app_id)
 
 
 /**
- * ms_get_desktop_app_info_for_app_id:
- * @app_id: the app_id
+ * ms_app_id_intern:
+ * @app_id:(nullable): the app_id
  *
- * Looks up an app info object for specified application ID.
- * Tries a bunch of transformations in order to maximize compatibility
- * with X11 and non-GTK applications that may not report the exact same
- * string as their app-id and in their desktop file.
+ * Interns an app_id so all users in the process share one
+ * allocation. Interned app ids can be compared by pointer.
  *
- * This is based on what phosh does.
+ * Returns: (transfer full)(nullable): The interned app_id. Release with
+ *   g_ref_string_release().
+ */
+char *
+ms_app_id_intern (const char *app_id)
+{
+  if (app_id == NULL)
+    return NULL;
+
+  return g_ref_string_new_intern (app_id);
+}
+
+
+/**
+ * ms_munged_app_id_intern:
+ * @app_id: the app_id
  *
- * Returns: (transfer full): GDesktopAppInfo for requested app_id
+ * Like ms_munge_app_id() but returns an interned string so
+ * munged ids for the same app share one allocation and can be
+ * compared by pointer.
+ *
+ * Returns: (transfer full): The interned munged app_id. Release with
+ *   g_ref_string_release().
  */
-GDesktopAppInfo *
-ms_get_desktop_app_info_for_app_id (const char *app_id)
+char *
+ms_munged_app_id_intern (const char *app_id)
+{
+  g_autofree char *munged_app_id = NULL;
+
+  g_return_val_if_fail (app_id, NULL);
+
+  munged_app_id = ms_munge_app_id (app_id);
+  return g_ref_string_new_intern (munged_app_id);
+}
+
+
+#define APP_ID_MAPPINGS_RESOURCE "/mobi/phosh/MobileSettings/app-id-mappings.ini"
+#define APP_ID_MAPPINGS_FILE "phosh-mobile-settings/app-id-mappings.ini"
+#define APP_ID_MAPPINGS_GROUP "Mappings"
+
+/* app-id -> GDesktopAppInfo, NULL for app-ids without desktop file */
+static GHashTable *app_infos;
+/* broken app-id -> desktop file id */
+static GHashTable *app_id_mappings;
+
+
+static void
+add_app_id_mappings (GKeyFile *keyfile)
+{
+  g_auto (GStrv) keys = g_key_file_get_keys (keyfile, APP_ID_MAPPINGS_GROUP, NULL, NULL);
+
+  for (int i = 0; keys && keys[i]; i++) {
+    g_autofree char *value = g_key_file_get_string (keyfile, APP_ID_MAPPINGS_GROUP, keys[i], NULL);
+
+    if (STR_IS_NULL_OR_EMPTY (value))
+      continue;
+
+    g_hash_table_insert (app_id_mappings, g_strdup (keys[i]), g_steal_pointer (&value));
+  }
+}
+
+
+static void
+load_app_id_mappings_file (const char *data_dir)
+{
+  g_autoptr (GKeyFile) keyfile = g_key_file_new ();
+  g_autofree char *path = g_build_filename (data_dir, APP_ID_MAPPINGS_FILE, NULL);
+  g_autoptr (GError) err = NULL;
+
+  if (g_key_file_load_from_file (keyfile, path, G_KEY_FILE_NONE, &err)) {
+    add_app_id_mappings (keyfile);
+  } else if (!g_error_matches (err, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+    g_warning ("Failed to load app-id mappings from '%s': %s", path, err->message);
+  }
+}
+
+/*
+ * Loads the built-in mappings and merges in the ones from all data
+ * dirs. Entries from more important data dirs override less
+ * important ones, the user's data dir wins over all.
+ */
+static void
+load_app_id_mappings (void)
+{
+  g_autoptr (GKeyFile) builtin = g_key_file_new ();
+  g_autoptr (GBytes) data = NULL;
+  g_autoptr (GError) err = NULL;
+  const char * const *data_dirs = g_get_system_data_dirs ();
+
+  app_id_mappings = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  data = g_resources_lookup_data (APP_ID_MAPPINGS_RESOURCE, G_RESOURCE_LOOKUP_FLAGS_NONE, &err);
+  if (data && g_key_file_load_from_bytes (builtin, data, G_KEY_FILE_NONE, &err))
+    add_app_id_mappings (builtin);
+  else
+    g_warning ("Failed to load built-in app-id mappings: %s", err->message);
+
+  for (int i = g_strv_length ((GStrv) data_dirs) - 1; i >= 0; i--)
+    load_app_id_mappings_file (data_dirs[i]);
+  load_app_id_mappings_file (g_get_user_data_dir ());
+}
+
+
+static void
+app_info_unref (gpointer data)
+{
+  if (data)
+    g_object_unref (data);
+}
+
+
+static void
+on_app_info_changed (GAppInfoMonitor *monitor)
+{
+  g_debug ("Installed apps changed, dropping %u cached app infos", g_hash_table_size (app_infos));
+  g_hash_table_remove_all (app_infos);
+}
+
+
+static GDesktopAppInfo *
+lookup_desktop_app_info (const char *app_id)
 {
   g_autofree char *desktop_id = NULL;
   g_autofree char *lowercase = NULL;
   GDesktopAppInfo *app_info = NULL;
+  const char *mapped_id;
   char *last_component;
-  static char *mappings[][2] = {
-    { "org.gnome.ControlCenter", "gnome-control-center" },
-    { "gnome-usage", "org.gnome.Usage" },
-  };
-
-  g_assert (app_id);
 
   /* fix up applications with known broken app-id */
-  for (int i = 0; i < G_N_ELEMENTS (mappings); i++) {
-    if (strcmp (app_id, mappings[i][0]) == 0) {
-      app_id = mappings[i][1];
-      break;
-    }
-  }
+  mapped_id = g_hash_table_lookup (app_id_mappings, app_id);
+  if (mapped_id)
+    app_id = mapped_id;
 
   desktop_id = g_strdup_printf ("%s.desktop", app_id);
   g_return_val_if_fail (desktop_id, NULL);
@@ -109,6 +216,49 @@ ms_get_desktop_app_info_for_app_id (const char *app_id)
   return app_info;
 }
 
+/**
+ * ms_get_desktop_app_info_for_app_id:
+ * @app_id: the app_id
+ *
+ * Looks up an app info object for specified application ID.
+ * Tries a bunch of transformations in order to maximize compatibility
+ * with X11 and non-GTK applications that may not report the exact same
+ * string as their app-id and in their desktop file. App-ids known to
+ * not match their desktop file are mapped via `app-id-mappings.ini`.
+ * The files from all data dirs are merged, so a user's file extends
+ * the distribution's one.
+ *
+ * This is based on what phosh does.
+ *
+ * Results (including failed lookups) are cached until the installed
+ * applications change. Must be invoked from the main thread.
+ *
+ * Returns: (transfer full)(nullable): GDesktopAppInfo for requested app_id
+ */
+GDesktopAppInfo *
+ms_get_desktop_app_info_for_app_id (const char *app_id)
+{
+  GDesktopAppInfo *app_info;
+
+  g_assert (app_id);
+
+  if (app_infos == NULL) {
+    app_infos = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, app_info_unref);
+    load_app_id_mappings ();
+    /* The monitor is a singleton that lives as long as we hold the ref */
+    g_signal_connect (g_app_info_monitor_get (), "changed",
+                      G_CALLBACK (on_app_info_changed), NULL);
+  }
+
+  if (g_hash_table_lookup_extended (app_infos, app_id, NULL, (gpointer *)&app_info))
+    return app_info ? g_object_ref (app_info) : NULL;
+
+  app_info = lookup_desktop_app_info (app_id);
+  g_hash_table_insert (app_infos, g_strdup (app_id), app_info ? g_object_ref (app_info) : NULL);
+
+  return app_info;
+}
+
 
 MsFeedbackProfile
 ms_feedback_profile_from_setting (const char *name)
@@ -155,3 +305,95 @@ ms_feedback_profile_to_label (MsFeedbackProfile profile)
     g_return_val_if_reached (NULL);
   }
 }
+
+
+/**
+ * ms_get_mtime:
+ * @path: The path of a file or directory
+ *
+ * Gets the modification time of the given path.
+ *
+ * Returns: The mtime in microseconds or `-1` if it can't be determined
+ */
+gint64
+ms_get_mtime (const char *path)
+{
+  g_autoptr (GFile) file = g_file_new_for_path (path);
+  g_autoptr (GFileInfo) info = NULL;
+  guint64 mtime;
+
+  info = g_file_query_info (file,
+                            G_FILE_ATTRIBUTE_TIME_MODIFIED "," G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                            G_FILE_QUERY_INFO_NONE,
+                            NULL,
+                            NULL);
+  if (info == NULL)
+    return -1;
+
+  mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC;
+  mtime += g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+
+  return mtime;
+}
+
+
+static char *
+get_cache_filename (const char *name)
+{
+  return g_build_filename (g_get_user_cache_dir (), "phosh-mobile-settings", name, NULL);
+}
+
+/**
+ * ms_cache_load:
+ * @name: The cache file's name
+ * @type: The expected type of the cached data
+ *
+ * Loads a serialized GVariant from mobile settings' cache
+ * directory. The file is mmap()ed so the data is only paged in
+ * when used.
+ *
+ * Returns:(transfer full)(nullable): The cached data or %NULL if there's none
+ */
+GVariant *
+ms_cache_load (const char *name, const GVariantType *type)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GMappedFile) mapped = NULL;
+  g_autoptr (GBytes) bytes = NULL;
+  g_autofree char *path = get_cache_filename (name);
+
+  mapped = g_mapped_file_new (path, FALSE, &err);
+  if (mapped == NULL) {
+    if (!g_error_matches (err, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      g_warning ("Failed to load cache %s: %s", path, err->message);
+    return NULL;
+  }
+
+  bytes = g_mapped_file_get_bytes (mapped);
+  return g_variant_ref_sink (g_variant_new_from_bytes (type, bytes, FALSE));
+}
+
+/**
+ * ms_cache_save:
+ * @name: The cache file's name
+ * @data: The data to cache
+ *
+ * Saves serialized data to mobile settings' cache directory. If
+ * @data is floating it is consumed.
+ */
+void
+ms_cache_save (const char *name, GVariant *data)
+{
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GVariant) value = g_variant_ref_sink (data);
+  g_autofree char *path = get_cache_filename (name);
+  g_autofree char *dirname = g_path_get_dirname (path);
+
+  if (g_mkdir_with_parents (dirname, 0700) < 0) {
+    g_warning ("Failed to create %s: %s", dirname, g_strerror (errno));
+    return;
+  }
+
+  if (!g_file_set_contents (path, g_variant_get_data (value), g_variant_get_size (value), &err))
+    g_warning ("Failed to save cache %s: %s", path, err->message);
+}
@@ -17,9 +17,14 @@ G_BEGIN_DECLS
 #define STR_IS_NULL_OR_EMPTY(x) ((x) == NULL || (x)[0] == '\0')
 
 gchar            *ms_munge_app_id (const gchar *app_id);
+char             *ms_app_id_intern (const char *app_id);
+char             *ms_munged_app_id_intern (const char *app_id);
 GDesktopAppInfo  *ms_get_desktop_app_info_for_app_id (const char *app_id);
 MsFeedbackProfile ms_feedback_profile_from_setting (const char *name);
 char             *ms_feedback_profile_to_setting (MsFeedbackProfile profile);
 char             *ms_feedback_profile_to_label (MsFeedbackProfile profile);
+gint64            ms_get_mtime (const char *path);
+GVariant         *ms_cache_load (const char *name, const GVariantType *type);
+void              ms_cache_save (const char *name, GVariant *data);
 
 G_END_DECLS
@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ms-wayland-stats"
+
+#include "mobile-settings-config.h"
+
+#include "ms-wayland-stats.h"
+
+#include <stdlib.h>
+
+/**
+ * MsWaylandStats:
+ *
+ * Counters and latency histograms for the Wayland events handled by
+ * a tracker. Events are counted as they arrive. When the tracker
+ * updated its model (`ms_wayland_stats_batch_end()`) the time since
+ * the first event of each kind in that batch is added to the event's
+ * histogram. The time from the batch's `done` event
+ * (`ms_wayland_stats_batch_begin()`) to the model update is tracked
+ * separately.
+ */
+
+/* Upper bounds of the histogram buckets in µs, the last one is unbounded */
+static const gint64 buckets[] = { 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000 };
+#define N_BUCKETS (G_N_ELEMENTS (buckets) + 1)
+
+typedef struct {
+  guint64 counts[N_BUCKETS];
+  guint64 n;
+  gint64  max;
+} MsHistogram;
+
+typedef struct {
+  guint64     count;
+  gint64      pending_since;
+  MsHistogram latency;
+} MsEventStats;
+
+struct _MsWaylandStats {
+  char         *name;
+  GHashTable   *events;
+  GHashTable   *live;
+
+  guint64       n_batches;
+  gint64        batch_begin;
+  MsHistogram   batch_latency;
+};
+
+
+static void
+histogram_add (MsHistogram *histogram, gint64 value)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (buckets); i++) {
+    if (value <= buckets[i])
+      break;
+  }
+
+  histogram->counts[i]++;
+  histogram->n++;
+  histogram->max = MAX (histogram->max, value);
+}
+
+
+static const char *
+bucket_name (guint i)
+{
+  static const char *names[] = { "≤50µs", "≤100µs", "≤250µs", "≤500µs", "≤1ms", "≤2.5ms",
+                                 "≤5ms", "≤10ms", "≤25ms", "≤50ms", "≤100ms", ">100ms" };
+
+  G_STATIC_ASSERT (G_N_ELEMENTS (names) == N_BUCKETS);
+
+  return names[i];
+}
+
+
+static void
+histogram_append (MsHistogram *histogram, GString *str)
+{
+  gboolean first = TRUE;
+
+  if (histogram->n == 0)
+    return;
+
+  g_string_append (str, " [");
+  for (guint i = 0; i < N_BUCKETS; i++) {
+    if (histogram->counts[i] == 0)
+      continue;
+
+    g_string_append_printf (str, "%s%s: %" G_GUINT64_FORMAT,
+                            first ? "" : ", ", bucket_name (i), histogram->counts[i]);
+    first = FALSE;
+  }
+  g_string_append_printf (str, "], max %" G_GINT64_FORMAT "µs", histogram->max);
+}
+
+
+MsWaylandStats *
+ms_wayland_stats_new (const char *name)
+{
+  MsWaylandStats *self = g_new0 (MsWaylandStats, 1);
+
+  self->name = g_strdup (name);
+  /* Event names and kinds are static strings */
+  self->events = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+  self->live = g_hash_table_new (g_str_hash, g_str_equal);
+
+  return self;
+}
+
+
+void
+ms_wayland_stats_free (MsWaylandStats *self)
+{
+  g_return_if_fail (self);
+
+  g_free (self->name);
+  g_hash_table_destroy (self->events);
+  g_hash_table_destroy (self->live);
+  g_free (self);
+}
+
+/**
+ * ms_wayland_stats_event:
+ * @self: The stats
+ * @event: The event's name. Must be a static string.
+ *
+ * Count a received event.
+ */
+void
+ms_wayland_stats_event (MsWaylandStats *self, const char *event)
+{
+  MsEventStats *stats;
+
+  g_return_if_fail (self);
+
+  stats = g_hash_table_lookup (self->events, event);
+  if (stats == NULL) {
+    stats = g_new0 (MsEventStats, 1);
+    g_hash_table_insert (self->events, (gpointer)event, stats);
+  }
+
+  stats->count++;
+  if (stats->pending_since == 0)
+    stats->pending_since = g_get_monotonic_time ();
+}
+
+/**
+ * ms_wayland_stats_batch_begin:
+ * @self: The stats
+ *
+ * Mark the point where the compositor finished sending a batch of
+ * state (usually the `done` event). Later calls before the batch
+ * ends are ignored.
+ */
+void
+ms_wayland_stats_batch_begin (MsWaylandStats *self)
+{
+  g_return_if_fail (self);
+
+  if (self->batch_begin == 0)
+    self->batch_begin = g_get_monotonic_time ();
+}
+
+/**
+ * ms_wayland_stats_batch_end:
+ * @self: The stats
+ *
+ * Mark that the tracker's model got updated with the events
+ * received so far.
+ */
+void
+ms_wayland_stats_batch_end (MsWaylandStats *self)
+{
+  gint64 now = g_get_monotonic_time ();
+  GHashTableIter iter;
+  MsEventStats *stats;
+
+  g_return_if_fail (self);
+
+  self->n_batches++;
+  if (self->batch_begin) {
+    histogram_add (&self->batch_latency, now - self->batch_begin);
+    self->batch_begin = 0;
+  }
+
+  g_hash_table_iter_init (&iter, self->events);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&stats)) {
+    if (stats->pending_since == 0)
+      continue;
+
+    histogram_add (&stats->latency, now - stats->pending_since);
+    stats->pending_since = 0;
+  }
+}
+
+/**
+ * ms_wayland_stats_set_live:
+ * @self: The stats
+ * @kind: The kind of object. Must be a static string.
+ * @n: The number of live objects
+ *
+ * Update the number of live objects of the given kind.
+ */
+void
+ms_wayland_stats_set_live (MsWaylandStats *self, const char *kind, guint n)
+{
+  g_return_if_fail (self);
+
+  g_hash_table_insert (self->live, (gpointer)kind, GUINT_TO_POINTER (n));
+}
+
+
+static int
+compare_strings (gconstpointer a, gconstpointer b)
+{
+  return g_strcmp0 (*(const char **)a, *(const char **)b);
+}
+
+/**
+ * ms_wayland_stats_get_report:
+ * @self: The stats
+ *
+ * Get a human readable report suitable for the debug information.
+ *
+ * Returns:(transfer full): The report
+ */
+char *
+ms_wayland_stats_get_report (MsWaylandStats *self)
+{
+  GString *str = g_string_new (NULL);
+  g_autofree const char **kinds = NULL;
+  g_autofree const char **events = NULL;
+  guint n;
+
+  g_return_val_if_fail (self, NULL);
+
+  g_string_append_printf (str, "- %s:", self->name);
+  kinds = (const char **)g_hash_table_get_keys_as_array (self->live, &n);
+  qsort (kinds, n, sizeof (char *), compare_strings);
+  for (guint i = 0; i < n; i++) {
+    g_string_append_printf (str, "%s %s %u", i ? "," : "", kinds[i],
+                            GPOINTER_TO_UINT (g_hash_table_lookup (self->live, kinds[i])));
+  }
+  g_string_append (str, "\n");
+
+  g_string_append_printf (str, "  - %" G_GUINT64_FORMAT " model updates, done → update:",
+                          self->n_batches);
+  histogram_append (&self->batch_latency, str);
+  g_string_append (str, "\n");
+
+  events = (const char **)g_hash_table_get_keys_as_array (self->events, &n);
+  qsort (events, n, sizeof (char *), compare_strings);
+  for (guint i = 0; i < n; i++) {
+    MsEventStats *stats = g_hash_table_lookup (self->events, events[i]);
+
+    g_string_append_printf (str, "  - %s: %" G_GUINT64_FORMAT " events",
+                            events[i], stats->count);
+    histogram_append (&stats->latency, str);
+    g_string_append (str, "\n");
+  }
+
+  return g_string_free (str, FALSE);
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MsWaylandStats MsWaylandStats;
+
+MsWaylandStats *ms_wayland_stats_new          (const char *name);
+void            ms_wayland_stats_free         (MsWaylandStats *self);
+void            ms_wayland_stats_event        (MsWaylandStats *self, const char *event);
+void            ms_wayland_stats_batch_begin  (MsWaylandStats *self);
+void            ms_wayland_stats_batch_end    (MsWaylandStats *self);
+void            ms_wayland_stats_set_live     (MsWaylandStats *self, const char *kind, guint n);
+char           *ms_wayland_stats_get_report   (MsWaylandStats *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (MsWaylandStats, ms_wayland_stats_free)
+
+G_END_DECLS
@@ -0,0 +1,632 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ms-stub-compositor"
+
+#include "mobile-settings-config.h"
+
+#include "protocols/wlr-foreign-toplevel-management-unstable-v1-server-protocol.h"
+#include "protocols/wlr-output-management-unstable-v1-server-protocol.h"
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <wayland-server.h>
+
+#include <signal.h>
+#include <stdlib.h>
+
+/**
+ * A headless Wayland server that implements just enough of
+ * wlr-foreign-toplevel-management and wlr-output-management to drive
+ * MsToplevelTracker and MsHeadTracker without a running phoc.
+ *
+ * Scenarios are run from a timer: `toplevels` opens a batch of
+ * toplevels and closes them again on the next tick, `hotplug` adds
+ * and removes a head on each tick. This allows to watch the trackers
+ * under load, e.g. with ms-tracker-bench.
+ */
+
+#define TOPLEVEL_MANAGER_VERSION 2
+#define OUTPUT_MANAGER_VERSION 2
+
+typedef struct {
+  char          *app_id;
+  char          *title;
+  struct wl_list resources;
+} StubToplevel;
+
+typedef struct {
+  int32_t        width;
+  int32_t        height;
+  int32_t        refresh;
+  gboolean       preferred;
+} StubMode;
+
+typedef struct {
+  char          *name;
+  char          *description;
+  GArray        *modes;
+  struct wl_list resources;
+} StubHead;
+
+typedef struct {
+  struct wl_display *display;
+  GMainLoop         *loop;
+
+  struct wl_list     toplevel_managers;
+  struct wl_list     output_managers;
+  GPtrArray         *toplevels;
+  GPtrArray         *heads;
+  guint32            serial;
+
+  /* Scenario */
+  const char        *scenario;
+  int                count;
+  int                n_app_ids;
+  int                cycles;
+  int                cycle;
+  guint              n_heads_added;
+} StubCompositor;
+
+
+static void
+resource_unlink (struct wl_resource *resource)
+{
+  wl_list_remove (wl_resource_get_link (resource));
+}
+
+/* wlr-foreign-toplevel-management */
+
+static void
+handle_toplevel_noop (struct wl_client *client, struct wl_resource *resource)
+{
+}
+
+
+static void
+handle_toplevel_activate (struct wl_client *client, struct wl_resource *resource,
+                          struct wl_resource *seat)
+{
+}
+
+
+static void
+handle_toplevel_set_rectangle (struct wl_client *client, struct wl_resource *resource,
+                               struct wl_resource *surface,
+                               int32_t x, int32_t y, int32_t width, int32_t height)
+{
+}
+
+
+static void
+handle_toplevel_set_fullscreen (struct wl_client *client, struct wl_resource *resource,
+                                struct wl_resource *output)
+{
+}
+
+
+static void
+handle_resource_destroy (struct wl_client *client, struct wl_resource *resource)
+{
+  wl_resource_destroy (resource);
+}
+
+
+static const struct zwlr_foreign_toplevel_handle_v1_interface toplevel_handle_impl = {
+  .set_maximized = handle_toplevel_noop,
+  .unset_maximized = handle_toplevel_noop,
+  .set_minimized = handle_toplevel_noop,
+  .unset_minimized = handle_toplevel_noop,
+  .activate = handle_toplevel_activate,
+  .close = handle_toplevel_noop,
+  .set_rectangle = handle_toplevel_set_rectangle,
+  .destroy = handle_resource_destroy,
+  .set_fullscreen = handle_toplevel_set_fullscreen,
+  .unset_fullscreen = handle_toplevel_noop,
+};
+
+
+static void
+toplevel_send (StubToplevel *toplevel, struct wl_resource *manager)
+{
+  struct wl_resource *resource;
+  struct wl_array state;
+
+  resource = wl_resource_create (wl_resource_get_client (manager),
+                                 &zwlr_foreign_toplevel_handle_v1_interface,
+                                 wl_resource_get_version (manager), 0);
+  if (resource == NULL) {
+    wl_resource_post_no_memory (manager);
+    return;
+  }
+  wl_resource_set_implementation (resource, &toplevel_handle_impl, toplevel, resource_unlink);
+  wl_list_insert (&toplevel->resources, wl_resource_get_link (resource));
+
+  zwlr_foreign_toplevel_manager_v1_send_toplevel (manager, resource);
+  zwlr_foreign_toplevel_handle_v1_send_title (resource, toplevel->title);
+  zwlr_foreign_toplevel_handle_v1_send_app_id (resource, toplevel->app_id);
+  wl_array_init (&state);
+  zwlr_foreign_toplevel_handle_v1_send_state (resource, &state);
+  wl_array_release (&state);
+  zwlr_foreign_toplevel_handle_v1_send_done (resource);
+}
+
+
+static StubToplevel *
+toplevel_new (StubCompositor *self, const char *app_id, const char *title)
+{
+  StubToplevel *toplevel = g_new0 (StubToplevel, 1);
+  struct wl_resource *manager;
+
+  toplevel->app_id = g_strdup (app_id);
+  toplevel->title = g_strdup (title);
+  wl_list_init (&toplevel->resources);
+
+  wl_resource_for_each (manager, &self->toplevel_managers)
+    toplevel_send (toplevel, manager);
+
+  return toplevel;
+}
+
+
+static void
+toplevel_close (gpointer data)
+{
+  StubToplevel *toplevel = data;
+  struct wl_resource *resource, *tmp;
+
+  wl_resource_for_each_safe (resource, tmp, &toplevel->resources) {
+    zwlr_foreign_toplevel_handle_v1_send_closed (resource);
+    /* The client destroys the handle, make sure we don't reference the toplevel */
+    wl_resource_set_user_data (resource, NULL);
+    resource_unlink (resource);
+    wl_list_init (wl_resource_get_link (resource));
+  }
+
+  g_free (toplevel->app_id);
+  g_free (toplevel->title);
+  g_free (toplevel);
+}
+
+
+static void
+handle_toplevel_manager_stop (struct wl_client *client, struct wl_resource *resource)
+{
+  zwlr_foreign_toplevel_manager_v1_send_finished (resource);
+  wl_resource_destroy (resource);
+}
+
+
+static const struct zwlr_foreign_toplevel_manager_v1_interface toplevel_manager_impl = {
+  .stop = handle_toplevel_manager_stop,
+};
+
+
+static void
+bind_toplevel_manager (struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+  StubCompositor *self = data;
+  struct wl_resource *resource;
+
+  resource = wl_resource_create (client, &zwlr_foreign_toplevel_manager_v1_interface, version, id);
+  if (resource == NULL) {
+    wl_client_post_no_memory (client);
+    return;
+  }
+  wl_resource_set_implementation (resource, &toplevel_manager_impl, self, resource_unlink);
+  wl_list_insert (&self->toplevel_managers, wl_resource_get_link (resource));
+
+  for (guint i = 0; i < self->toplevels->len; i++)
+    toplevel_send (g_ptr_array_index (self->toplevels, i), resource);
+}
+
+/* wlr-output-management */
+
+static void
+handle_config_head_set_mode (struct wl_client *client, struct wl_resource *resource,
+                             struct wl_resource *mode)
+{
+}
+
+
+static void
+handle_config_head_set_custom_mode (struct wl_client *client, struct wl_resource *resource,
+                                    int32_t width, int32_t height, int32_t refresh)
+{
+}
+
+
+static void
+handle_config_head_set_position (struct wl_client *client, struct wl_resource *resource,
+                                 int32_t x, int32_t y)
+{
+}
+
+
+static void
+handle_config_head_set_transform (struct wl_client *client, struct wl_resource *resource,
+                                  int32_t transform)
+{
+}
+
+
+static void
+handle_config_head_set_scale (struct wl_client *client, struct wl_resource *resource,
+                              wl_fixed_t scale)
+{
+}
+
+
+static const struct zwlr_output_configuration_head_v1_interface config_head_impl = {
+  .set_mode = handle_config_head_set_mode,
+  .set_custom_mode = handle_config_head_set_custom_mode,
+  .set_position = handle_config_head_set_position,
+  .set_transform = handle_config_head_set_transform,
+  .set_scale = handle_config_head_set_scale,
+};
+
+
+static void
+handle_config_enable_head (struct wl_client *client, struct wl_resource *resource,
+                           uint32_t id, struct wl_resource *head)
+{
+  struct wl_resource *config_head;
+
+  config_head = wl_resource_create (client, &zwlr_output_configuration_head_v1_interface,
+                                    wl_resource_get_version (resource), id);
+  if (config_head == NULL) {
+    wl_client_post_no_memory (client);
+    return;
+  }
+  wl_resource_set_implementation (config_head, &config_head_impl, NULL, NULL);
+}
+
+
+static void
+handle_config_disable_head (struct wl_client *client, struct wl_resource *resource,
+                            struct wl_resource *head)
+{
+}
+
+
+static void
+handle_config_apply (struct wl_client *client, struct wl_resource *resource)
+{
+  /* We don't actually configure anything */
+  zwlr_output_configuration_v1_send_cancelled (resource);
+}
+
+
+static const struct zwlr_output_configuration_v1_interface config_impl = {
+  .enable_head = handle_config_enable_head,
+  .disable_head = handle_config_disable_head,
+  .apply = handle_config_apply,
+  .test = handle_config_apply,
+  .destroy = handle_resource_destroy,
+};
+
+
+static void
+handle_output_manager_create_configuration (struct wl_client *client, struct wl_resource *resource,
+                                            uint32_t id, uint32_t serial)
+{
+  struct wl_resource *config;
+
+  config = wl_resource_create (client, &zwlr_output_configuration_v1_interface,
+                               wl_resource_get_version (resource), id);
+  if (config == NULL) {
+    wl_client_post_no_memory (client);
+    return;
+  }
+  wl_resource_set_implementation (config, &config_impl, NULL, NULL);
+}
+
+
+static void
+handle_output_manager_stop (struct wl_client *client, struct wl_resource *resource)
+{
+  zwlr_output_manager_v1_send_finished (resource);
+  wl_resource_destroy (resource);
+}
+
+
+static const struct zwlr_output_manager_v1_interface output_manager_impl = {
+  .create_configuration = handle_output_manager_create_configuration,
+  .stop = handle_output_manager_stop,
+};
+
+
+static void
+head_send (StubHead *head, struct wl_resource *manager)
+{
+  struct wl_client *client = wl_resource_get_client (manager);
+  guint32 version = wl_resource_get_version (manager);
+  struct wl_resource *resource;
+
+  resource = wl_resource_create (client, &zwlr_output_head_v1_interface, version, 0);
+  if (resource == NULL) {
+    wl_resource_post_no_memory (manager);
+    return;
+  }
+  wl_resource_set_implementation (resource, NULL, head, resource_unlink);
+  wl_list_insert (&head->resources, wl_resource_get_link (resource));
+
+  zwlr_output_manager_v1_send_head (manager, resource);
+  zwlr_output_head_v1_send_name (resource, head->name);
+  zwlr_output_head_v1_send_description (resource, head->description);
+  zwlr_output_head_v1_send_physical_size (resource, 65, 130);
+
+  for (guint i = 0; i < head->modes->len; i++) {
+    StubMode *mode = &g_array_index (head->modes, StubMode, i);
+    struct wl_resource *mode_resource;
+
+    mode_resource = wl_resource_create (client, &zwlr_output_mode_v1_interface, version, 0);
+    if (mode_resource == NULL) {
+      wl_resource_post_no_memory (manager);
+      return;
+    }
+    wl_resource_set_implementation (mode_resource, NULL, NULL, NULL);
+
+    zwlr_output_head_v1_send_mode (resource, mode_resource);
+    zwlr_output_mode_v1_send_size (mode_resource, mode->width, mode->height);
+    zwlr_output_mode_v1_send_refresh (mode_resource, mode->refresh);
+    if (mode->preferred) {
+      zwlr_output_mode_v1_send_preferred (mode_resource);
+      zwlr_output_head_v1_send_enabled (resource, TRUE);
+      zwlr_output_head_v1_send_current_mode (resource, mode_resource);
+    }
+  }
+
+  zwlr_output_head_v1_send_position (resource, 0, 0);
+  zwlr_output_head_v1_send_transform (resource, WL_OUTPUT_TRANSFORM_NORMAL);
+  zwlr_output_head_v1_send_scale (resource, wl_fixed_from_double (2.0));
+  if (version >= ZWLR_OUTPUT_HEAD_V1_MAKE_SINCE_VERSION) {
+    zwlr_output_head_v1_send_make (resource, "Phosh");
+    zwlr_output_head_v1_send_model (resource, "Stub");
+    zwlr_output_head_v1_send_serial_number (resource, head->name);
+  }
+}
+
+
+static void
+output_managers_send_done (StubCompositor *self)
+{
+  struct wl_resource *manager;
+
+  self->serial++;
+  wl_resource_for_each (manager, &self->output_managers)
+    zwlr_output_manager_v1_send_done (manager, self->serial);
+}
+
+
+static StubHead *
+head_new (StubCompositor *self, const char *name)
+{
+  StubHead *head = g_new0 (StubHead, 1);
+  StubMode modes[] = {
+    { 720, 1440, 60000, TRUE },
+    { 1920, 1080, 60000, FALSE },
+  };
+  struct wl_resource *manager;
+
+  head->name = g_strdup (name);
+  head->description = g_strdup_printf ("Stub head %s", name);
+  head->modes = g_array_new (FALSE, FALSE, sizeof (StubMode));
+  g_array_append_vals (head->modes, modes, G_N_ELEMENTS (modes));
+  wl_list_init (&head->resources);
+
+  wl_resource_for_each (manager, &self->output_managers)
+    head_send (head, manager);
+
+  return head;
+}
+
+
+static void
+head_remove (gpointer data)
+{
+  StubHead *head = data;
+  struct wl_resource *resource, *tmp;
+
+  /* Modes aren't tracked individually, the head going away is enough for the tracker */
+  wl_resource_for_each_safe (resource, tmp, &head->resources) {
+    zwlr_output_head_v1_send_finished (resource);
+    wl_resource_destroy (resource);
+  }
+
+  g_free (head->name);
+  g_free (head->description);
+  g_array_unref (head->modes);
+  g_free (head);
+}
+
+
+static void
+bind_output_manager (struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+  StubCompositor *self = data;
+  struct wl_resource *resource;
+
+  resource = wl_resource_create (client, &zwlr_output_manager_v1_interface, version, id);
+  if (resource == NULL) {
+    wl_client_post_no_memory (client);
+    return;
+  }
+  wl_resource_set_implementation (resource, &output_manager_impl, self, resource_unlink);
+  wl_list_insert (&self->output_managers, wl_resource_get_link (resource));
+
+  for (guint i = 0; i < self->heads->len; i++)
+    head_send (g_ptr_array_index (self->heads, i), resource);
+  zwlr_output_manager_v1_send_done (resource, self->serial);
+}
+
+/* Scenarios */
+
+static void
+run_toplevels_step (StubCompositor *self)
+{
+  if (self->toplevels->len) {
+    g_debug ("Closing %u toplevels", self->toplevels->len);
+    g_ptr_array_set_size (self->toplevels, 0);
+    self->cycle++;
+    return;
+  }
+
+  g_debug ("Opening %d toplevels", self->count);
+  for (int i = 0; i < self->count; i++) {
+    g_autofree char *app_id = g_strdup_printf ("org.example.App%d", i % self->n_app_ids);
+    g_autofree char *title = g_strdup_printf ("Window %d", i);
+
+    g_ptr_array_add (self->toplevels, toplevel_new (self, app_id, title));
+  }
+}
+
+
+static void
+run_hotplug_step (StubCompositor *self)
+{
+  g_autofree char *name = NULL;
+
+  /* Keep the first head around */
+  if (self->heads->len > 1) {
+    g_debug ("Unplugging %u heads", self->heads->len - 1);
+    g_ptr_array_set_size (self->heads, 1);
+    output_managers_send_done (self);
+    self->cycle++;
+    return;
+  }
+
+  for (int i = 0; i < self->count; i++) {
+    name = g_strdup_printf ("STUB-%u", ++self->n_heads_added);
+    g_ptr_array_add (self->heads, head_new (self, name));
+    g_clear_pointer (&name, g_free);
+  }
+  g_debug ("Plugged %d heads", self->count);
+  output_managers_send_done (self);
+}
+
+
+static gboolean
+on_scenario_step (gpointer data)
+{
+  StubCompositor *self = data;
+
+  if (self->cycles && self->cycle >= self->cycles) {
+    g_message ("Scenario '%s' done after %d cycles", self->scenario, self->cycle);
+    g_main_loop_quit (self->loop);
+    return G_SOURCE_REMOVE;
+  }
+
+  if (g_strcmp0 (self->scenario, "toplevels") == 0)
+    run_toplevels_step (self);
+  else if (g_strcmp0 (self->scenario, "hotplug") == 0)
+    run_hotplug_step (self);
+
+  wl_display_flush_clients (self->display);
+  return G_SOURCE_CONTINUE;
+}
+
+
+static gboolean
+on_wayland_event (int fd, GIOCondition condition, gpointer data)
+{
+  StubCompositor *self = data;
+
+  wl_event_loop_dispatch (wl_display_get_event_loop (self->display), 0);
+  wl_display_flush_clients (self->display);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static gboolean
+on_shutdown_signal (gpointer data)
+{
+  StubCompositor *self = data;
+
+  g_main_loop_quit (self->loop);
+  return G_SOURCE_REMOVE;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  g_autoptr (GOptionContext) opt_context = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autofree char *socket = NULL;
+  g_autofree char *scenario = NULL;
+  StubCompositor self = { 0 };
+  int count = 100, n_app_ids = 20, cycles = 0, interval = 500;
+  struct wl_event_loop *event_loop;
+  const GOptionEntry options [] = {
+    {"socket", 's', 0, G_OPTION_ARG_STRING, &socket,
+     "The Wayland socket name (default: ms-stub-0)", NULL},
+    {"scenario", 0, 0, G_OPTION_ARG_STRING, &scenario,
+     "The scenario to run: 'toplevels', 'hotplug' or 'none' (default: toplevels)", NULL},
+    {"count", 'n', 0, G_OPTION_ARG_INT, &count,
+     "Number of toplevels or heads per cycle (default: 100)", NULL},
+    {"app-ids", 'a', 0, G_OPTION_ARG_INT, &n_app_ids,
+     "Number of distinct app-ids (default: 20)", NULL},
+    {"cycles", 'c', 0, G_OPTION_ARG_INT, &cycles,
+     "Number of cycles to run, 0 runs forever (default: 0)", NULL},
+    {"interval", 'i', 0, G_OPTION_ARG_INT, &interval,
+     "Interval between scenario steps in ms (default: 500)", NULL},
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+  };
+
+  opt_context = g_option_context_new ("- stub compositor for the toplevel and head trackers");
+  g_option_context_add_main_entries (opt_context, options, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return EXIT_FAILURE;
+  }
+
+  if (count < 1 || n_app_ids < 1 || cycles < 0 || interval < 1) {
+    g_printerr ("Invalid scenario parameters\n");
+    return EXIT_FAILURE;
+  }
+
+  self.scenario = scenario ?: "toplevels";
+  self.count = count;
+  self.n_app_ids = n_app_ids;
+  self.cycles = cycles;
+  self.toplevels = g_ptr_array_new_with_free_func (toplevel_close);
+  self.heads = g_ptr_array_new_with_free_func (head_remove);
+  wl_list_init (&self.toplevel_managers);
+  wl_list_init (&self.output_managers);
+
+  self.display = wl_display_create ();
+  if (wl_display_add_socket (self.display, socket ?: "ms-stub-0") != 0) {
+    g_printerr ("Failed to add socket %s\n", socket ?: "ms-stub-0");
+    return EXIT_FAILURE;
+  }
+
+  wl_global_create (self.display, &zwlr_foreign_toplevel_manager_v1_interface,
+                    TOPLEVEL_MANAGER_VERSION, &self, bind_toplevel_manager);
+  wl_global_create (self.display, &zwlr_output_manager_v1_interface,
+                    OUTPUT_MANAGER_VERSION, &self, bind_output_manager);
+  g_ptr_array_add (self.heads, head_new (&self, "STUB-0"));
+
+  self.loop = g_main_loop_new (NULL, FALSE);
+  event_loop = wl_display_get_event_loop (self.display);
+  g_unix_fd_add (wl_event_loop_get_fd (event_loop), G_IO_IN, on_wayland_event, &self);
+  g_unix_signal_add (SIGINT, on_shutdown_signal, &self);
+  g_unix_signal_add (SIGTERM, on_shutdown_signal, &self);
+  if (g_strcmp0 (self.scenario, "none"))
+    g_timeout_add (interval, on_scenario_step, &self);
+
+  g_message ("Running scenario '%s' on WAYLAND_DISPLAY=%s", self.scenario, socket ?: "ms-stub-0");
+  g_main_loop_run (self.loop);
+
+  wl_display_destroy_clients (self.display);
+  g_clear_pointer (&self.toplevels, g_ptr_array_unref);
+  g_clear_pointer (&self.heads, g_ptr_array_unref);
+  wl_display_destroy (self.display);
+  g_main_loop_unref (self.loop);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2024 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "ms-tracker-bench"
+
+#include "mobile-settings-config.h"
+
+#include "ms-head-tracker.h"
+#include "ms-toplevel-tracker.h"
+
+#include "protocols/wlr-foreign-toplevel-management-unstable-v1-client-protocol.h"
+#include "protocols/wlr-output-management-unstable-v1-client-protocol.h"
+
+#include <glib-unix.h>
+#include <wayland-client.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Connects MsToplevelTracker and MsHeadTracker to a compositor
+ * (usually ms-stub-compositor) and measures how long it takes from
+ * reading a burst of Wayland events until the trackers' list models
+ * are updated. It also estimates the memory used per toplevel from
+ * the process' resident set size.
+ */
+
+typedef struct {
+  const char *name;
+  GArray     *latencies;
+  gint64      burst_start;
+} BenchModel;
+
+typedef struct {
+  struct wl_display  *display;
+  struct wl_registry *registry;
+  GMainLoop          *loop;
+
+  struct zwlr_foreign_toplevel_manager_v1 *foreign_toplevel_manager;
+  struct zwlr_output_manager_v1           *output_manager;
+  MsToplevelTracker  *toplevel_tracker;
+  MsHeadTracker      *head_tracker;
+
+  BenchModel          toplevels;
+  BenchModel          heads;
+  guint               quiesce_id;
+
+  gint64              rss_baseline;
+  gint64              rss_peak;
+  guint               n_toplevels_peak;
+} Bench;
+
+
+static gint64
+get_rss (void)
+{
+  g_autofree char *contents = NULL;
+  g_auto (GStrv) fields = NULL;
+
+  if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    return -1;
+
+  fields = g_strsplit (contents, " ", -1);
+  if (g_strv_length (fields) < 2)
+    return -1;
+
+  return g_ascii_strtoll (fields[1], NULL, 10) * sysconf (_SC_PAGESIZE);
+}
+
+
+static int
+compare_latencies (gconstpointer a, gconstpointer b)
+{
+  gint64 la = *(gint64 *)a, lb = *(gint64 *)b;
+
+  return (la > lb) - (la < lb);
+}
+
+
+static void
+bench_model_record (BenchModel *model)
+{
+  gint64 latency;
+
+  if (model->burst_start == 0)
+    return;
+
+  latency = g_get_monotonic_time () - model->burst_start;
+  g_array_append_val (model->latencies, latency);
+  model->burst_start = 0;
+}
+
+
+static void
+bench_model_report (BenchModel *model)
+{
+  GArray *l = model->latencies;
+
+  if (l->len == 0) {
+    g_print ("%s: no updates\n", model->name);
+    return;
+  }
+
+  g_array_sort (l, compare_latencies);
+  g_print ("%s: %u updates, latency µs min %" G_GINT64_FORMAT
+           ", median %" G_GINT64_FORMAT
+           ", p95 %" G_GINT64_FORMAT
+           ", max %" G_GINT64_FORMAT "\n",
+           model->name,
+           l->len,
+           g_array_index (l, gint64, 0),
+           g_array_index (l, gint64, l->len / 2),
+           g_array_index (l, gint64, (l->len * 95) / 100),
+           g_array_index (l, gint64, l->len - 1));
+}
+
+
+static void
+on_toplevels_changed (Bench *self, guint position, guint removed, guint added, GListModel *model)
+{
+  guint n_toplevels = 0;
+
+  bench_model_record (&self->toplevels);
+
+  for (guint i = 0; i < g_list_model_get_n_items (model); i++) {
+    g_autoptr (MsRunningApp) app = g_list_model_get_item (model, i);
+
+    n_toplevels += ms_running_app_get_n_toplevels (app);
+  }
+
+  if (n_toplevels > self->n_toplevels_peak) {
+    self->n_toplevels_peak = n_toplevels;
+    self->rss_peak = get_rss ();
+  }
+}
+
+
+static void
+on_heads_changed (Bench *self, guint position, guint removed, guint added, GListModel *model)
+{
+  bench_model_record (&self->heads);
+}
+
+
+static gboolean
+on_quiesce (gpointer data)
+{
+  Bench *self = data;
+
+  /* Everything got processed, bursts that didn't touch a model don't count */
+  self->toplevels.burst_start = 0;
+  self->heads.burst_start = 0;
+  self->quiesce_id = 0;
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+on_wayland_event (int fd, GIOCondition condition, gpointer data)
+{
+  Bench *self = data;
+  gint64 now = g_get_monotonic_time ();
+
+  if (condition & (G_IO_HUP | G_IO_ERR)) {
+    g_message ("Compositor went away");
+    g_main_loop_quit (self->loop);
+    return G_SOURCE_REMOVE;
+  }
+
+  /* We can't tell which tracker a burst is for before dispatching it */
+  if (self->toplevels.burst_start == 0)
+    self->toplevels.burst_start = now;
+  if (self->heads.burst_start == 0)
+    self->heads.burst_start = now;
+
+  if (wl_display_dispatch (self->display) < 0) {
+    g_warning ("Failed to dispatch Wayland events");
+    g_main_loop_quit (self->loop);
+    return G_SOURCE_REMOVE;
+  }
+  wl_display_flush (self->display);
+
+  /* Runs after the trackers' model updates */
+  if (self->quiesce_id == 0)
+    self->quiesce_id = g_idle_add_full (G_PRIORITY_LOW, on_quiesce, self, NULL);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+registry_handle_global (void               *data,
+                        struct wl_registry *registry,
+                        uint32_t            name,
+                        const char         *interface,
+                        uint32_t            version)
+{
+  Bench *self = data;
+
+  if (strcmp (interface, zwlr_foreign_toplevel_manager_v1_interface.name) == 0) {
+    self->foreign_toplevel_manager =
+      wl_registry_bind (registry, name, &zwlr_foreign_toplevel_manager_v1_interface, 1);
+  } else if (strcmp (interface, zwlr_output_manager_v1_interface.name) == 0) {
+    self->output_manager =
+      wl_registry_bind (registry, name, &zwlr_output_manager_v1_interface, 2);
+  }
+}
+
+
+static void
+registry_handle_global_remove (void               *data,
+                               struct wl_registry *registry,
+                               uint32_t            name)
+{
+}
+
+
+static const struct wl_registry_listener registry_listener = {
+  registry_handle_global,
+  registry_handle_global_remove
+};
+
+
+static gboolean
+on_timeout (gpointer data)
+{
+  Bench *self = data;
+
+  g_main_loop_quit (self->loop);
+  return G_SOURCE_REMOVE;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  g_autoptr (GOptionContext) opt_context = NULL;
+  g_autoptr (GError) err = NULL;
+  Bench self = { 0 };
+  int duration = 10;
+  gboolean expect_toplevels = FALSE;
+  int ret = EXIT_SUCCESS;
+  const GOptionEntry options [] = {
+    {"duration", 'd', 0, G_OPTION_ARG_INT, &duration,
+     "Seconds to run the benchmark (default: 10)", NULL},
+    {"expect-toplevels", 0, 0, G_OPTION_ARG_NONE, &expect_toplevels,
+     "Fail if the toplevel model never got updated", NULL},
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+  };
+
+  opt_context = g_option_context_new ("- measure toplevel and head tracker latency");
+  g_option_context_add_main_entries (opt_context, options, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return EXIT_FAILURE;
+  }
+
+  self.display = wl_display_connect (NULL);
+  if (self.display == NULL) {
+    g_printerr ("Failed to connect to Wayland display\n");
+    return EXIT_FAILURE;
+  }
+
+  self.registry = wl_display_get_registry (self.display);
+  wl_registry_add_listener (self.registry, &registry_listener, &self);
+  wl_display_roundtrip (self.display);
+
+  if (self.foreign_toplevel_manager == NULL || self.output_manager == NULL) {
+    g_printerr ("Compositor lacks wlr-foreign-toplevel-management or wlr-output-management\n");
+    return EXIT_FAILURE;
+  }
+
+  self.toplevels.name = "toplevels";
+  self.toplevels.latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+  self.heads.name = "heads";
+  self.heads.latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+  self.rss_baseline = get_rss ();
+
+  self.toplevel_tracker = ms_toplevel_tracker_new (self.foreign_toplevel_manager);
+  g_signal_connect_swapped (self.toplevel_tracker, "items-changed",
+                            G_CALLBACK (on_toplevels_changed), &self);
+  self.head_tracker = ms_head_tracker_new (self.output_manager);
+  g_signal_connect_swapped (ms_head_tracker_get_heads (self.head_tracker), "items-changed",
+                            G_CALLBACK (on_heads_changed), &self);
+
+  self.loop = g_main_loop_new (NULL, FALSE);
+  g_unix_fd_add (wl_display_get_fd (self.display), G_IO_IN | G_IO_HUP | G_IO_ERR,
+                 on_wayland_event, &self);
+  g_unix_signal_add (SIGINT, on_timeout, &self);
+  g_timeout_add_seconds (duration, on_timeout, &self);
+  wl_display_flush (self.display);
+
+  g_main_loop_run (self.loop);
+
+  bench_model_report (&self.toplevels);
+  bench_model_report (&self.heads);
+  if (expect_toplevels && self.toplevels.latencies->len == 0) {
+    g_printerr ("No toplevel updates seen\n");
+    ret = EXIT_FAILURE;
+  }
+  if (self.n_toplevels_peak && self.rss_baseline > 0 && self.rss_peak > 0) {
+    g_print ("peak of %u toplevels, ~%" G_GINT64_FORMAT " bytes RSS per toplevel\n",
+             self.n_toplevels_peak,
+             (self.rss_peak - self.rss_baseline) / self.n_toplevels_peak);
+  }
+
+  g_clear_object (&self.toplevel_tracker);
+  g_clear_object (&self.head_tracker);
+  g_array_unref (self.toplevels.latencies);
+  g_array_unref (self.heads.latencies);
+  g_main_loop_unref (self.loop);
+  wl_display_disconnect (self.display);
+
+  return ret;
+}